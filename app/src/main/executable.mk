@@ -9,6 +9,6 @@ include $(PREBUILT_SHARED_LIBRARY)
 include $(CLEAR_VARS)
 LOCAL_MODULE    := puzzlesgen$(PUZZLESGEN_SUFFIX)
 LOCAL_CFLAGS    := -DSLOW_SYSTEM -DANDROID -DSTYLUS_BASED -DNO_PRINTING -DCOMBINED -DEXECUTABLE
-LOCAL_SRC_FILES := jni/android-gen.c
+LOCAL_SRC_FILES := jni/android-gen.c jni/android-bench.c
 LOCAL_SHARED_LIBRARIES := libpuzzles-prebuilt
 include $(BUILD_EXECUTABLE)
@@ -1,5 +1,7 @@
 package name.boyle.chris.sgtpuzzles;
 
+import java.io.BufferedInputStream;
+import java.io.DataInputStream;
 import java.io.File;
 import java.io.FileInputStream;
 import java.io.FileOutputStream;
@@ -7,6 +9,7 @@ import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
 import java.lang.ref.WeakReference;
+import java.nio.ByteBuffer;
 import java.nio.charset.Charset;
 import java.text.MessageFormat;
 import java.util.ArrayList;
@@ -41,6 +44,7 @@ import android.content.pm.ResolveInfo;
 import android.content.res.Configuration;
 import android.content.res.Resources;
 import android.database.Cursor;
+import android.graphics.Bitmap;
 import android.graphics.Color;
 import android.graphics.PointF;
 import android.graphics.PorterDuff;
@@ -69,6 +73,7 @@ import android.support.v7.app.ActionBarActivity;
 import android.text.InputType;
 import android.util.DisplayMetrics;
 import android.util.Log;
+import android.view.Choreographer;
 import android.view.Gravity;
 import android.view.KeyEvent;
 import android.view.Menu;
@@ -98,6 +103,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private static final String BRIDGES_SHOW_H_KEY = "bridgesShowH";
 	private static final String FULLSCREEN_KEY = "fullscreen";
 	private static final String STAY_AWAKE_KEY = "stayAwake";
+	private static final String NATIVE_RENDERING_KEY = "nativeRendering";
 	private static final String UNDO_REDO_KBD_KEY = "undoRedoOnKeyboard";
 	private static final boolean UNDO_REDO_KBD_DEFAULT = true;
 	private static final String PATTERN_SHOW_LENGTHS_KEY = "patternShowLengths";
@@ -110,6 +116,8 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	public static final String SAVED_GAME_PREFIX = "savedGame_";
 	public static final String LAST_PARAMS_PREFIX = "last_params_";
 	private static final String PUZZLESGEN_LAST_UPDATE = "puzzlesgen_last_update";
+	private static final String PUZZLESGEN_POOL_FILE = "puzzlesgen-pool";
+	private static final int MAX_RACE_THREADS = 4;
 	private static final String BLUETOOTH_PACKAGE_PREFIX = "com.android.bluetooth";
 
 	private static final int REQ_CODE_CREATE_DOC = Activity.RESULT_FIRST_USER;
@@ -123,8 +131,12 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private SubMenu typeMenu;
 	private Map<String, String> gameTypes;
 	private int currentType = 0;
-	private boolean workerRunning = false;
+	private volatile boolean workerRunning = false;
+	private final Object gameGenLock = new Object();
 	private Process gameGenProcess = null;
+	private InputStream gameGenOutput = null;
+	/** Set while generateGame talks to the generator; guarded by gameGenLock. */
+	private boolean gameGenBusy = false;
 	private boolean solveEnabled = false, customVisible = false,
 			undoEnabled = false, redoEnabled = false;
 	private SharedPreferences prefs, state;
@@ -133,6 +145,8 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	static final long MAX_SAVE_SIZE = 1000000; // 1MB; we only have 16MB of heap
 	private boolean gameWantsTimer = false;
 	static final int TIMER_INTERVAL = 20;
+	private long frameIntervalNanos = TIMER_INTERVAL * 1000000L;
+	private VsyncTicker vsyncTicker = null;
 	private StringBuffer savingState;
 	private AlertDialog dialog;
 	private int dialogEvent;
@@ -175,16 +189,62 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private void handleMessage(Message msg) {
 		switch( MsgType.values()[msg.what] ) {
 		case TIMER:
-			if( progress == null ) timerTick();
-			if( gameWantsTimer ) {
-				handler.sendMessageDelayed(
-						handler.obtainMessage(MsgType.TIMER.ordinal()),
-						TIMER_INTERVAL);
-			}
+			tick(System.nanoTime(), TIMER_INTERVAL * 1000000L);
 			break;
 		}
 	}
 
+	/** Ticks the game's timer on each frame of the display, where there's Choreographer to say when. */
+	@TargetApi(Build.VERSION_CODES.JELLY_BEAN)
+	private class VsyncTicker implements Choreographer.FrameCallback {
+		// the UI thread's, as requestTimer may come from the game generation thread
+		private final Choreographer choreographer = Choreographer.getInstance();
+		private boolean posted = false;
+
+		synchronized void schedule() {
+			if (posted) return;
+			posted = true;
+			choreographer.postFrameCallback(this);
+		}
+
+		synchronized void cancel() {
+			posted = false;
+			choreographer.removeFrameCallback(this);
+		}
+
+		@Override
+		public void doFrame(long frameTimeNanos) {
+			synchronized (this) {
+				posted = false;
+			}
+			tick(frameTimeNanos, frameIntervalNanos);
+		}
+	}
+
+	private void scheduleTick() {
+		if (vsyncTicker != null) {
+			vsyncTicker.schedule();
+		} else if (! handler.hasMessages(MsgType.TIMER.ordinal())) {
+			handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()), TIMER_INTERVAL);
+		}
+	}
+
+	private void cancelTicks() {
+		if (vsyncTicker != null) vsyncTicker.cancel();
+		handler.removeMessages(MsgType.TIMER.ordinal());
+	}
+
+	private void tick(long frameTimeNanos, long intervalNanos) {
+		if( progress == null ) timerTick(frameTimeNanos, intervalNanos);
+		if( gameWantsTimer ) {
+			scheduleTick();
+		} else if (progress == null && BuildConfig.DEBUG) {
+			// that was the end of an animation (or of a game with a clock)
+			final String stats = getFrameStats();
+			if (stats != null) Log.d(TAG, "frames: " + stats);
+		}
+	}
+
 	private void showProgress(int msgId, final boolean returnToChooser)
 	{
 		progress = new ProgressDialog(this);
@@ -219,7 +279,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	{
 		if (currentBackend == null || progress != null) return null;
 		savingState = new StringBuffer();
-		serialise();  // serialiseWrite() callbacks will happen in here
+		serialise();  // serialiseWrite() callback will happen in here, once
 		String s = savingState.toString();
 		savingState = null;
 		return s;
@@ -279,6 +339,12 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		statusBar = (TextView)findViewById(R.id.statusBar);
 		gameView = (GameView)findViewById(R.id.game);
 		keyboard = (SmallKeyboard)findViewById(R.id.keyboard);
+		applyNativeRendering();
+		final float refreshRate = getWindowManager().getDefaultDisplay().getRefreshRate();
+		if (refreshRate >= 10) frameIntervalNanos = Math.round(1e9 / refreshRate);
+		if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.JELLY_BEAN) {
+			vsyncTicker = new VsyncTicker();
+		}
 		dialogIds = new ArrayList<String>();
 		setDefaultKeyMode(DEFAULT_KEYS_SHORTCUT);
 		gameView.requestFocus();
@@ -680,30 +746,60 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	}
 
 	private String generateGame(final List<String> args) throws IllegalArgumentException, IOException {
-		String game;
-		startGameGenProcess(args);
-		OutputStream stdin = gameGenProcess.getOutputStream();
-		stdin.close();
-		game = Utils.readAllOf(gameGenProcess.getInputStream());
-		if (game.length() == 0) game = null;
-		int exitStatus = Utils.waitForProcess(gameGenProcess);
-		if (exitStatus != 0) {
-			String error = game;
-			if (error != null && error.length() > 0) {  // probably bogus params
-				throw new IllegalArgumentException(error);
-			} else if (workerRunning) {
-				error = "Game generation exited with status "+exitStatus;
-				Log.e(TAG, error);
-				throw new IOException(error);
+		final OutputStream toGen;
+		final InputStream fromGen;
+		synchronized (gameGenLock) {
+			if (!workerRunning) return null;  // cancelled before we started
+			if (gameGenProcess == null) startGameGenProcess();
+			toGen = gameGenProcess.getOutputStream();
+			fromGen = gameGenOutput;
+			gameGenBusy = true;
+		}
+		try {
+			final StringBuilder request = new StringBuilder();
+			for (String arg : args) {
+				if (request.length() > 0) request.append('\t');
+				request.append(arg);
+			}
+			request.append('\n');
+			toGen.write(request.toString().getBytes());
+			toGen.flush();
+			// Response is "OK <len>" or "ERROR <len>" then exactly len bytes
+			final String header = Utils.readLine(fromGen);
+			if (header == null) throw new IOException("Game generation process exited");
+			final int space = header.indexOf(' ');
+			final int length;
+			try {
+				length = (space < 0) ? -1 : Integer.parseInt(header.substring(space + 1));
+			} catch (NumberFormatException e) {
+				throw new IOException("Bad response from game generation process: " + header);
+			}
+			if (length < 0) throw new IOException("Bad response from game generation process: " + header);
+			final byte[] body = new byte[length];
+			new DataInputStream(fromGen).readFully(body);
+			if (!workerRunning) return null;  // cancelled
+			final String status = header.substring(0, space);
+			if (status.equals("ERROR")) {
+				throw new IllegalArgumentException(new String(body));  // probably bogus params
+			} else if (!status.equals("OK")) {
+				throw new IOException("Bad response from game generation process: " + header);
+			}
+			return (length == 0) ? null : new String(body);
+		} catch (IOException e) {
+			if (!workerRunning) return null;  // cancelled: stopNative killed the process
+			Log.e(TAG, "Game generation failed", e);
+			stopGameGenProcess();
+			throw e;
+		} finally {
+			synchronized (gameGenLock) {
+				gameGenBusy = false;
 			}
-			// else cancelled
 		}
-		if( !workerRunning) return null;  // cancelled
-		return game;
 	}
 
+	/** Starts a long-lived puzzlesgen in server mode; caller must hold gameGenLock. */
 	@SuppressLint("CommitPrefEdits")
-	private void startGameGenProcess(final List<String> args) throws IOException {
+	private void startGameGenProcess() throws IOException {
 		final ApplicationInfo applicationInfo = getApplicationInfo();
 		final File dataDir = new File(applicationInfo.dataDir);
 		final File libDir;
@@ -725,16 +821,31 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 			prefsSaver.save(prefs.edit().putInt(PUZZLESGEN_LAST_UPDATE, BuildConfig.VERSION_CODE));
 		}
 		Utils.setExecutable(executablePath);
-		final String[] cmdLine = new String[args.size() + 1];
-		cmdLine[0] = executablePath.getAbsolutePath();
-		int i = 1;
-		for (String arg : args) cmdLine[i++] = arg;
+		// The pool of pre-generated games is only a cache: fine for the system to clear it
+		final int raceThreads = Math.max(1, Math.min(MAX_RACE_THREADS, Runtime.getRuntime().availableProcessors()));
+		final String[] cmdLine = new String[] { executablePath.getAbsolutePath(), "--server",
+				"--pool", new File(getCacheDir(), PUZZLESGEN_POOL_FILE).getAbsolutePath(),
+				"--race", Integer.toString(raceThreads) };
 		Log.d(TAG, "exec: " + Arrays.toString(cmdLine));
 		File libPuzDir = libDir;
 		final String SO = "libpuzzles.so";
 		if (! new File(libPuzDir, SO).exists() && new File(SYS_LIB, SO).exists()) libPuzDir = SYS_LIB;
 		gameGenProcess = Runtime.getRuntime().exec(cmdLine,
 				new String[]{"LD_LIBRARY_PATH="+libPuzDir}, libPuzDir);
+		gameGenOutput = new BufferedInputStream(gameGenProcess.getInputStream());
+	}
+
+	private void stopGameGenProcess() {
+		final Process process;
+		synchronized (gameGenLock) {
+			process = gameGenProcess;
+			gameGenProcess = null;
+			gameGenOutput = null;
+		}
+		if (process != null) {
+			Utils.closeQuietly(process.getOutputStream());  // server exits on EOF
+			process.destroy();
+		}
 	}
 
 	private void copyFile(File src, File dst) throws IOException {
@@ -957,11 +1068,15 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 
 	private void stopNative()
 	{
-		workerRunning = false;
-		if (gameGenProcess != null) {
-			gameGenProcess.destroy();
-			gameGenProcess = null;
+		final boolean busy;
+		// Clear workerRunning under the same lock generateGame checks it under before
+		// setting gameGenBusy, so either it sees the cancel or we see it busy
+		synchronized (gameGenLock) {
+			workerRunning = false;
+			busy = gameGenBusy;
 		}
+		// Only kill the generator to cancel a game in progress; otherwise keep it for next time
+		if (busy) stopGameGenProcess();
 		if (worker != null) {
 			while(true) { try {
 				worker.join();  // we may ANR if native code is spinning - safer than leaving a runaway native thread
@@ -973,7 +1088,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	@Override
 	protected void onPause()
 	{
-		handler.removeMessages(MsgType.TIMER.ordinal());
+		cancelTicks();
 		save();
 		super.onPause();
 	}
@@ -994,16 +1109,15 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	protected void onDestroy()
 	{
 		stopNative();
+		stopGameGenProcess();
 		super.onDestroy();
 	}
 
 	@Override
 	public void onWindowFocusChanged( boolean f )
 	{
-		if( f && gameWantsTimer && currentBackend != null
-				&& ! handler.hasMessages(MsgType.TIMER.ordinal()) )
-			handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()),
-					TIMER_INTERVAL);
+		if( f && gameWantsTimer && currentBackend != null )
+			scheduleTick();
 	}
 
 	void sendKey(PointF p, int k)
@@ -1261,8 +1375,8 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	{
 		if( gameWantsTimer && on ) return;
 		gameWantsTimer = on;
-		if( on ) handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()), TIMER_INTERVAL);
-		else handler.removeMessages(MsgType.TIMER.ordinal());
+		if( on ) scheduleTick();
+		else cancelTicks();
 	}
 
 	@UsedByJNI
@@ -1419,9 +1533,10 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	}
 
 	@UsedByJNI
-	void serialiseWrite(byte[] buffer)
+	void serialiseWrite(ByteBuffer buffer)
 	{
-		savingState.append(new String(buffer));
+		// buffer is native memory, only valid during this call
+		savingState.append(Charset.forName("UTF-8").decode(buffer));
 	}
 
 	private SmallKeyboard.ArrowMode lastArrowMode = SmallKeyboard.ArrowMode.NO_ARROWS;
@@ -1450,6 +1565,9 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 			applyFullscreen(true);  // = already started
 		} else if (key.equals(STAY_AWAKE_KEY)) {
 			applyStayAwake();
+		} else if (key.equals(NATIVE_RENDERING_KEY)) {
+			applyNativeRendering();
+			gameViewResized();  // redraw everything the new way
 		} else if (key.equals(ORIENTATION_KEY)) {
 			applyOrientation();
 		} else if (key.equals(UNDO_REDO_KBD_KEY)) {
@@ -1524,6 +1642,11 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		}
 	}
 
+	private void applyNativeRendering()
+	{
+		gameView.setNativeRendering(prefs.getBoolean(NATIVE_RENDERING_KEY, false));
+	}
+
 	@SuppressLint("InlinedApi")
 	private void applyOrientation() {
 		final String orientationPref = prefs.getString(ORIENTATION_KEY, "unspecified");
@@ -1604,7 +1727,8 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 
 	native void startPlaying(GameView _gameView, String savedGame);
 	native void startPlayingGameID(GameView _gameView, String whichBackend, String gameID);
-	native void timerTick();
+	native void timerTick(long frameTimeNanos, long intervalNanos);
+	native String getFrameStats();
 	native String htmlHelpTopic();
 	native void keyEvent(int x, int y, int k);
 	native void restartEvent();
@@ -1624,6 +1748,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	native void requestKeys(String backend, String params);
 	native void setCursorVisibility(boolean visible);
 	native float[] getColours();
+	native void setRasterTarget(Bitmap bitmap, int originX, int originY);
 	native String[] getPresets();
 	native String getGameTitle();
 	native int getUIVisibility();
@@ -34,6 +34,11 @@ import android.view.ScaleGestureDetector;
 import android.view.View;
 import android.view.ViewConfiguration;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.IntBuffer;
+import java.nio.charset.Charset;
+
 public class GameView extends View
 {
 	private GamePlay parent;
@@ -63,6 +68,14 @@ public class GameView extends View
     private static final int RELEASE = LEFT_RELEASE - LEFT_BUTTON;
 	static final int CURSOR_UP = 0x209, CURSOR_DOWN = 0x20a,
 			CURSOR_LEFT = 0x20b, CURSOR_RIGHT = 0x20c, MOD_NUM_KEYPAD = 0x4000;
+	// drawing commands and font type from drawbuf.c and puzzles.h
+	private static final int DRAW_RECT = 1, DRAW_LINE = 2, DRAW_POLYGON = 3, DRAW_CIRCLE = 4,
+			DRAW_TEXT = 5, DRAW_CLIP = 6, DRAW_UNCLIP = 7, DRAW_BLITTER_SAVE = 8,
+			DRAW_BLITTER_LOAD = 9, DRAW_UPDATE = 10, FONT_FIXED = 0;
+	private static final Charset UTF_8 = Charset.forName("UTF-8");
+	private byte[] textBytes = new byte[64];
+	private final RectF dirtyRect = new RectF();
+	private boolean nativeRendering = false;
 	int keysHandled = 0;  // debug
 	final boolean hasPinchZoom;
 	ScaleGestureDetector scaleDetector = null;
@@ -262,6 +275,7 @@ public class GameView extends View
 			edges[2].onRelease();
 		}
 		canvas.setMatrix(zoomMatrix);
+		updateRasterTarget();
 		invertZoomMatrix();  // now with our changes
 	}
 
@@ -322,6 +336,7 @@ public class GameView extends View
 	void resetZoomForClear() {
 		resetZoomMatrix();
 		canvas.setMatrix(zoomMatrix);
+		updateRasterTarget();
 		invertZoomMatrix();
 	}
 
@@ -348,6 +363,7 @@ public class GameView extends View
 		zoomMatrix.postConcat(zoomInProgressMatrix);
 		zoomInProgressMatrix.reset();
 		canvas.setMatrix(zoomMatrix);
+		updateRasterTarget();
 		invertZoomMatrix();
 		if (parent != null) {
 			clear();
@@ -356,6 +372,28 @@ public class GameView extends View
 		ViewCompat.postInvalidateOnAnimation(GameView.this);
 	}
 
+	void setNativeRendering(boolean enabled) {
+		nativeRendering = enabled;
+		updateRasterTarget();
+	}
+
+	/**
+	 * Lets native code draw straight into our bitmap, if the user wants it to, while we're not
+	 * zoomed: it works in the bitmap's own pixels, without the canvas matrix.
+	 */
+	private void updateRasterTarget() {
+		if (parent == null) return;
+		final float[] values = new float[9];
+		zoomMatrix.getValues(values);
+		final boolean unzoomed = values[Matrix.MSCALE_X] == 1.f && values[Matrix.MSCALE_Y] == 1.f
+				&& values[Matrix.MSKEW_X] == 0.f && values[Matrix.MSKEW_Y] == 0.f;
+		if (nativeRendering && unzoomed) {
+			parent.setRasterTarget(bitmap, Math.round(values[Matrix.MTRANS_X]), Math.round(values[Matrix.MTRANS_Y]));
+		} else {
+			parent.setRasterTarget(null, 0, 0);
+		}
+	}
+
 	private float getXScale(Matrix m) {
 		float[] values = new float[9];
 		m.getValues(values);
@@ -593,6 +631,18 @@ public class GameView extends View
 	public void clear()
 	{
 		bitmap.eraseColor(backgroundColour);
+		postInvalidate();  // the game will only say which parts of this it redraws
+	}
+
+	/** Invalidates where this area of the bitmap is on screen, plus a pixel for anti-aliasing. */
+	private void invalidateDrawn(int x, int y, int w, int h)
+	{
+		dirtyRect.set(x - 1, y - 1, x + w + 1, y + h + 1);
+		zoomMatrix.mapRect(dirtyRect);
+		zoomInProgressMatrix.mapRect(dirtyRect);
+		dirtyRect.offset(-overdrawX, -overdrawY);
+		postInvalidate((int) Math.floor(dirtyRect.left), (int) Math.floor(dirtyRect.top),
+				(int) Math.ceil(dirtyRect.right), (int) Math.ceil(dirtyRect.bottom));
 	}
 
 	@Override
@@ -606,7 +656,6 @@ public class GameView extends View
 		return getResources().getColor(R.color.game_background);
 	}
 
-	@UsedByJNI
 	void clipRect(int x, int y, int w, int h)
 	{
 		canvas.clipRect(new RectF(x - 0.5f, y - 0.5f, x + w - 0.5f, y + h - 0.5f), Region.Op.REPLACE);
@@ -618,7 +667,6 @@ public class GameView extends View
 		canvas.clipRect(marginX - 0.5f, marginY - 0.5f, w - marginX - 1.5f, h - marginY - 1.5f, Region.Op.REPLACE);
 	}
 
-	@UsedByJNI
 	void fillRect(final int x, final int y, final int w, final int h, final int colour)
 	{
 		paint.setColor(colours[colour]);
@@ -634,25 +682,24 @@ public class GameView extends View
 		paint.setAntiAlias(true);
 	}
 
-	@UsedByJNI
 	void drawLine(int x1, int y1, int x2, int y2, int colour)
 	{
 		paint.setColor(colours[colour]);
 		canvas.drawLine(x1, y1, x2, y2, paint);
 	}
 
-	@UsedByJNI
-	void drawPoly(int[] points, int ox, int oy, int line, int fill)
+	/** Draws the polygon whose points start at cmds[start]; see {@link #drawCommands}. */
+	void drawPoly(IntBuffer cmds, int start, int nPoints, int line, int fill)
 	{
 		Path path = new Path();
-		path.moveTo(points[0] + ox, points[1] + oy);
-		for(int i=1; i < points.length/2; i++) {
-			path.lineTo(points[2 * i] + ox, points[2 * i + 1] + oy);
+		path.moveTo(cmds.get(start), cmds.get(start + 1));
+		for(int i=1; i < nPoints; i++) {
+			path.lineTo(cmds.get(start + 2 * i), cmds.get(start + 2 * i + 1));
 		}
 		path.close();
 		// cheat slightly: polygons up to square look prettier without (and adjacent squares want to
 		// look continuous in lightup)
-		boolean disableAntiAlias = points.length <= 8;  // 2 per point
+		boolean disableAntiAlias = nPoints <= 4;
 		if (disableAntiAlias) paint.setAntiAlias(false);
 		drawPoly(path, line, fill);
 		paint.setAntiAlias(true);
@@ -670,7 +717,6 @@ public class GameView extends View
 		canvas.drawPath(p, paint);
 	}
 
-	@UsedByJNI
 	void drawCircle(int x, int y, int r, int lineColour, int fillColour)
 	{
 		if (fillColour != -1) {
@@ -683,7 +729,6 @@ public class GameView extends View
 		canvas.drawOval(new RectF(x-r, y-r, x+r, y+r), paint);
 	}
 
-	@UsedByJNI
 	void drawText(int x, int y, int flags, int size, int colour, String text)
 	{
 		paint.setColor(colours[colour]);
@@ -699,6 +744,73 @@ public class GameView extends View
 		canvas.drawText(text, x, y, paint);
 	}
 
+	/**
+	 * Replays a frame's drawing as recorded by drawbuf.c (the format is in puzzles.h): each
+	 * command is an opcode and its arguments as native-order ints, and text is UTF-8 padded
+	 * to a whole int.
+	 */
+	@UsedByJNI
+	void drawCommands(ByteBuffer buffer)
+	{
+		buffer.order(ByteOrder.nativeOrder());
+		final IntBuffer cmds = buffer.asIntBuffer();
+		final int len = cmds.limit();
+		int p = 0;
+		while (p < len) {
+			switch (cmds.get(p)) {
+			case DRAW_RECT:
+				fillRect(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3), cmds.get(p + 4), cmds.get(p + 5));
+				p += 6;
+				break;
+			case DRAW_LINE:
+				drawLine(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3), cmds.get(p + 4), cmds.get(p + 5));
+				p += 6;
+				break;
+			case DRAW_POLYGON:
+				drawPoly(cmds, p + 4, cmds.get(p + 1), cmds.get(p + 3), cmds.get(p + 2));
+				p += 4 + 2 * cmds.get(p + 1);
+				break;
+			case DRAW_CIRCLE:
+				drawCircle(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3), cmds.get(p + 5), cmds.get(p + 4));
+				p += 6;
+				break;
+			case DRAW_TEXT: {
+				final int n = cmds.get(p + 7);
+				if (n > textBytes.length) textBytes = new byte[n];
+				buffer.position(4 * (p + 8));
+				buffer.get(textBytes, 0, n);
+				final int flags = (cmds.get(p + 3) == FONT_FIXED ? TEXT_MONO : 0) | cmds.get(p + 5);
+				drawText(cmds.get(p + 1), cmds.get(p + 2), flags, cmds.get(p + 4), cmds.get(p + 6),
+						new String(textBytes, 0, n, UTF_8));
+				p += 8 + (n + 3) / 4;
+				break;
+			}
+			case DRAW_CLIP:
+				clipRect(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3), cmds.get(p + 4));
+				p += 5;
+				break;
+			case DRAW_UNCLIP:
+				unClip(cmds.get(p + 1), cmds.get(p + 2));
+				p += 3;
+				break;
+			case DRAW_BLITTER_SAVE:
+				blitterSave(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3));
+				p += 4;
+				break;
+			case DRAW_BLITTER_LOAD:
+				blitterLoad(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3));
+				p += 4;
+				break;
+			case DRAW_UPDATE:
+				invalidateDrawn(cmds.get(p + 1), cmds.get(p + 2), cmds.get(p + 3), cmds.get(p + 4));
+				p += 5;
+				break;
+			default:
+				throw new RuntimeException("Unknown drawing command " + cmds.get(p));
+			}
+		}
+	}
+
 	@UsedByJNI
 	int blitterAlloc(int w, int h)
 	{
@@ -720,7 +832,6 @@ public class GameView extends View
 		blitters[i] = null;
 	}
 
-	@UsedByJNI
 	void blitterSave(int i, int x, int y)
 	{
 		if( blitters[i] == null ) return;
@@ -733,7 +844,6 @@ public class GameView extends View
 		c.drawBitmap(bitmap, m, null);
 	}
 
-	@UsedByJNI
 	void blitterLoad(int i, int x, int y)
 	{
 		if( blitters[i] == null ) return;
@@ -29,6 +29,19 @@ public abstract class Utils {
 		return log.toString();
 	}
 
+	/** Reads a line of bytes up to '\n' without buffering beyond it; null at EOF. */
+	@Nullable
+	static String readLine(InputStream s) throws IOException
+	{
+		StringBuilder line = new StringBuilder();
+		int c;
+		while ((c = s.read()) != '\n') {
+			if (c < 0) return (line.length() > 0) ? line.toString() : null;
+			line.append((char) c);
+		}
+		return line.toString();
+	}
+
 	static void closeQuietly(@Nullable Closeable c)
 	{
 		if (c == null) return;
@@ -0,0 +1,1642 @@
+#ifdef EXECUTABLE
+/*
+ * android-bench.c: benchmarks built into puzzlesgen.
+ *
+ * "puzzlesgen --bench" runs new_desc for every preset of every game (or
+ * of the games named) on a fixed list of seeds, and writes one
+ * tab-separated line per preset so that runs from different builds or
+ * devices can be diffed:
+ *
+ *   game preset params runs timeouts min_ms median_ms p95_ms max_ms
+ *   peak_heap_bytes attempts
+ *
+ * The seeds are "bench0", "bench1" and so on, which use the original
+ * SHA-1 random number generator; with "--rng fast" they get
+ * RANDOM_FAST_PREFIX on the front and use xoshiro256** instead, which
+ * is what new games get, so the two can be compared. They make
+ * different puzzles from the same seed, though, and that can move a
+ * preset's median further than the generator itself does.
+ *
+ * "puzzlesgen --bench --save" instead times midend_serialise on a Net
+ * game with a long history of moves, writing into a serialise_buf, and
+ * reports how many calls it made to the write function per save. It
+ * also times midend_deserialise on a save of that game with no
+ * checkpoints in it (as older versions wrote, so every move has to be
+ * replayed), on the one we wrote (which has them), and on the same
+ * again in the binary form (which only puzzlesgen writes; the app
+ * saves text), and checks that save_convert takes each form to the
+ * other exactly.
+ *
+ * "puzzlesgen --bench --undo" loads a long game of 50x50 Net with no
+ * undo budget and then with one, and reports how many game_states each
+ * holds after loading and after undoing to the start, the heap used
+ * by loading, and the time to undo all the way back and redo again.
+ *
+ * "puzzlesgen --bench --drag" drags the mouse around big boards of a
+ * few games, and reports the allocations and time per input event, and
+ * how many of the drags ended up as moves.
+ *
+ * "puzzlesgen --bench --frame" redraws big boards of a few games from
+ * scratch, once straight through to a drawing_api that does nothing
+ * and once recorded into a drawbuf as the Android front end does, and
+ * reports the primitives per frame (each of which was a JNI call, and
+ * each text and polygon a Java object too, before they were batched),
+ * the size of the recording, and the time to draw, record and replay.
+ *
+ * "puzzlesgen --bench --dirty" clicks around big boards of a few
+ * games, with draw_updates passed straight through and then merged by
+ * drawing.c at a few tolerances, and reports the update rectangles the
+ * front end got for the first, full, frame and then per frame, and how
+ * much of the window they covered (overlaps counting twice) as against
+ * what the game asked for.
+ *
+ * "puzzlesgen --bench --replay" loads each save file given (or each
+ * file in each directory given) and redraws it from scratch, then
+ * undoes every move and redoes them again, running the animations and
+ * flashes in between at 60 ticks a second. It counts what each game's
+ * redraw draws, and writes one line per file for each of those two
+ * parts:
+ *
+ *   file game phase frames prims_per_frame texts_per_frame
+ *   updates_per_frame update_pct_per_frame cpu_us_per_frame
+ *
+ * where the updates are the draw_updates as the game made them, before
+ * drawing.c merges them, and their area is a percentage of the window.
+ *
+ * "puzzlesgen --bench --anim" makes some moves in a few games with
+ * long animations, then undoes them all, drawing the animations into
+ * pixels with raster_drawing on ticks of a pretend 60Hz display. It
+ * does that once drawing on every tick and once paced by pacing.c, and
+ * reports the frames drawn and ticks skipped, frame times, and how
+ * much of the animations' time went on drawing. Frame times are the
+ * CPU time here multiplied by --slowdown, to stand in for a slower
+ * device.
+ *
+ * "puzzlesgen --bench --dsf" runs the same merges and lookups through
+ * a dsf merged by least index (dsf_merge) and one merged by size
+ * (dsf_merge_by_size, keeping the minimums), on a square grid of
+ * --size squares a side. The merges are shaped like the games' use of
+ * them: "regions" joins neighbouring squares in random order, checking
+ * first whether they're already joined, as Galaxies, Filling and
+ * Bridges do when finding regions, then looks up every square once;
+ * "sweep" joins the same squares working back from the bottom right,
+ * as a solver working through the grid in the other direction would;
+ * and "parity" joins random pairs as the same or opposite, with
+ * lookups in between, as Loopy's linedsf does. It reports the depth of
+ * the trees before the final lookups and the time per operation, and
+ * checks that both give the same classes and least elements. (The
+ * solvers themselves are timed by plain --bench on those games.)
+ *
+ * "puzzlesgen --bench --tree" runs tree234 workloads shaped like Flip's
+ * generator and Mines' set store (ss_add and ss_remove), which insert
+ * and delete a great deal, once on trees from newtree234 and once on
+ * pooled ones from newpooltree234. It reports the allocations, peak
+ * heap and time per run, and checks both come out the same. It then
+ * does the same for big Flip and Mines games themselves, as they are.
+ *
+ * "puzzlesgen --bench --maxflow" generates Latin squares (as Keen,
+ * Towers, Unequal and Singles do, by one maxflow per row) of orders 4
+ * to 16, and matches trees to tents (as Tents' completion check does)
+ * on random grids four times as wide, with each of the algorithms
+ * maxflow.c has. It reports the time per square and per matching,
+ * that the squares are Latin squares and the flows are flows, that
+ * each seed gives the same square when run again, and that the
+ * algorithms find matchings of the same size. The two algorithms give
+ * different squares from the same seed.
+ *
+ * `attempts' is the mean number of passes per run round the
+ * generator's retry loops, as counted by random_cancelled() (nested
+ * loops each count), or "-" for generators that never check, and
+ * `peak_heap_bytes' is the largest peak of smalloc'ed memory over the
+ * runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "puzzles.h"
+#include "tree234.h"
+#include "maxflow.h"
+#include "latin.h"
+
+#define DEFAULT_SEEDS 10
+#define DEFAULT_SAVE_MOVES 5000
+#define DEFAULT_SAVE_REPEAT 20
+#define SAVE_GAME_ID "7x7w#bench"
+#define SAVE_GAME_SIZE 7
+#define DEFAULT_UNDO_MOVES 2000
+#define DEFAULT_UNDO_BUDGET 64
+#define UNDO_GAME_ID "50x50w#bench"
+#define UNDO_GAME_SIZE 50
+#define BENCH_PIXELS 800
+#define DEFAULT_DRAGS 100
+#define DRAG_SAMPLES 50
+#define DEFAULT_FRAMES 50
+#define DEFAULT_CLICKS 200
+#define REPLAY_TICK (1.0F / 60)
+#define REPLAY_MAX_TICKS 600           /* per move: 10 seconds' worth */
+#define ANIM_INTERVAL (1.0 / 60)
+#define DEFAULT_ANIM_MOVES 20
+#define DEFAULT_DSF_SIZE 300
+#define DSF_PASSES 10
+#define DEFAULT_TREE_SEEDS 5
+#define DEFAULT_MAXFLOW_SEEDS 20
+#define MAXFLOW_MIN_ORDER 4
+#define MAXFLOW_MAX_ORDER 16
+#define MAXFLOW_GRID_SCALE 4
+
+/*
+ * The drawing_api every benchmark here draws through, and the
+ * generator too (android-gen.c). With a NULL handle it draws nothing;
+ * otherwise the handle is a draw_counter, which counts what it's asked
+ * to draw and, if `db' is set, records it there as android.c does.
+ * Like android.c it has no draw_thick_line, so drawing.c makes thick
+ * lines into polygons.
+ */
+struct draw_counter {
+	struct drawbuf *db;			/* or NULL not to record */
+	long frames, prims, texts, objects, updates;
+	double area;
+	int nblitters;
+};
+
+#define DRAW_COUNTER(objs) \
+	struct draw_counter *dc = (struct draw_counter *)handle; \
+	if (!dc) return; \
+	dc->prims++; \
+	dc->objects += (objs);
+static void counting_text(void *handle, int x, int y, int fonttype, int fontsize,
+		int align, int colour, char *text) {
+	DRAW_COUNTER(1)
+	dc->texts++;
+	if (dc->db) drawbuf_text(dc->db, x, y, fonttype, fontsize, align, colour, text);
+}
+static void counting_rect(void *handle, int x, int y, int w, int h, int colour) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_rect(dc->db, x, y, w, h, colour);
+}
+static void counting_line(void *handle, int x1, int y1, int x2, int y2, int colour) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_line(dc->db, x1, y1, x2, y2, colour);
+}
+static void counting_polygon(void *handle, int *coords, int npoints,
+		int fillcolour, int outlinecolour) {
+	DRAW_COUNTER(1)
+	if (dc->db) drawbuf_polygon(dc->db, coords, npoints, 0, 0, fillcolour, outlinecolour);
+}
+static void counting_circle(void *handle, int cx, int cy, int radius,
+		int fillcolour, int outlinecolour) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_circle(dc->db, cx, cy, radius, fillcolour, outlinecolour);
+}
+static void counting_clip(void *handle, int x, int y, int w, int h) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_clip(dc->db, x, y, w, h);
+}
+static void counting_unclip(void *handle) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_unclip(dc->db, 0, 0);
+}
+static void counting_blitter_save(void *handle, blitter *bl, int x, int y) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_blitter_save(dc->db, *(int *)bl, x, y);
+}
+static void counting_blitter_load(void *handle, blitter *bl, int x, int y) {
+	DRAW_COUNTER(0)
+	if (dc->db) drawbuf_blitter_load(dc->db, *(int *)bl, x, y);
+}
+static void counting_update(void *handle, int x, int y, int w, int h) {
+	struct draw_counter *dc = (struct draw_counter *)handle;
+	if (!dc) return;
+	dc->updates++;
+	dc->area += (double)w * h;
+	if (dc->db) drawbuf_update(dc->db, x, y, w, h);
+}
+static void counting_start_draw(void *handle) {}
+static void counting_end_draw(void *handle) {
+	struct draw_counter *dc = (struct draw_counter *)handle;
+	if (dc) dc->frames++;
+}
+static void counting_status_bar(void *handle, char *text) {}
+static blitter *counting_blitter_new(void *handle, int w, int h) {
+	struct draw_counter *dc = (struct draw_counter *)handle;
+	int *id = snew(int);
+	*id = dc ? dc->nblitters++ : 0;
+	return (blitter *)id;
+}
+static void counting_blitter_free(void *handle, blitter *bl) {
+	sfree(bl);
+}
+static char *counting_text_fallback(void *handle, const char *const *strings, int nstrings) {
+	return dupstr(strings[0]);
+}
+static void counting_changed_state(void *handle, int can_undo, int can_redo) {}
+
+const struct drawing_api counting_drawing = {
+	counting_text, counting_rect, counting_line, counting_polygon, counting_circle,
+	counting_update, counting_clip, counting_unclip, counting_start_draw,
+	counting_end_draw, counting_status_bar, counting_blitter_new,
+	counting_blitter_free, counting_blitter_save, counting_blitter_load,
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	counting_text_fallback, counting_changed_state, NULL,
+};
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_cpu_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *av, const void *bv) {
+	double a = *(const double *)av, b = *(const double *)bv;
+	return a < b ? -1 : a > b ? +1 : 0;
+}
+
+static void bench_preset(const char *id, const game *g, const char *name,
+		const game_params *params, int nseeds, double timeout, const char *prefix) {
+	double *times = snewn(nseeds, double);
+	char *encoded = g->encode_params(params, TRUE);
+	unsigned long attempts = 0;
+	long peak = 0;
+	int runs = 0, timeouts = 0, i;
+
+	for (i = 0; i < nseeds; i++) {
+		char seed[40], *desc, *aux = NULL;
+		random_state *rs;
+		double start;
+
+		sprintf(seed, "%sbench%d", prefix, i);
+		rs = random_new_seed(seed);
+		if (timeout > 0) random_set_timeout(rs, timeout);
+		malloc_stats_reset();
+		malloc_stats_enable(TRUE);
+		start = bench_now();
+		desc = g->new_desc(params, rs, &aux, FALSE);
+		times[runs] = bench_now() - start;
+		malloc_stats_enable(FALSE);
+		if (malloc_stats_peak() > peak) peak = malloc_stats_peak();
+		attempts += random_attempts(rs);
+		random_free(rs);
+		if (desc) {
+			runs++;
+		} else {
+			timeouts++;
+		}
+		sfree(desc);
+		sfree(aux);
+	}
+
+	printf("%s\t%s\t%s\t%d\t%d", id, name, encoded, runs, timeouts);
+	if (runs > 0) {
+		qsort(times, runs, sizeof(double), compare_doubles);
+		printf("\t%.3f\t%.3f\t%.3f\t%.3f", times[0] * 1000, times[(runs - 1) / 2] * 1000,
+				times[(runs - 1) * 95 / 100] * 1000, times[runs - 1] * 1000);
+	} else {
+		printf("\t-\t-\t-\t-");
+	}
+	printf("\t%ld", peak);
+	/* A generator that checks at all checks at least once a run. */
+	if (attempts > 0) {
+		printf("\t%.1f\n", (double)attempts / nseeds);
+	} else {
+		printf("\t-\n");
+	}
+	fflush(stdout);
+
+	sfree(encoded);
+	sfree(times);
+}
+
+static void bench_game(const char *id, const game *g, int nseeds, double timeout,
+		const char *prefix) {
+	game_params *params;
+	char *name;
+	int i;
+
+	for (i = 0; g->fetch_preset(i, &name, &params); i++) {
+		bench_preset(id, g, name, params, nseeds, timeout, prefix);
+		sfree(name);
+		g->free_params(params);
+	}
+	if (i == 0) {
+		/* Some games have no presets: use the default. */
+		params = g->default_params();
+		bench_preset(id, g, "(default)", params, nseeds, timeout, prefix);
+		g->free_params(params);
+	}
+}
+
+struct counting_buf {
+	struct serialise_buf sb;
+	int writes;
+};
+
+static void counting_write(void *ctx, void *buf, int len) {
+	struct counting_buf *cb = (struct counting_buf *)ctx;
+	cb->writes++;
+	serialise_buf_write(&cb->sb, buf, len);
+}
+
+static void append_line(struct serialise_buf *sb, const char *header, const char *str) {
+	char hbuf[80];
+	sprintf(hbuf, "%-8.8s:%d:", header, (int)strlen(str));
+	serialise_buf_write(sb, hbuf, strlen(hbuf));
+	serialise_buf_write(sb, (void *)str, strlen(str));
+	serialise_buf_write(sb, "\n", 1);
+}
+
+/* Mean time to load `sb' into `me', or -1 if it won't load. */
+static double bench_load(midend *me, const struct serialise_buf *sb, int repeat) {
+	struct mem_read mr;
+	double start = bench_now();
+	char *error;
+	int i;
+
+	for (i = 0; i < repeat; i++) {
+		mr.p = sb->buf;
+		mr.len = sb->len;
+		error = midend_deserialise(me, mem_read, &mr);
+		if (error) {
+			fprintf(stderr, "%s\n", error);
+			return -1;
+		}
+	}
+	return (bench_now() - start) / repeat;
+}
+
+/*
+ * Build a save of the Net game `id', `size' squares across, with
+ * `nmoves' random rotations after it, by saving the fresh game and
+ * appending the history by hand.
+ */
+static int make_net_save(midend *me, const char *id, int size, int nmoves,
+		struct serialise_buf *sb) {
+	random_state *rs;
+	char *dup = dupstr(id), *error, buf[80];
+	int i;
+
+	error = midend_game_id(me, dup);
+	sfree(dup);
+	if (error) {
+		fprintf(stderr, "%s\n", error);
+		return FALSE;
+	}
+	midend_new_game(me);
+	midend_serialise(me, serialise_buf_write, sb);
+
+	/* The fresh save ends with NSTATES and STATEPOS: replace them. */
+	for (i = 0; i < 2; i++) {
+		sb->len--;
+		while (sb->len > 0 && sb->buf[sb->len - 1] != '\n') sb->len--;
+	}
+	sprintf(buf, "%d", nmoves + 1);
+	append_line(sb, "NSTATES", buf);
+	append_line(sb, "STATEPOS", buf);
+	rs = random_new("bench", 5);
+	for (i = 0; i < nmoves; i++) {
+		sprintf(buf, "%c%d,%d", random_upto(rs, 2) ? 'C' : 'A',
+				(int)random_upto(rs, size), (int)random_upto(rs, size));
+		append_line(sb, "MOVE", buf);
+	}
+	random_free(rs);
+	return TRUE;
+}
+
+/*
+ * Load a save of a long Net game, and time saving it again, and
+ * loading both.
+ */
+static int bench_save(int nmoves, int repeat) {
+	const game *g = game_by_name("net");
+	midend *me = midend_new(NULL, g, &counting_drawing, NULL);
+	struct serialise_buf sb = { NULL, 0, 0 }, again = { NULL, 0, 0 };
+	struct serialise_buf bin = { NULL, 0, 0 }, conv = { NULL, 0, 0 };
+	struct counting_buf cb;
+	struct mem_read mr;
+	char *p;
+	double start, total = 0, best = 0, load, load_ckpt, load_bin;
+	int i, lossless;
+
+	if (!make_net_save(me, SAVE_GAME_ID, SAVE_GAME_SIZE, nmoves, &sb)) return 1;
+	if ((load = bench_load(me, &sb, repeat)) < 0) return 1;
+
+	printf("#moves\tbytes\twrites\tmean_ms\tmin_ms\tload_ms\tload_ckpt_ms\tbin_bytes\tload_bin_ms\n");
+	for (i = 0; i < repeat; i++) {
+		double t;
+		if (i > 0) sfree(cb.sb.buf);
+		cb.sb.buf = NULL;
+		cb.sb.len = cb.sb.size = 0;
+		cb.writes = 0;
+		start = bench_now();
+		midend_serialise(me, counting_write, &cb);
+		t = bench_now() - start;
+		total += t;
+		if (i == 0 || t < best) best = t;
+	}
+
+	/* The save we wrote should come back the same after loading it. */
+	if ((load_ckpt = bench_load(me, &cb.sb, repeat)) < 0) return 1;
+	midend_serialise(me, serialise_buf_write, &again);
+	p = (again.len == cb.sb.len && !memcmp(again.buf, cb.sb.buf, again.len)) ? "" : " (differs after loading)";
+
+	/* Binary from the midend should match converting the text, and back. */
+	midend_serialise_binary(me, serialise_buf_write, &bin);
+	if ((load_bin = bench_load(me, &bin, repeat)) < 0) return 1;
+	mr.p = cb.sb.buf;
+	mr.len = cb.sb.len;
+	lossless = !save_convert(mem_read, &mr, serialise_buf_write, &conv, TRUE) &&
+			conv.len == bin.len && !memcmp(conv.buf, bin.buf, bin.len);
+	conv.len = 0;
+	mr.p = bin.buf;
+	mr.len = bin.len;
+	lossless = lossless && !save_convert(mem_read, &mr, serialise_buf_write, &conv, FALSE) &&
+			conv.len == cb.sb.len && !memcmp(conv.buf, cb.sb.buf, conv.len);
+	if (!lossless) p = " (conversion not lossless)";
+
+	printf("%d\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%d\t%.3f%s\n", nmoves, cb.sb.len, cb.writes,
+			total / repeat * 1000, best * 1000, load * 1000, load_ckpt * 1000,
+			bin.len, load_bin * 1000, p);
+
+	sfree(conv.buf);
+	sfree(bin.buf);
+	sfree(again.buf);
+	sfree(cb.sb.buf);
+	sfree(sb.buf);
+	midend_free(me);
+	return 0;
+}
+
+/*
+ * Load a long game of big Net with the given undo budget, and see how
+ * much heap it holds and how long it takes to undo back to the start
+ * and redo to the end again.
+ */
+static void bench_undo_budget(const struct serialise_buf *sb, int nmoves, int budget) {
+	midend *me = midend_new(NULL, game_by_name("net"), &counting_drawing, NULL);
+	int x = BENCH_PIXELS, y = BENCH_PIXELS, nstates, loaded, walked;
+	double start, undo, redo;
+	long heap;
+
+	midend_set_undo_budget(me, budget);
+	malloc_stats_reset();
+	malloc_stats_enable(TRUE);
+	if (bench_load(me, sb, 1) < 0) exit(1);
+	heap = malloc_stats_current();
+	malloc_stats_enable(FALSE);
+	midend_undo_stats(me, &nstates, &loaded);
+	midend_size(me, &x, &y, FALSE);
+
+	start = bench_now();
+	while (midend_can_undo(me)) midend_process_key(me, 0, 0, 'u');
+	undo = bench_now() - start;
+	midend_undo_stats(me, &nstates, &walked);
+	start = bench_now();
+	while (midend_can_redo(me)) midend_process_key(me, 0, 0, 'r');
+	redo = bench_now() - start;
+
+	printf("%d\t%d\t%d\t%d\t%ld\t%.3f\t%.3f\n", budget, nmoves, loaded, walked, heap,
+			undo * 1000, redo * 1000);
+	midend_stop_anim(me);
+	midend_free(me);
+}
+
+/*
+ * Drag the mouse around a big board of each of a few games, in
+ * `ndrags' drags of DRAG_SAMPLES samples each along a random walk
+ * (the same walk every time), and count the allocations per event.
+ */
+static const char *const drag_games[][2] = {
+	{ "pattern", "30x30" },
+	{ "untangle", "40" },
+	{ "mines", "30x16n99" },
+	{ "net", "50x50w" },
+};
+
+static int bench_drag(int ndrags) {
+	int g, i, j;
+
+	printf("#game\tparams\tevents\tmoves\tallocs_per_event\tus_per_event\n");
+	for (g = 0; g < lenof(drag_games); g++) {
+		midend *me = midend_new(NULL, game_by_name(drag_games[g][0]), &counting_drawing, NULL);
+		char *id = snewn(strlen(drag_games[g][1]) + 10, char), *error;
+		int w = BENCH_PIXELS, h = BENCH_PIXELS, x, y, events = 0, nstates, held;
+		random_state *rs = random_new("drag", 4);
+		double start, t;
+		long allocs;
+
+		sprintf(id, "%s#drag", drag_games[g][1]);
+		error = midend_game_id(me, id);
+		sfree(id);
+		if (error) {
+			fprintf(stderr, "%s: %s\n", drag_games[g][0], error);
+			return 1;
+		}
+		midend_new_game(me);
+		midend_size(me, &w, &h, FALSE);
+		midend_redraw(me);
+
+		malloc_stats_reset();
+		malloc_stats_enable(TRUE);
+		start = bench_now();
+		for (i = 0; i < ndrags; i++) {
+			x = random_upto(rs, w);
+			y = random_upto(rs, h);
+			midend_process_key(me, x, y, LEFT_BUTTON);
+			for (j = 0; j < DRAG_SAMPLES; j++) {
+				x = max(0, min(w - 1, x + (int)random_upto(rs, 9) - 4));
+				y = max(0, min(h - 1, y + (int)random_upto(rs, 9) - 4));
+				midend_process_key(me, x, y, LEFT_DRAG);
+			}
+			midend_process_key(me, x, y, LEFT_RELEASE);
+			events += DRAG_SAMPLES + 2;
+			midend_stop_anim(me);
+		}
+		t = bench_now() - start;
+		malloc_stats_enable(FALSE);
+		allocs = malloc_stats_allocs();
+		midend_undo_stats(me, &nstates, &held);
+
+		printf("%s\t%s\t%d\t%d\t%.2f\t%.2f\n", drag_games[g][0], drag_games[g][1], events,
+				nstates - 1, (double)allocs / events, t / events * 1e6);
+		fflush(stdout);
+		random_free(rs);
+		midend_free(me);
+	}
+	return 0;
+}
+
+/*
+ * Redraw a big board of each of a few games from scratch `nframes'
+ * times each way, and time the frames.
+ */
+static const char *const frame_games[][2] = {
+	{ "solo", "4x4" },
+	{ "map", "30x30n120" },
+	{ "pattern", "30x30" },
+	{ "mines", "30x16n99" },
+	{ "net", "50x50w" },
+};
+
+static midend *frame_midend(const char *name, const char *params,
+		const drawing_api *api, void *handle) {
+	midend *me = midend_new(NULL, game_by_name(name), api, handle);
+	char *id = snewn(strlen(params) + 10, char), *error;
+	int w = BENCH_PIXELS, h = BENCH_PIXELS;
+
+	sprintf(id, "%s#frame", params);
+	error = midend_game_id(me, id);
+	sfree(id);
+	if (error) {
+		fprintf(stderr, "%s: %s\n", name, error);
+		midend_free(me);
+		return NULL;
+	}
+	midend_new_game(me);
+	midend_size(me, &w, &h, FALSE);
+	return me;
+}
+
+static int bench_frame(int nframes) {
+	int g, i;
+
+	printf("#game\tparams\tprims_per_frame\tobjects_per_frame\tbytes_per_frame"
+			"\tdirect_ms\trecord_ms\treplay_ms\n");
+	for (g = 0; g < lenof(frame_games); g++) {
+		struct drawbuf db = { NULL, 0, 0 };
+		struct draw_counter dc;
+		midend *direct, *recorded;
+		double start, tdirect, trecord = 0, treplay = 0;
+		int bytes;
+
+		direct = frame_midend(frame_games[g][0], frame_games[g][1], &counting_drawing, NULL);
+		memset(&dc, 0, sizeof(dc));
+		dc.db = &db;
+		recorded = frame_midend(frame_games[g][0], frame_games[g][1], &counting_drawing, &dc);
+		if (!direct || !recorded) return 1;
+
+		start = bench_now();
+		for (i = 0; i < nframes; i++) midend_force_redraw(direct);
+		tdirect = bench_now() - start;
+
+		dc.prims = dc.objects = 0;
+		for (i = 0; i < nframes; i++) {
+			db.len = 0;
+			start = bench_now();
+			midend_force_redraw(recorded);
+			trecord += bench_now() - start;
+			start = bench_now();
+			drawbuf_replay(&db, &counting_drawing, NULL, NULL);
+			treplay += bench_now() - start;
+		}
+		bytes = db.len * sizeof(int);
+
+		printf("%s\t%s\t%ld\t%ld\t%d\t%.3f\t%.3f\t%.3f\n", frame_games[g][0],
+				frame_games[g][1], dc.prims / nframes, dc.objects / nframes, bytes,
+				tdirect / nframes * 1000, trecord / nframes * 1000,
+				treplay / nframes * 1000);
+		fflush(stdout);
+		midend_free(direct);
+		midend_free(recorded);
+		drawbuf_free(&db);
+	}
+	return 0;
+}
+
+/*
+ * Click `nclicks' times at random on a big board of each of the drag
+ * games (the same clicks each time), at each update tolerance, the
+ * first of which turns merging off.
+ */
+static const float dirty_tolerances[] = { -1, 0, 0.25F, 1 };
+
+static int bench_dirty(int nclicks) {
+	int g, t, i;
+
+	printf("#game\tparams\ttolerance\tfirst_frame_rects\tframes\trects_per_frame"
+			"\twindow_pct_per_frame\tasked_pct_per_frame\n");
+	for (g = 0; g < lenof(drag_games); g++) {
+		double asked = 0;
+		for (t = 0; t < lenof(dirty_tolerances); t++) {
+			struct draw_counter dc;
+			midend *me;
+			random_state *rs;
+			int w = BENCH_PIXELS, h = BENCH_PIXELS, x, y;
+			long first;
+
+			memset(&dc, 0, sizeof(dc));
+			me = frame_midend(drag_games[g][0], drag_games[g][1], &counting_drawing, &dc);
+			if (!me) return 1;
+			rs = random_new("dirty", 5);
+			midend_size(me, &w, &h, FALSE);
+			midend_set_update_tolerance(me, dirty_tolerances[t]);
+			midend_redraw(me);
+			first = dc.updates;
+			dc.frames = dc.updates = 0;
+			dc.area = 0;
+			for (i = 0; i < nclicks; i++) {
+				x = random_upto(rs, w);
+				y = random_upto(rs, h);
+				midend_process_key(me, x, y, i % 2 ? RIGHT_BUTTON : LEFT_BUTTON);
+				midend_process_key(me, x, y, i % 2 ? RIGHT_RELEASE : LEFT_RELEASE);
+				midend_stop_anim(me);
+			}
+			if (t == 0) asked = dc.area;  // straight through, overlaps and all
+
+			printf("%s\t%s\t%g\t%ld\t%ld\t%.1f\t%.2f\t%.2f\n", drag_games[g][0],
+					drag_games[g][1], dirty_tolerances[t], first, dc.frames, (double)dc.updates / max(dc.frames, 1),
+					dc.area * 100 / ((double)w * h) / max(dc.frames, 1),
+					asked * 100 / ((double)w * h) / max(dc.frames, 1));
+			fflush(stdout);
+			random_free(rs);
+			midend_free(me);
+		}
+	}
+	return 0;
+}
+
+static void replay_report(const char *filename, const game *g, const char *phase,
+		const struct draw_counter *dc, double cpu, int w, int h) {
+	long frames = max(dc->frames, 1);
+	printf("%s\t%s\t%s\t%ld\t%.1f\t%.1f\t%.1f\t%.2f\t%.1f\n", filename, g->name, phase,
+			dc->frames, (double)dc->prims / frames, (double)dc->texts / frames,
+			(double)dc->updates / frames, dc->area * 100 / ((double)w * h) / frames,
+			cpu / frames * 1e6);
+	fflush(stdout);
+}
+
+/* Run the animation and flash after a move, if any, a tick at a time. */
+static void replay_ticks(midend *me, struct draw_counter *dc) {
+	int i;
+	long frames;
+
+	for (i = 0; i < REPLAY_MAX_TICKS; i++) {
+		frames = dc->frames;
+		midend_timer(me, REPLAY_TICK);
+		if (dc->frames == frames) break;
+	}
+}
+
+static int bench_replay_file(const char *filename, int nframes) {
+	struct serialise_buf sb = { NULL, 0, 0 };
+	struct draw_counter dc;
+	struct mem_read mr;
+	const game *g = NULL;
+	char buf[4096], *error, *name;
+	int w = BENCH_PIXELS, h = BENCH_PIXELS, i, n;
+	midend *me;
+	double start;
+	FILE *fp;
+
+	if (!(fp = fopen(filename, "rb"))) {
+		perror(filename);
+		return 1;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		serialise_buf_write(&sb, buf, n);
+	fclose(fp);
+
+	mr.p = sb.buf;
+	mr.len = sb.len;
+	error = identify_game(&name, mem_read, &mr);
+	for (i = 0; !error && i < gamecount; i++) {
+		if (!strcmp(gamelist[i]->name, name)) g = gamelist[i];
+	}
+	if (!error) sfree(name);
+	if (!error && !g) error = "Game name not recognised";
+	if (error) {
+		fprintf(stderr, "%s: %s\n", filename, error);
+		sfree(sb.buf);
+		return 1;
+	}
+	memset(&dc, 0, sizeof(dc));
+	me = midend_new(NULL, g, &counting_drawing, &dc);
+	if (bench_load(me, &sb, 1) < 0) {
+		fprintf(stderr, "%s: failed to load\n", filename);
+		midend_free(me);
+		sfree(sb.buf);
+		return 1;
+	}
+	sfree(sb.buf);
+	midend_set_update_tolerance(me, -1);  // as the game asked
+	midend_size(me, &w, &h, FALSE);
+
+	memset(&dc, 0, sizeof(dc));
+	start = bench_cpu_now();
+	midend_redraw(me);
+	for (i = 1; i < nframes; i++) midend_force_redraw(me);
+	replay_report(filename, g, "redraw", &dc, bench_cpu_now() - start, w, h);
+
+	memset(&dc, 0, sizeof(dc));
+	start = bench_cpu_now();
+	while (midend_can_undo(me)) {
+		midend_process_key(me, 0, 0, 'u');
+		replay_ticks(me, &dc);
+	}
+	while (midend_can_redo(me)) {
+		midend_process_key(me, 0, 0, 'r');
+		replay_ticks(me, &dc);
+	}
+	replay_report(filename, g, "undo_redo", &dc, bench_cpu_now() - start, w, h);
+
+	midend_free(me);
+	return 0;
+}
+
+static int compare_strings(const void *av, const void *bv) {
+	return strcmp(*(char *const *)av, *(char *const *)bv);
+}
+
+/* Each file in a directory, in name order so that runs line up. */
+static int bench_replay_dir(const char *dirname, int nframes) {
+	DIR *dir = opendir(dirname);
+	struct dirent *de;
+	struct stat st;
+	char **names = NULL;
+	int n = 0, size = 0, i, failures = 0;
+
+	if (!dir) {
+		perror(dirname);
+		return 1;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		char *path = snewn(strlen(dirname) + strlen(de->d_name) + 2, char);
+		sprintf(path, "%s/%s", dirname, de->d_name);
+		if (de->d_name[0] == '.' || stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+			sfree(path);
+			continue;
+		}
+		if (n >= size) {
+			size = size * 3 / 2 + 16;
+			names = sresize(names, size, char *);
+		}
+		names[n++] = path;
+	}
+	closedir(dir);
+	qsort(names, n, sizeof(*names), compare_strings);
+	for (i = 0; i < n; i++) {
+		failures += bench_replay_file(names[i], nframes);
+		sfree(names[i]);
+	}
+	sfree(names);
+	return failures;
+}
+
+static int bench_replay(int argc, const char *argv[], int nframes) {
+	struct stat st;
+	int i, failures = 0;
+
+	printf("#file\tgame\tphase\tframes\tprims_per_frame\ttexts_per_frame"
+			"\tupdates_per_frame\tupdate_pct_per_frame\tcpu_us_per_frame\n");
+	for (i = 0; i < argc; i++) {
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+			failures += bench_replay_dir(argv[i], nframes);
+		else
+			failures += bench_replay_file(argv[i], nframes);
+	}
+	return failures ? 1 : 0;
+}
+
+/*
+ * Run the animation after a move on ticks of a display refreshing
+ * every ANIM_INTERVAL, starting from *now, and move *now on to when
+ * its last frame was drawn. A tick that comes while a frame is still
+ * being drawn is missed, as it would be on the UI thread. Returns the
+ * time spent drawing.
+ */
+static long anim_frames;
+
+static void anim_end_draw(void *handle) {
+	anim_frames++;
+}
+
+static double anim_run(midend *me, struct frame_pacer *fp, int paced, double slowdown,
+		double *now) {
+	double t = *now, vsync = ceil(t / ANIM_INTERVAL) * ANIM_INTERVAL, last = t, busy = 0;
+	double tplus, cost, start;
+	long frames;
+	int i;
+
+	pacer_start(fp);
+	for (i = 0; i < REPLAY_MAX_TICKS; i++) {
+		while (vsync <= t) vsync += ANIM_INTERVAL;
+		if (!paced) {
+			tplus = vsync - last;
+		} else if (!pacer_tick(fp, ANIM_INTERVAL, vsync - last, &tplus)) {
+			last = t = vsync;
+			continue;
+		}
+		last = vsync;
+		frames = anim_frames;
+		start = bench_cpu_now();
+		midend_timer(me, (float)tplus);
+		cost = (bench_cpu_now() - start) * slowdown;
+		if (anim_frames == frames) break;  // nothing left to animate
+		pacer_frame(fp, cost);
+		busy += cost;
+		t = *now = vsync + cost;
+	}
+	return busy;
+}
+
+/* Inertia dies too soon on random moves, so it follows its solution. */
+static const struct {
+	const char *name, *params;
+	int follow_solution;
+} anim_games[] = {
+	{ "twiddle", "6x6n3", FALSE },
+	{ "fifteen", "8x8", FALSE },
+	{ "cube", "c8x8", FALSE },
+	{ "inertia", "20x16", TRUE },
+};
+
+static int bench_anim(int nmoves, double slowdown) {
+	struct drawing_api api = raster_drawing;
+	int g, paced, i;
+
+	api.end_draw = anim_end_draw;
+	printf("#game\tparams\tpaced\tmoves\tanim_s\tframes\tskipped\tover_budget"
+			"\tmean_ms\tworst_ms\tbusy_pct\n");
+	for (g = 0; g < lenof(anim_games); g++) {
+		for (paced = 0; paced < 2; paced++) {
+			raster *r = raster_new();
+			midend *me = frame_midend(anim_games[g].name, anim_games[g].params, &api, r);
+			random_state *rs = random_new("anim", 4);
+			int w = BENCH_PIXELS, h = BENCH_PIXELS, ncolours, moves;
+			unsigned char *pixels;
+			struct frame_pacer fp;
+			double now = 0, busy = 0;
+			float *colours;
+
+			if (!me) return 1;
+			midend_size(me, &w, &h, FALSE);
+			colours = midend_colours(me, &ncolours);
+			raster_set_colours(r, colours, ncolours);
+			sfree(colours);
+			pixels = snewn(w * h * 4, unsigned char);
+			raster_set_target(r, pixels, w, h, w * 4, RASTER_RGBA8888);
+			midend_redraw(me);
+			if (anim_games[g].follow_solution) midend_solve(me);
+			for (i = 0; i < nmoves * 10; i++) {
+				int x = random_upto(rs, w), y = random_upto(rs, h), nstates, held;
+				midend_undo_stats(me, &nstates, &held);
+				if (nstates > nmoves) break;
+				if (anim_games[g].follow_solution) {
+					midend_process_key(me, 0, 0, CURSOR_SELECT);
+				} else if (i % 2) {
+					midend_process_key(me, 0, 0, CURSOR_UP + random_upto(rs, 4));
+				} else {
+					midend_process_key(me, x, y, LEFT_BUTTON);
+					midend_process_key(me, x, y, LEFT_RELEASE);
+				}
+				midend_stop_anim(me);
+			}
+
+			pacer_init(&fp, ANIM_INTERVAL);
+			for (moves = 0; midend_can_undo(me); moves++) {
+				midend_process_key(me, 0, 0, 'u');
+				busy += anim_run(me, &fp, paced, slowdown, &now);
+			}
+
+			printf("%s\t%s\t%s\t%d\t%.2f\t%d\t%d\t%d\t%.2f\t%.2f\t%.1f\n",
+					anim_games[g].name, anim_games[g].params, paced ? "yes" : "no", moves, now,
+					fp.stats.frames, fp.stats.skipped, fp.stats.overruns,
+					fp.stats.total / max(fp.stats.frames, 1) * 1000, fp.stats.worst * 1000,
+					now > 0 ? busy / now * 100 : 0.0);
+			fflush(stdout);
+			random_free(rs);
+			midend_free(me);
+			raster_free(r);
+			sfree(pixels);
+		}
+	}
+	return 0;
+}
+
+enum { DSF_MERGE, DSF_FIND, DSF_LABEL };
+
+struct dsf_op {
+	int type, a, b, inverse;
+};
+
+static struct dsf_op *dsf_add_op(struct dsf_op *ops, int *nops, int *opsize,
+		int type, int a, int b, int inverse) {
+	if (*nops >= *opsize) {
+		*opsize = *opsize * 3 / 2 + 64;
+		ops = sresize(ops, *opsize, struct dsf_op);
+	}
+	ops[*nops].type = type;
+	ops[*nops].a = a;
+	ops[*nops].b = b;
+	ops[*nops].inverse = inverse;
+	(*nops)++;
+	return ops;
+}
+
+/* Half the edges between neighbouring squares, each as "find both ends,
+ * and merge if they differ"; then a lookup of every square. */
+static struct dsf_op *dsf_grid_ops(int n, int reverse, random_state *rs, int *nops) {
+	int nedges = 0, opsize = 0, i;
+	int *edges = snewn(2 * n * n, int);
+	struct dsf_op *ops = NULL;
+
+	*nops = 0;
+	for (i = 0; i < n * n; i++) {
+		if (i % n + 1 < n && random_upto(rs, 2)) edges[nedges++] = 2 * i;
+		if (i + n < n * n && random_upto(rs, 2)) edges[nedges++] = 2 * i + 1;
+	}
+	if (reverse) {
+		for (i = 0; i < nedges / 2; i++) {
+			int t = edges[i];
+			edges[i] = edges[nedges - 1 - i];
+			edges[nedges - 1 - i] = t;
+		}
+	} else {
+		shuffle(edges, nedges, sizeof(*edges), rs);
+	}
+	for (i = 0; i < nedges; i++) {
+		int a = edges[i] / 2, b = a + (edges[i] % 2 ? n : 1);
+		ops = dsf_add_op(ops, nops, &opsize, DSF_MERGE, a, b, 0);
+	}
+	for (i = 0; i < n * n; i++)
+		ops = dsf_add_op(ops, nops, &opsize, DSF_LABEL, i, 0, 0);
+	sfree(edges);
+	return ops;
+}
+
+/* Random pairs joined as the same or opposite, consistently with a
+ * hidden assignment, with a couple of lookups after each; then a
+ * lookup of every element. */
+static struct dsf_op *dsf_parity_ops(int n, random_state *rs, int *nops) {
+	int size = n * n, opsize = 0, i;
+	unsigned char *truth = snewn(size, unsigned char);
+	struct dsf_op *ops = NULL;
+
+	*nops = 0;
+	for (i = 0; i < size; i++) truth[i] = random_upto(rs, 2);
+	for (i = 0; i < size; i++) {
+		int a = random_upto(rs, size), b = random_upto(rs, size);
+		ops = dsf_add_op(ops, nops, &opsize, DSF_MERGE, a, b, truth[a] ^ truth[b]);
+		ops = dsf_add_op(ops, nops, &opsize, DSF_FIND, random_upto(rs, size), 0, 0);
+		ops = dsf_add_op(ops, nops, &opsize, DSF_FIND, random_upto(rs, size), 0, 0);
+	}
+	for (i = 0; i < size; i++)
+		ops = dsf_add_op(ops, nops, &opsize, DSF_LABEL, i, 0, 0);
+	sfree(truth);
+	return ops;
+}
+
+/*
+ * Run the operations, and leave the canonical element of each class in
+ * labels: for the by-size dsf, its least element from the minimums.
+ * The depths are found by walking the trees directly (see dsf_init for
+ * the representation) before the labelling pass compresses them.
+ */
+static long dsf_run(const struct dsf_op *ops, int nops, int size, int by_size,
+		int *dsf, int *mins, int *labels, double *mean_depth, int *max_depth) {
+	long sum = 0, total = 0;
+	int i, inv1, inv2, measured = FALSE;
+
+	dsf_init(dsf, size);
+	dsf_init_mins(mins, size);
+	for (i = 0; i < nops; i++) {
+		const struct dsf_op *op = &ops[i];
+		if (op->type == DSF_LABEL && !measured && max_depth) {
+			int j;
+			*max_depth = 0;
+			for (j = 0; j < size; j++) {
+				int k = j, d = 0;
+				while (!(dsf[k] & 2)) {
+					k = dsf[k] >> 2;
+					d++;
+				}
+				total += d;
+				*max_depth = max(*max_depth, d);
+			}
+			*mean_depth = (double)total / size;
+			measured = TRUE;
+		}
+		switch (op->type) {
+		  case DSF_MERGE:
+			if (edsf_canonify(dsf, op->a, &inv1) == edsf_canonify(dsf, op->b, &inv2))
+				break;
+			if (by_size)
+				edsf_merge_by_size(dsf, mins, op->a, op->b, op->inverse);
+			else
+				edsf_merge(dsf, op->a, op->b, op->inverse);
+			break;
+		  case DSF_FIND:
+			sum += dsf_canonify(dsf, op->a);
+			break;
+		  case DSF_LABEL:
+			labels[op->a] = by_size ? dsf_minimum(dsf, mins, op->a) :
+					dsf_canonify(dsf, op->a);
+			sum += labels[op->a];
+			break;
+		}
+	}
+	return sum;
+}
+
+static const char *const dsf_workloads[] = { "regions", "sweep", "parity" };
+
+static int bench_dsf(int n) {
+	int size = n * n, w, by_size, i;
+	int *dsf = snewn(size, int), *mins = snewn(size, int);
+	int *labels[2];
+
+	labels[0] = snewn(size, int);
+	labels[1] = snewn(size, int);
+	printf("#workload\telements\tmerge\tops\tmean_depth\tmax_depth\tns_per_op\tsame\n");
+	for (w = 0; w < lenof(dsf_workloads); w++) {
+		random_state *rs = random_new(dsf_workloads[w], strlen(dsf_workloads[w]));
+		struct dsf_op *ops;
+		int nops;
+
+		if (w == 2)
+			ops = dsf_parity_ops(n, rs, &nops);
+		else
+			ops = dsf_grid_ops(n, w == 1, rs, &nops);
+		for (by_size = 0; by_size < 2; by_size++) {
+			double mean_depth = 0, start;
+			int max_depth = 0;
+
+			dsf_run(ops, nops, size, by_size, dsf, mins, labels[by_size],
+					&mean_depth, &max_depth);
+			start = bench_cpu_now();
+			for (i = 0; i < DSF_PASSES; i++)
+				dsf_run(ops, nops, size, by_size, dsf, mins, labels[by_size], NULL, NULL);
+			printf("%s\t%d\t%s\t%d\t%.2f\t%d\t%.1f\t%s\n", dsf_workloads[w], size,
+					by_size ? "size" : "index", nops, mean_depth, max_depth,
+					(bench_cpu_now() - start) / DSF_PASSES / nops * 1e9,
+					by_size ? (memcmp(labels[0], labels[1], size * sizeof(int)) ?
+							"no" : "yes") : "-");
+			fflush(stdout);
+		}
+		sfree(ops);
+		random_free(rs);
+	}
+	sfree(dsf);
+	sfree(mins);
+	sfree(labels[0]);
+	sfree(labels[1]);
+	return 0;
+}
+
+/*
+ * Tree workloads shaped like the two generators' use of tree234s, run
+ * on trees made by a given constructor. "flip" keeps the same elements
+ * in three trees sorted by different orders of their keys, and
+ * repeatedly takes one out of all three, changes a key and puts it
+ * back, or drops it and adds a new one, as Flip's generator does with
+ * its pick, cov and osize trees. "mines" is a set store with a steady
+ * churn of small sets being added (when not already present), looked
+ * up by position and removed, as the solver's ss_add and ss_remove do.
+ * Each returns a checksum of what its trees ended up holding.
+ */
+struct tree_elt {
+	int key[3], id;
+};
+
+static int tree_elt_cmp(const struct tree_elt *a, const struct tree_elt *b, int first) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		int k = (first + i) % 3;
+		if (a->key[k] != b->key[k]) return a->key[k] < b->key[k] ? -1 : +1;
+	}
+	return a->id < b->id ? -1 : a->id > b->id ? +1 : 0;
+}
+static int tree_cmp0(void *a, void *b) { return tree_elt_cmp(a, b, 0); }
+static int tree_cmp1(void *a, void *b) { return tree_elt_cmp(a, b, 1); }
+static int tree_cmp2(void *a, void *b) { return tree_elt_cmp(a, b, 2); }
+
+static struct tree_elt *tree_new_elt(random_state *rs, int n, int id) {
+	struct tree_elt *e = snew(struct tree_elt);
+	e->key[0] = random_upto(rs, n);
+	e->key[1] = random_upto(rs, 9);
+	e->key[2] = random_upto(rs, 9);
+	e->id = id;
+	return e;
+}
+
+static unsigned long tree_flip(tree234 *(*newtree)(cmpfn234), int n, random_state *rs) {
+	tree234 *t[3];
+	struct tree_elt *e;
+	unsigned long sum = 0;
+	iter234 it;
+	int i, j, id = 0;
+
+	t[0] = newtree(tree_cmp0);
+	t[1] = newtree(tree_cmp1);
+	t[2] = newtree(tree_cmp2);
+	for (i = 0; i < n; i++) {
+		e = tree_new_elt(rs, n, id++);
+		for (j = 0; j < 3; j++) add234(t[j], e);
+	}
+	for (i = 0; i < 8 * n; i++) {
+		e = delpos234(t[0], random_upto(rs, n));
+		del234(t[1], e);
+		del234(t[2], e);
+		if (random_upto(rs, 4)) {
+			e->key[1 + random_upto(rs, 2)]++;
+		} else {
+			sfree(e);
+			e = tree_new_elt(rs, n, id++);
+		}
+		for (j = 0; j < 3; j++) add234(t[j], e);
+	}
+	for (e = first234(t[0], &it); e; e = next234(&it)) {
+		sum = sum * 31 + e->id;
+		sfree(e);
+	}
+	for (j = 0; j < 3; j++) freetree234(t[j]);
+	return sum;
+}
+
+static unsigned long tree_mines(tree234 *(*newtree)(cmpfn234), int n, random_state *rs) {
+	tree234 *t = newtree(tree_cmp0);
+	struct tree_elt *e, key;
+	unsigned long sum = 0;
+	iter234 it;
+	int i, id = 0;
+
+	for (i = 0; i < 40 * n; i++) {
+		int op = random_upto(rs, 3);
+		if (op == 0 || count234(t) < n / 2) {
+			e = tree_new_elt(rs, n, 0);
+			e->id = 1 + random_upto(rs, 511);   /* the mask */
+			if (add234(t, e) != e) sfree(e);
+			else id++;
+		} else if (op == 1) {
+			e = index234(t, random_upto(rs, count234(t)));
+			del234(t, e);
+			sfree(e);
+		} else {
+			key.key[0] = random_upto(rs, n);
+			key.key[1] = key.key[2] = key.id = 0;
+			e = findrelpos234(t, &key, NULL, REL234_GE, NULL);
+			if (e) sum += e->id;
+		}
+	}
+	for (e = first234(t, &it); e; e = next234(&it)) {
+		sum = sum * 31 + e->id;
+		sfree(e);
+	}
+	freetree234(t);
+	return sum + id;
+}
+
+static const struct {
+	const char *name;
+	unsigned long (*run)(tree234 *(*newtree)(cmpfn234), int n, random_state *rs);
+	int n;
+} tree_workloads[] = {
+	{ "flip", tree_flip, 400 },
+	{ "flip", tree_flip, 3600 },
+	{ "mines", tree_mines, 100 },
+	{ "mines", tree_mines, 800 },
+};
+
+/* Whole generators, with their trees pooled as they are now. */
+static const char *const tree_games[][2] = {
+	{ "flip", "20x20r" },
+	{ "mines", "60x60n800" },
+};
+
+static int bench_tree(int nseeds) {
+	int i, pooled, seed;
+
+	printf("#workload\tsize\tnodes\truns\tallocs_per_run\tpeak_heap_bytes\tmean_ms\tsame\n");
+	for (i = 0; i < lenof(tree_workloads); i++) {
+		unsigned long *sums = snewn(nseeds, unsigned long);
+
+		for (pooled = 0; pooled < 2; pooled++) {
+			double total = 0;
+			long allocs = 0, peak = 0;
+			int same = TRUE;
+
+			for (seed = 0; seed < nseeds; seed++) {
+				char seedstr[40];
+				random_state *rs;
+				unsigned long sum;
+				double start;
+
+				sprintf(seedstr, "bench%d", seed);
+				rs = random_new(seedstr, strlen(seedstr));
+				malloc_stats_reset();
+				malloc_stats_enable(TRUE);
+				start = bench_cpu_now();
+				sum = tree_workloads[i].run(pooled ? newpooltree234 : newtree234,
+						tree_workloads[i].n, rs);
+				total += bench_cpu_now() - start;
+				malloc_stats_enable(FALSE);
+				allocs += malloc_stats_allocs();
+				if (malloc_stats_peak() > peak) peak = malloc_stats_peak();
+				random_free(rs);
+				if (!pooled) sums[seed] = sum;
+				else if (sum != sums[seed]) same = FALSE;
+			}
+			printf("%s\t%d\t%s\t%d\t%ld\t%ld\t%.2f\t%s\n", tree_workloads[i].name,
+					tree_workloads[i].n, pooled ? "pooled" : "malloc", nseeds,
+					allocs / nseeds, peak, total / nseeds * 1000,
+					pooled ? (same ? "yes" : "no") : "-");
+			fflush(stdout);
+		}
+		sfree(sums);
+	}
+
+	for (i = 0; i < lenof(tree_games); i++) {
+		const game *g = game_by_name(tree_games[i][0]);
+		game_params *params = g->default_params();
+		double total = 0;
+		long allocs = 0, peak = 0;
+
+		g->decode_params(params, tree_games[i][1]);
+		for (seed = 0; seed < nseeds; seed++) {
+			char seedstr[40], *desc, *aux = NULL;
+			random_state *rs;
+			double start;
+
+			sprintf(seedstr, "bench%d", seed);
+			rs = random_new(seedstr, strlen(seedstr));
+			malloc_stats_reset();
+			malloc_stats_enable(TRUE);
+			start = bench_cpu_now();
+			desc = g->new_desc(params, rs, &aux, FALSE);
+			total += bench_cpu_now() - start;
+			malloc_stats_enable(FALSE);
+			allocs += malloc_stats_allocs();
+			if (malloc_stats_peak() > peak) peak = malloc_stats_peak();
+			random_free(rs);
+			sfree(aux);
+			sfree(desc);
+		}
+		printf("%s\t%s\tpooled\t%d\t%ld\t%ld\t%.2f\t-\n", tree_games[i][0],
+				tree_games[i][1], nseeds, allocs / nseeds, peak, total / nseeds * 1000);
+		fflush(stdout);
+		g->free_params(params);
+	}
+	return 0;
+}
+
+static const int maxflow_algorithms[] = { MAXFLOW_EDMONDS_KARP, MAXFLOW_DINIC };
+static const char *const maxflow_names[] = { "edmonds-karp", "dinic" };
+
+/* Generate a square from a seed, returning the time taken. */
+static double maxflow_latin(int o, int seed, int alg, digit **sq) {
+	char seedstr[40];
+	random_state *rs;
+	double start, time;
+
+	sprintf(seedstr, "bench%d", seed);
+	rs = random_new(seedstr, strlen(seedstr));
+	start = bench_cpu_now();
+	*sq = latin_generate_alg(o, rs, alg);
+	time = bench_cpu_now() - start;
+	random_free(rs);
+	return time;
+}
+
+/*
+ * Build the network Tents' completion check matches trees to tents
+ * with, for a side x side grid of random trees (a third of the
+ * squares) and empty squares: source to each tree, each tree to the
+ * empty squares beside it, and each empty square to the sink. The
+ * edges come out in the order maxflow wants them. Returns the number
+ * of edges.
+ */
+static int maxflow_grid(int side, int seed, int *edges, int *capacity) {
+	char seedstr[40];
+	random_state *rs;
+	char *tree = snewn(side * side, char);
+	int n = side * side, ne = 0, i, d;
+
+	sprintf(seedstr, "bench%d", seed);
+	rs = random_new(seedstr, strlen(seedstr));
+	for (i = 0; i < n; i++)
+		tree[i] = random_upto(rs, 3) == 0;
+	random_free(rs);
+
+	for (i = 0; i < n; i++) {
+		int x = i % side, y = i / side;
+		int nb[4] = { y > 0 ? i - side : -1, x > 0 ? i - 1 : -1,
+				x < side - 1 ? i + 1 : -1, y < side - 1 ? i + side : -1 };
+
+		if (tree[i]) {
+			for (d = 0; d < 4; d++)
+				if (nb[d] >= 0 && !tree[nb[d]]) {
+					edges[ne * 2] = i;
+					edges[ne * 2 + 1] = nb[d];
+					capacity[ne++] = 1;
+				}
+		} else {
+			edges[ne * 2] = i;
+			edges[ne * 2 + 1] = n + 1;
+			capacity[ne++] = 1;
+		}
+	}
+	for (i = 0; i < n; i++)
+		if (tree[i]) {
+			edges[ne * 2] = n;
+			edges[ne * 2 + 1] = i;
+			capacity[ne++] = 1;
+		}
+	sfree(tree);
+	return ne;
+}
+
+/* A flow is valid if it keeps to the capacities and every vertex but
+ * the source and sink has as much going out as coming in. */
+static int maxflow_valid(int nv, int source, int sink, int ne,
+		const int *edges, const int *capacity, const int *flow) {
+	int *net = snewn(nv, int);
+	int i, ok = TRUE;
+
+	memset(net, 0, nv * sizeof(int));
+	for (i = 0; i < ne; i++) {
+		if (flow[i] < 0 || flow[i] > capacity[i]) ok = FALSE;
+		net[edges[i * 2]] -= flow[i];
+		net[edges[i * 2 + 1]] += flow[i];
+	}
+	for (i = 0; i < nv; i++)
+		if (i != source && i != sink && net[i]) ok = FALSE;
+	sfree(net);
+	return ok;
+}
+
+static int bench_maxflow(int nseeds) {
+	int o, alg, seed;
+
+	printf("#order\talgorithm\tlatin_us\tmatch_us\tvalid\trepeatable\tagree\n");
+	for (o = MAXFLOW_MIN_ORDER; o <= MAXFLOW_MAX_ORDER; o++) {
+		int side = o * MAXFLOW_GRID_SCALE, n = side * side;
+		int maxedges = 3 * n, nv = n + 2;
+		int *edges = snewn(maxedges * 2, int), *capacity = snewn(maxedges, int);
+		int *flow = snewn(maxedges, int);
+		double latin[lenof(maxflow_algorithms)], match[lenof(maxflow_algorithms)];
+		int valid[lenof(maxflow_algorithms)], repeatable[lenof(maxflow_algorithms)];
+		int agree = TRUE;
+
+		for (alg = 0; alg < lenof(maxflow_algorithms); alg++) {
+			latin[alg] = match[alg] = 0;
+			valid[alg] = repeatable[alg] = TRUE;
+		}
+		for (seed = 0; seed < nseeds; seed++) {
+			int ne = maxflow_grid(side, seed, edges, capacity), total = -1;
+
+			for (alg = 0; alg < lenof(maxflow_algorithms); alg++) {
+				digit *sq, *sq2;
+				double start;
+				int ret;
+
+				latin[alg] += maxflow_latin(o, seed, maxflow_algorithms[alg], &sq);
+				maxflow_latin(o, seed, maxflow_algorithms[alg], &sq2);
+				if (latin_check(sq, o)) valid[alg] = FALSE;
+				if (memcmp(sq, sq2, o * o)) repeatable[alg] = FALSE;
+				sfree(sq);
+				sfree(sq2);
+
+				start = bench_cpu_now();
+				ret = maxflow_alg(maxflow_algorithms[alg], nv, n, n + 1, ne,
+						edges, capacity, flow, NULL);
+				match[alg] += bench_cpu_now() - start;
+				if (!maxflow_valid(nv, n, n + 1, ne, edges, capacity, flow))
+					valid[alg] = FALSE;
+				if (total >= 0 && ret != total) agree = FALSE;
+				total = ret;
+			}
+		}
+		for (alg = 0; alg < lenof(maxflow_algorithms); alg++) {
+			printf("%d\t%s\t%.1f\t%.1f\t%s\t%s\t%s\n", o, maxflow_names[alg],
+					latin[alg] / nseeds * 1e6, match[alg] / nseeds * 1e6,
+					valid[alg] ? "yes" : "no", repeatable[alg] ? "yes" : "no",
+					agree ? "yes" : "no");
+		}
+		fflush(stdout);
+		sfree(flow);
+		sfree(capacity);
+		sfree(edges);
+	}
+	return 0;
+}
+
+static int bench_undo(int nmoves, int budget) {
+	midend *me = midend_new(NULL, game_by_name("net"), &counting_drawing, NULL);
+	struct serialise_buf sb = { NULL, 0, 0 };
+
+	if (!make_net_save(me, UNDO_GAME_ID, UNDO_GAME_SIZE, nmoves, &sb)) return 1;
+	midend_free(me);
+	printf("#budget\tmoves\tstates_loaded\tstates_after_undo\theap_bytes\tundo_all_ms\tredo_all_ms\n");
+	bench_undo_budget(&sb, nmoves, 0);
+	bench_undo_budget(&sb, nmoves, budget);
+	sfree(sb.buf);
+	return 0;
+}
+
+static int run_save(const double *opt, int nfiles, const char *files[]) {
+	return bench_save((int)opt[0], (int)opt[1]);
+}
+
+static int run_undo(const double *opt, int nfiles, const char *files[]) {
+	return bench_undo((int)opt[0], (int)opt[1]);
+}
+
+static int run_drag(const double *opt, int nfiles, const char *files[]) {
+	return bench_drag((int)opt[0]);
+}
+
+static int run_frame(const double *opt, int nfiles, const char *files[]) {
+	return bench_frame((int)opt[0]);
+}
+
+static int run_dirty(const double *opt, int nfiles, const char *files[]) {
+	return bench_dirty((int)opt[0]);
+}
+
+static int run_replay(const double *opt, int nfiles, const char *files[]) {
+	return bench_replay(nfiles, files, (int)opt[0]);
+}
+
+static int run_anim(const double *opt, int nfiles, const char *files[]) {
+	return bench_anim((int)opt[0], opt[1]);
+}
+
+static int run_dsf(const double *opt, int nfiles, const char *files[]) {
+	return bench_dsf((int)opt[0]);
+}
+
+static int run_tree(const double *opt, int nfiles, const char *files[]) {
+	return bench_tree((int)opt[0]);
+}
+
+static int run_maxflow(const double *opt, int nfiles, const char *files[]) {
+	return bench_maxflow((int)opt[0]);
+}
+
+/*
+ * The benchmarks other than the generator one, each with up to two
+ * options of its own and perhaps some files after them. Both the
+ * command line parsing and the usage message come from this table.
+ */
+#define BENCH_MAX_OPTIONS 2
+
+static const struct bench_mode {
+	const char *name;
+	struct bench_option {
+		const char *name;
+		double def, min;
+		int integer;            /* else a number with a fraction */
+	} options[BENCH_MAX_OPTIONS];
+	const char *files;              /* NULL if it takes none */
+	int (*run)(const double *opt, int nfiles, const char *files[]);
+} bench_modes[] = {
+	{ "--save", { { "--moves", DEFAULT_SAVE_MOVES, 0, TRUE },
+			{ "--repeat", DEFAULT_SAVE_REPEAT, 1, TRUE } }, NULL, run_save },
+	{ "--undo", { { "--moves", DEFAULT_UNDO_MOVES, 0, TRUE },
+			{ "--budget", DEFAULT_UNDO_BUDGET, 1, TRUE } }, NULL, run_undo },
+	{ "--drag", { { "--drags", DEFAULT_DRAGS, 1, TRUE } }, NULL, run_drag },
+	{ "--frame", { { "--frames", DEFAULT_FRAMES, 1, TRUE } }, NULL, run_frame },
+	{ "--dirty", { { "--clicks", DEFAULT_CLICKS, 1, TRUE } }, NULL, run_dirty },
+	{ "--replay", { { "--frames", DEFAULT_FRAMES, 1, TRUE } },
+		"savefile|directory...", run_replay },
+	{ "--anim", { { "--moves", DEFAULT_ANIM_MOVES, 1, TRUE },
+			{ "--slowdown", 1, 0.01, FALSE } }, NULL, run_anim },
+	{ "--dsf", { { "--size", DEFAULT_DSF_SIZE, 2, TRUE } }, NULL, run_dsf },
+	{ "--tree", { { "--seeds", DEFAULT_TREE_SEEDS, 1, TRUE } }, NULL, run_tree },
+	{ "--maxflow", { { "--seeds", DEFAULT_MAXFLOW_SEEDS, 1, TRUE } }, NULL, run_maxflow },
+};
+
+/* Print the --bench lines of the usage message, the first starting
+ * "Usage:" if `first' is set and lined up under it otherwise. */
+void bench_usage(FILE *fp, int first) {
+	int i, j;
+
+	fprintf(fp, "%-6s puzzles-gen --bench [--seeds n] [--timeout seconds] "
+			"[--rng sha1|fast] [gamename...]\n", first ? "Usage:" : "");
+	for (i = 0; i < lenof(bench_modes); i++) {
+		const struct bench_mode *m = &bench_modes[i];
+
+		fprintf(fp, "       puzzles-gen --bench %s", m->name);
+		for (j = 0; j < BENCH_MAX_OPTIONS && m->options[j].name; j++)
+			fprintf(fp, " [%s %s]", m->options[j].name, m->options[j].integer ? "n" : "x");
+		if (m->files) fprintf(fp, " %s", m->files);
+		fprintf(fp, "\n");
+	}
+}
+
+static int bench_mode_main(const struct bench_mode *m, int argc, const char *argv[]) {
+	double opt[BENCH_MAX_OPTIONS];
+	int i, j;
+
+	for (j = 0; j < BENCH_MAX_OPTIONS; j++) opt[j] = m->options[j].def;
+	for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+		const struct bench_option *o = NULL;
+		double value;
+
+		for (j = 0; j < BENCH_MAX_OPTIONS && m->options[j].name; j++) {
+			if (!strcmp(argv[i], m->options[j].name)) o = &m->options[j];
+		}
+		if (!o || i + 1 >= argc) break;
+		value = o->integer ? atoi(argv[i+1]) : atof(argv[i+1]);
+		if (value < o->min) break;
+		opt[o - m->options] = value;
+	}
+	if ((i < argc && argv[i][0] == '-') || (m->files ? i >= argc : i < argc)) {
+		bench_usage(stderr, TRUE);
+		return 1;
+	}
+	return m->run(opt, argc - i, argv + i);
+}
+
+int bench_main(int argc, const char *argv[]) {
+	int nseeds = DEFAULT_SEEDS, ngames = 0, i, j;
+	double timeout = 0;
+	const char *prefix = "";
+
+	for (i = 0; i < lenof(bench_modes); i++) {
+		if (argc >= 1 && !strcmp(argv[0], bench_modes[i].name))
+			return bench_mode_main(&bench_modes[i], argc, argv);
+	}
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "--seeds") && i + 1 < argc && atoi(argv[i+1]) >= 1) {
+			nseeds = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--timeout") && i + 1 < argc && atof(argv[i+1]) > 0) {
+			timeout = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--rng") && i + 1 < argc && !strcmp(argv[i+1], "sha1")) {
+			prefix = "";
+			i++;
+		} else if (!strcmp(argv[i], "--rng") && i + 1 < argc && !strcmp(argv[i+1], "fast")) {
+			prefix = RANDOM_FAST_PREFIX;
+			i++;
+		} else if (argv[i][0] == '-') {
+			bench_usage(stderr, TRUE);
+			return 1;
+		} else if (!game_by_name(argv[i])) {
+			fprintf(stderr, "Game name not recognised: %s\n", argv[i]);
+			return 1;
+		} else {
+			ngames++;
+		}
+	}
+
+	printf("#game\tpreset\tparams\truns\ttimeouts\tmin_ms\tmedian_ms\tp95_ms\tmax_ms"
+			"\tpeak_heap_bytes\tattempts\n");
+	for (j = 0; j < gamecount; j++) {
+		int wanted = (ngames == 0);
+		for (i = 0; i < argc && !wanted; i++) {
+			if (!strcmp(argv[i], gamenames[j])) wanted = TRUE;
+		}
+		if (wanted) bench_game(gamenames[j], gamelist[j], nseeds, timeout, prefix);
+	}
+	return 0;
+}
+#endif
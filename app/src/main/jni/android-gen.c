@@ -1,8 +1,105 @@
 #ifdef EXECUTABLE
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "puzzles.h"
 
-#define USAGE "Usage: puzzles-gen gamename [params | --seed seed | --desc desc]\n"
+#define USAGE_HEAD "Usage: puzzles-gen gamename [params | --seed seed | --desc desc]\n" \
+	"       puzzles-gen gamename [params] --count n [--threads t]\n" \
+	"       puzzles-gen --server [--pool file] [--race threads] [--timeout seconds]\n" \
+	"       puzzles-gen --stress [--count n] [--threads t]\n"
+#define USAGE_TAIL "       puzzles-gen --convert text|binary savefile\n" \
+	"       puzzles-gen --render [--size pixels] savefile\n" \
+	"       puzzles-gen --profile (any of the above)\n"
+
+/*
+ * In server mode we read one request per line from stdin, each being
+ * the same arguments as the one-shot command line (gamename, then
+ * optionally params, or --seed/--desc and a value) separated by tabs.
+ * Each response is a header line "OK <len>" or "ERROR <len>" followed
+ * by exactly <len> bytes of saved game or error message, so the
+ * frontend can keep one process around instead of paying for exec,
+ * dynamic linking and midend setup on every new game.
+ */
+#define MAX_REQUEST_ARGS 3
+
+/* android-bench.c */
+int bench_main(int argc, const char *argv[]);
+void bench_usage(FILE *fp, int first);
+extern const struct drawing_api counting_drawing;  /* draws nothing given NULL */
+
+/* The --bench lines come from android-bench.c's table of benchmarks. */
+static void usage(void) {
+	fprintf(stderr, USAGE_HEAD);
+	bench_usage(stderr, FALSE);
+	fprintf(stderr, USAGE_TAIL);
+}
+
+/*
+ * With --pool, the server keeps a few ready-made games for each set of
+ * params it has been asked for, generated in the background and saved
+ * to the given file so that they survive the process.
+ */
+#define POOL_PER_KEY 3
+#define POOL_MAX_BYTES (256 * 1024)
+
+/*
+ * With --race, new games from fresh seeds are generated on that many
+ * threads at once from different seeds, keeping whichever is ready
+ * first; this cuts the long tail of the generators that retry.
+ */
+static int race = 1;
+
+/*
+ * With --timeout, a server request for a new game from a fresh seed
+ * fails rather than taking longer than this.
+ */
+static double timeout = 0.0;
+
+/*
+ * With --count, we generate that many games for one set of params on a
+ * few threads, each with its own midend, and write them to stdout
+ * framed as in server mode, in whatever order they finish. Seeds all
+ * come from one random state so that the threads can't collide on
+ * time-based seeds. Throughput and latency go to stderr at the end.
+ */
+struct bulk {
+	const game *game;
+	char *params;				/* fully encoded */
+	random_state *seeds;
+	int next, count;
+	double *latency;			/* seconds, indexed by job */
+	pthread_mutex_t lock;		/* guards all but the constants */
+};
+
+/*
+ * --profile, before any other arguments, turns on the generators'
+ * PROFILE_ counters and timers and writes them to stderr at exit, one
+ * tab-separated line per name: name, calls, total milliseconds. This
+ * needs libpuzzles built with -DPROFILING; otherwise we say so and
+ * carry on without.
+ */
+static void dump_profile(void) {
+	fprintf(stderr, "#name\tcalls\ttotal_ms\n");
+	profile_dump(stderr);
+}
+
+/*
+ * --stress generates and solves a few games from fixed seeds for every
+ * backend, once on one thread and then again on several threads at
+ * once, and checks that the results are identical. Build with
+ * -fsanitize=thread to check that the backends are re-entrant.
+ */
+struct stress {
+	int count, njobs, next;
+	char **results;				/* being filled in, indexed by job */
+	pthread_mutex_t lock;
+};
 
 struct frontend {
 	midend *me;
@@ -12,28 +109,546 @@ void serialise_write(void *ctx, void *buf, int len) {
 	write(1, buf, len);
 }
 
-
-const struct drawing_api null_drawing = {
-	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-	NULL,
-};
-
-int main(int argc, const char *argv[]) {
-	if (argc < 2 || argc > 4) {
-		fprintf(stderr, USAGE);
-		exit(1);
-	}
+/*
+ * Set up a new game in an existing midend from the arguments after the
+ * game name. Returns an error message or NULL.
+ */
+static char *new_game_from_args(midend *me, int argc, char **argv) {
+	const game *thegame = midend_which_game(me);
 	int defmode = DEF_PARAMS;
-	if (argc >= 4) {
-		if (!strcmp(argv[2], "--seed")) {
+	if (argc >= 2) {
+		if (!strcmp(argv[0], "--seed")) {
 			defmode = DEF_SEED;
-		} else if (!strcmp(argv[2], "--desc")) {
+		} else if (!strcmp(argv[0], "--desc")) {
 			defmode = DEF_DESC;
 		} else {
-			fprintf(stderr, USAGE);
+			return "Unrecognised option";
+		}
+	}
+
+	char *error = NULL;
+	game_params *params = NULL;
+	if (defmode == DEF_PARAMS) {
+		params = oriented_params_from_str(thegame, (argc >= 1 && strlen(argv[0]) > 0) ? argv[0] : NULL, &error);
+	} else {
+		char *tmp = dupstr(argv[1]);
+		error = midend_game_id_int(me, tmp, defmode, FALSE);
+		sfree(tmp);
+	}
+	if (error) return error;
+	if (defmode == DEF_PARAMS) {
+		midend_set_params(me, params);
+		thegame->free_params(params);
+	}
+	if (!midend_try_new_game(me, NULL, timeout))
+		return "Timed out generating game";
+	return NULL;
+}
+
+static void respond(const char *status, const char *buf, int len) {
+	printf("%s %d\n", status, len);
+	fwrite(buf, 1, len, stdout);
+	fflush(stdout);
+}
+
+static char *read_line(FILE *fp) {
+	int size = 256, len = 0;
+	char *line = snewn(size, char);
+	while (fgets(line + len, size - len, fp)) {
+		len += strlen(line + len);
+		if (len > 0 && line[len-1] == '\n') {
+			line[--len] = '\0';
+			if (len > 0 && line[len-1] == '\r') line[--len] = '\0';
+			return line;
+		}
+		size *= 2;
+		line = sresize(line, size, char);
+	}
+	if (len > 0) return line;  /* final line without newline */
+	sfree(line);
+	return NULL;
+}
+
+static puzzle_pool *pool = NULL;
+static const char *pool_filename = NULL;
+/* The pool is saved both from the refill thread and on taking. */
+static pthread_mutex_t pool_save_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int file_read(void *ctx, void *buf, int len) {
+	return fread(buf, 1, len, (FILE *)ctx) == (size_t)len;
+}
+
+static void file_write(void *ctx, void *buf, int len) {
+	fwrite(buf, 1, len, (FILE *)ctx);
+}
+
+static void save_pool(void *ctx) {
+	const char *filename = (const char *)ctx;
+	char *tmpname = snewn(strlen(filename) + 5, char);
+	FILE *fp;
+	sprintf(tmpname, "%s.tmp", filename);
+	pthread_mutex_lock(&pool_save_lock);
+	fp = fopen(tmpname, "wb");
+	if (fp) {
+		pool_save(pool, file_write, fp);
+		if (fclose(fp) == 0) rename(tmpname, filename);
+	}
+	pthread_mutex_unlock(&pool_save_lock);
+	sfree(tmpname);
+}
+
+static void start_pool(const char *filename) {
+	FILE *fp;
+	pool = pool_new(POOL_PER_KEY, POOL_MAX_BYTES);
+	pool_filename = filename;
+	fp = fopen(filename, "rb");
+	if (fp) {
+		char *error = pool_load(pool, file_read, fp);
+		if (error) fprintf(stderr, "%s: %s\n", filename, error);
+		fclose(fp);
+	}
+	pool_set_changed_callback(pool, save_pool, (void *)filename);
+	pool_start_refill(pool);
+}
+
+static int serve(void) {
+	/* One midend per backend, created on first use and reused thereafter */
+	midend **midends = snewn(gamecount, midend *);
+	frontend *fe = snew(frontend);
+	struct serialise_buf sb = { NULL, 0, 0 };
+	char *line;
+	int i;
+
+	for (i = 0; i < gamecount; i++) midends[i] = NULL;
+	fe->me = NULL;
+
+	while ((line = read_line(stdin)) != NULL) {
+		char *argv[MAX_REQUEST_ARGS + 1];
+		int argc = 0;
+		char *p = line, *error = NULL;
+		int which = -1;
+
+		if (!*line) {
+			sfree(line);
+			continue;
+		}
+		while (p && argc <= MAX_REQUEST_ARGS) {
+			argv[argc++] = p;
+			p = strchr(p, '\t');
+			if (p) *p++ = '\0';
+		}
+		if (p || argc > MAX_REQUEST_ARGS) {
+			error = "Too many arguments in request";
+		} else {
+			for (i = 0; i < gamecount; i++) {
+				if (!strcmp(argv[0], gamenames[i])) which = i;
+			}
+			if (which < 0) error = "Game name not recognised";
+		}
+		if (!error) {
+			if (!midends[which]) {
+				midends[which] = midend_new(fe, gamelist[which], &counting_drawing, NULL);
+				if (pool) midend_set_pool(midends[which], pool);
+				midend_set_race(midends[which], race);
+			}
+			fe->me = midends[which];
+			error = new_game_from_args(fe->me, argc - 1, argv + 1);
+		}
+		if (error) {
+			respond("ERROR", error, strlen(error));
+		} else {
+			sb.len = 0;
+			midend_serialise(fe->me, serialise_buf_write, &sb);
+			respond("OK", sb.buf, sb.len);
+		}
+		sfree(line);
+	}
+
+	for (i = 0; i < gamecount; i++) {
+		if (midends[i]) midend_free(midends[i]);
+	}
+	sfree(midends);
+	sfree(sb.buf);
+	sfree(fe);
+	if (pool) {
+		save_pool((void *)pool_filename);
+		pool_free(pool);
+	}
+	return 0;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bulk_thread(void *vbulk) {
+	struct bulk *bulk = (struct bulk *)vbulk;
+	frontend *fe = snew(frontend);
+	struct serialise_buf sb = { NULL, 0, 0 };
+	char *id = NULL;
+
+	fe->me = midend_new(fe, bulk->game, &counting_drawing, NULL);
+	while (1) {
+		char *seed, *error;
+		double start, end;
+		int job;
+
+		pthread_mutex_lock(&bulk->lock);
+		if (bulk->next >= bulk->count) {
+			pthread_mutex_unlock(&bulk->lock);
+			break;
+		}
+		job = bulk->next++;
+		seed = new_seed_string(bulk->seeds);
+		pthread_mutex_unlock(&bulk->lock);
+
+		id = sresize(id, strlen(bulk->params) + strlen(seed) + 2, char);
+		sprintf(id, "%s#%s", bulk->params, seed);
+		sfree(seed);
+
+		start = now();
+		error = midend_game_id(fe->me, id);
+		if (!error) midend_new_game(fe->me);
+		end = now();
+		sb.len = 0;
+		if (!error) midend_serialise(fe->me, serialise_buf_write, &sb);
+
+		pthread_mutex_lock(&bulk->lock);
+		bulk->latency[job] = end - start;
+		if (error) {
+			respond("ERROR", error, strlen(error));
+		} else {
+			respond("OK", sb.buf, sb.len);
+		}
+		pthread_mutex_unlock(&bulk->lock);
+	}
+	midend_free(fe->me);
+	sfree(fe);
+	sfree(sb.buf);
+	sfree(id);
+	return NULL;
+}
+
+static int compare_doubles(const void *av, const void *bv) {
+	double a = *(const double *)av, b = *(const double *)bv;
+	return a < b ? -1 : a > b ? +1 : 0;
+}
+
+static int bulk_generate(const game *thegame, const char *paramstr, int count, int nthreads) {
+	struct bulk bulk;
+	pthread_t *threads = snewn(nthreads, pthread_t);
+	char *error = NULL;
+	game_params *params;
+	void *randseed;
+	int randseedsize, started = 0, i;
+	double start, elapsed;
+
+	params = oriented_params_from_str(thegame, paramstr, &error);
+	if (!params) {
+		fprintf(stderr, "%s\n", error ? error : "Invalid parameters");
+		return 1;
+	}
+	bulk.game = thegame;
+	bulk.params = thegame->encode_params(params, TRUE);
+	thegame->free_params(params);
+	get_random_seed(&randseed, &randseedsize);
+	bulk.seeds = random_new(randseed, randseedsize);
+	sfree(randseed);
+	bulk.next = 0;
+	bulk.count = count;
+	bulk.latency = snewn(count, double);
+	pthread_mutex_init(&bulk.lock, NULL);
+
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, bulk_thread, &bulk) == 0) started++;
+		else break;
+	}
+	if (started == 0) bulk_thread(&bulk);
+	for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	elapsed = now() - start;
+
+	qsort(bulk.latency, count, sizeof(double), compare_doubles);
+	fprintf(stderr, "%d games on %d threads in %.3fs: %.2f games/s, latency p50 %.1fms p99 %.1fms\n",
+			count, started ? started : 1, elapsed, count / elapsed,
+			bulk.latency[(count - 1) * 50 / 100] * 1000,
+			bulk.latency[(count - 1) * 99 / 100] * 1000);
+
+	pthread_mutex_destroy(&bulk.lock);
+	random_free(bulk.seeds);
+	sfree(bulk.latency);
+	sfree(bulk.params);
+	sfree(threads);
+	return 0;
+}
+
+/* Generate and solve one game, returning a description of the results. */
+static char *stress_job(const game *g, int n) {
+	game_params *params = g->default_params();
+	char seed[40], *desc, *aux = NULL, *move = NULL, *msg = NULL, *ret;
+	random_state *rs;
+	game_state *state;
+
+	sprintf(seed, "stress%d", n);
+	rs = random_new(seed, strlen(seed));
+	desc = g->new_desc(params, rs, &aux, FALSE);
+	random_free(rs);
+	state = g->new_game(NULL, params, desc);
+	if (g->can_solve) {
+		/* Without aux, so that the solver does all the work. */
+		move = g->solve(state, state, NULL, &msg);
+		if (move) {
+			game_state *solved = g->execute_move(state, move);
+			if (solved) g->free_game(solved);
+		}
+	}
+	ret = snewn(strlen(desc) + (aux ? strlen(aux) : 0) + (move ? strlen(move) : msg ? strlen(msg) : 0) + 3, char);
+	sprintf(ret, "%s/%s/%s", desc, aux ? aux : "", move ? move : msg ? msg : "");
+	g->free_game(state);
+	g->free_params(params);
+	sfree(desc);
+	sfree(aux);
+	sfree(move);
+	return ret;
+}
+
+static void *stress_thread(void *vstress) {
+	struct stress *stress = (struct stress *)vstress;
+	while (1) {
+		char *result;
+		int job;
+
+		pthread_mutex_lock(&stress->lock);
+		if (stress->next >= stress->njobs) {
+			pthread_mutex_unlock(&stress->lock);
+			break;
+		}
+		job = stress->next++;
+		pthread_mutex_unlock(&stress->lock);
+
+		result = stress_job(gamelist[job / stress->count], job % stress->count);
+
+		pthread_mutex_lock(&stress->lock);
+		stress->results[job] = result;
+		pthread_mutex_unlock(&stress->lock);
+	}
+	return NULL;
+}
+
+static void stress_run(struct stress *stress, char **results, int nthreads) {
+	pthread_t *threads = snewn(nthreads, pthread_t);
+	int started = 0, i;
+
+	stress->next = 0;
+	stress->results = results;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, stress_thread, stress) == 0) started++;
+	}
+	if (started == 0) stress_thread(stress);
+	for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	sfree(threads);
+}
+
+static int stress_test(int count, int nthreads) {
+	struct stress stress;
+	char **single, **multi;
+	int failures = 0, i;
+
+	stress.count = count;
+	stress.njobs = gamecount * count;
+	single = snewn(stress.njobs, char *);
+	multi = snewn(stress.njobs, char *);
+	pthread_mutex_init(&stress.lock, NULL);
+
+	stress_run(&stress, single, 1);
+	stress_run(&stress, multi, nthreads);
+
+	for (i = 0; i < stress.njobs; i++) {
+		if (strcmp(single[i], multi[i])) {
+			fprintf(stderr, "%s seed %d differs on %d threads\n",
+					gamenames[i / count], i % count, nthreads);
+			failures++;
+		}
+		sfree(single[i]);
+		sfree(multi[i]);
+	}
+	fprintf(stderr, "%d games for %d backends on %d threads: %d differences\n",
+			stress.njobs, gamecount, nthreads, failures);
+
+	pthread_mutex_destroy(&stress.lock);
+	sfree(single);
+	sfree(multi);
+	return failures ? 1 : 0;
+}
+
+/*
+ * Map a whole file for reading, or say why not and return NULL. An
+ * empty file maps to an empty string.
+ */
+static void *map_file(const char *filename, struct mem_read *mr) {
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(filename);
+		return NULL;
+	}
+	map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(filename);
+		return NULL;
+	}
+	mr->p = map;
+	mr->len = st.st_size;
+	return map;
+}
+
+static void unmap_file(void *map, const struct mem_read *mr) {
+	if (mr->len > 0) munmap(map, mr->len);
+}
+
+/*
+ * With --convert, we write the save file given to stdout in the other
+ * form (or the same one). The file is mapped rather than read, so the
+ * reader takes each record straight from the page cache.
+ */
+static int convert_save(const char *filename, int binary) {
+	struct mem_read mr;
+	char *error;
+	void *map;
+
+	if (!(map = map_file(filename, &mr))) return 1;
+	error = save_convert(mem_read, &mr, serialise_write, NULL, binary);
+	unmap_file(map, &mr);
+	if (error) {
+		fprintf(stderr, "%s: %s\n", filename, error);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * With --render, we draw the game in the save file given with
+ * raster_drawing, as big as fits in a square of the given size, and
+ * write it to stdout as a PPM image.
+ */
+static int render_save(const char *filename, int size) {
+	struct mem_read whole, mr;
+	char *error, *name;
+	const game *g;
+	midend *me;
+	raster *r;
+	float *colours;
+	unsigned char *pixels, *p;
+	int w = size, h = size, ncolours, i;
+	void *map;
+
+	if (!(map = map_file(filename, &whole))) return 1;
+	mr = whole;
+	error = identify_game(&name, mem_read, &mr);
+	g = NULL;
+	for (i = 0; !error && i < gamecount; i++) {
+		if (!strcmp(gamelist[i]->name, name)) g = gamelist[i];
+	}
+	if (!error && !g) error = "Game name not recognised";
+	sfree(name);
+	if (!error) {
+		r = raster_new();
+		me = midend_new(NULL, g, &raster_drawing, r);
+		mr = whole;
+		error = midend_deserialise(me, mem_read, &mr);
+	}
+	unmap_file(map, &whole);
+	if (error) {
+		fprintf(stderr, "%s: %s\n", filename, error);
+		return 1;
+	}
+
+	midend_size(me, &w, &h, FALSE);
+	colours = midend_colours(me, &ncolours);
+	raster_set_colours(r, colours, ncolours);
+	sfree(colours);
+	pixels = snewn(w * h * 4, unsigned char);
+	raster_set_target(r, pixels, w, h, w * 4, RASTER_RGBA8888);
+	raster_drawing.draw_rect(r, 0, 0, w, h, 0);
+	midend_redraw(me);
+
+	printf("P6\n%d %d\n255\n", w, h);
+	for (i = 0, p = pixels; i < w * h; i++, p += 4)
+		fwrite(p, 1, 3, stdout);
+	sfree(pixels);
+	midend_free(me);
+	raster_free(r);
+	return 0;
+}
+
+int main(int argc, const char *argv[]) {
+	if (argc >= 2 && !strcmp(argv[1], "--profile")) {
+		if (profile_enable(TRUE)) {
+			atexit(dump_profile);
+		} else {
+			fprintf(stderr, "--profile: not built with PROFILING\n");
+		}
+		argv[1] = argv[0];
+		argc--;
+		argv++;
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--server")) {
+		const char *poolfile = NULL;
+		int i;
+		for (i = 2; i < argc; i += 2) {
+			if (i + 1 < argc && !strcmp(argv[i], "--pool")) {
+				poolfile = argv[i+1];
+			} else if (i + 1 < argc && !strcmp(argv[i], "--race") && atoi(argv[i+1]) >= 1) {
+				race = atoi(argv[i+1]);
+			} else if (i + 1 < argc && !strcmp(argv[i], "--timeout") && atof(argv[i+1]) > 0) {
+				timeout = atof(argv[i+1]);
+			} else {
+				usage();
+				exit(1);
+			}
+		}
+		if (poolfile) start_pool(poolfile);
+		exit(serve());
+	}
+	if (argc == 4 && !strcmp(argv[1], "--convert") &&
+			(!strcmp(argv[2], "text") || !strcmp(argv[2], "binary"))) {
+		exit(convert_save(argv[3], !strcmp(argv[2], "binary")));
+	}
+	if (argc >= 3 && !strcmp(argv[1], "--render")) {
+		int size = 512;
+		if (argc == 5 && !strcmp(argv[2], "--size") && atoi(argv[3]) >= 16) {
+			size = atoi(argv[3]);
+		} else if (argc != 3) {
+			usage();
 			exit(1);
 		}
+		exit(render_save(argv[argc - 1], size));
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+		exit(bench_main(argc - 2, argv + 2));
+	}
+	if (argc >= 2 && !strcmp(argv[1], "--stress")) {
+		int count = 3, nthreads = 8, i;
+		for (i = 2; i < argc; i += 2) {
+			if (i + 1 < argc && !strcmp(argv[i], "--count") && atoi(argv[i+1]) >= 1) {
+				count = atoi(argv[i+1]);
+			} else if (i + 1 < argc && !strcmp(argv[i], "--threads") && atoi(argv[i+1]) >= 1) {
+				nthreads = atoi(argv[i+1]);
+			} else {
+				usage();
+				exit(1);
+			}
+		}
+		exit(stress_test(count, nthreads));
+	}
+	if (argc < 2) {
+		usage();
+		exit(1);
 	}
 
 	const game *thegame = game_by_name(argv[1]);
@@ -43,24 +658,35 @@ int main(int argc, const char *argv[]) {
 		exit(1);
 	}
 
+	{
+		const char *paramstr = NULL;
+		int count = 0, nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN), bad = FALSE, i;
+		for (i = 2; i < argc; i++) {
+			if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+				count = atoi(argv[++i]);
+			} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+				nthreads = atoi(argv[++i]);
+			} else if (i == 2 && argv[i][0] != '-') {
+				paramstr = argv[i];
+			} else {
+				bad = TRUE;	/* perhaps a one-shot option */
+			}
+		}
+		if (count > 0 && nthreads >= 1 && !bad) exit(bulk_generate(thegame, paramstr, count, nthreads));
+		if (count != 0 || argc > 4) {
+			usage();
+			exit(1);
+		}
+	}
+
 	frontend *fe = snew(frontend);
-	fe->me = midend_new(fe, thegame, &null_drawing, fe);
+	fe->me = midend_new(fe, thegame, &counting_drawing, NULL);
 
-	char* error = NULL;
-	game_params *params = NULL;
-	if (defmode == DEF_PARAMS) {
-		params = oriented_params_from_str(thegame, (argc >= 3 && strlen(argv[2]) > 0) ? argv[2] : NULL, &error);
-	} else {
-		char *tmp = dupstr(argv[3]);
-		error = midend_game_id_int(fe->me, tmp, defmode, FALSE);
-		sfree(tmp);
-	}
+	char *error = new_game_from_args(fe->me, argc - 2, (char **)argv + 2);
 	if (error) {
 		fprintf(stderr, "%s\n", error);
 		exit(1);
 	}
-	if (defmode == DEF_PARAMS) midend_set_params(fe->me, params);
-	midend_new_game(fe->me);
 
 	// We need a save not just a desc: aux info contains solution
 	midend_serialise(fe->me, serialise_write, NULL);
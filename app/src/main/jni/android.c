@@ -14,6 +14,8 @@
 #include <ctype.h>
 #include <signal.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <dlfcn.h>
 
 #include <sys/time.h>
 
@@ -35,10 +37,18 @@ void fatal(char *fmt, ...)
 struct frontend {
 	midend *me;
 	int timer_active;
-	struct timeval last_time;
+	jlong last_tick;  // System.nanoTime() of the last tick, or when the timer started
+	struct frame_pacer pacer;
+	int frames_drawn;
 	config_item *cfg;
 	int cfg_which;
 	int ox, oy;
+	struct drawbuf cmds;  // this frame's drawing, not yet passed to Java
+	raster *raster;
+	int rastering;  // this frame is going straight into rasterBitmap
+	int text_pending;  // ...except for text in cmds
+	int clipped, clip_x, clip_y, clip_w, clip_h;
+	int updated;  // this frame said which areas it changed
 };
 
 static frontend *fe = NULL;
@@ -53,6 +63,10 @@ static jobject obj = NULL;
 #define GETTEXTED_COUNT 32
 static char gettexted[GETTEXTED_COUNT][GETTEXTED_SIZE];
 static int next_gettexted = 0;
+static pthread_mutex_t gettexted_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Full game_states kept for undo; the rest are replayed on demand. */
+#define UNDO_BUDGET 256
 
 static jobject ARROW_MODE_NONE = NULL,
 	ARROW_MODE_ARROWS_ONLY = NULL,
@@ -61,21 +75,33 @@ static jobject ARROW_MODE_NONE = NULL,
 	ARROW_MODE_DIAGONALS = NULL;
 
 static jobject gameView = NULL;
+
+/*
+ * When the user asks for it and the view isn't zoomed, GameView gives
+ * us its bitmap to draw into with raster.c, leaving only text to
+ * Java. libjnigraphics arrived in Android 2.2, so we look for it at
+ * run time rather than link against it; these are its declarations.
+ */
+typedef struct {
+	uint32_t width, height, stride;
+	int32_t format;
+	uint32_t flags;
+} BitmapInfo;
+#define BITMAP_FORMAT_RGBA_8888 1
+#define BITMAP_FORMAT_RGB_565 4
+static int (*bitmapGetInfo)(JNIEnv *env, jobject bitmap, BitmapInfo *info);
+static int (*bitmapLockPixels)(JNIEnv *env, jobject bitmap, void **pixels);
+static int (*bitmapUnlockPixels)(JNIEnv *env, jobject bitmap);
+static jobject rasterBitmap = NULL;
+static int rasterOX, rasterOY;
 static jmethodID
 	blitterAlloc,
 	blitterFree,
-	blitterLoad,
-	blitterSave,
 	changedState,
-	clipRect,
 	dialogAdd,
 	dialogInit,
 	dialogShow,
-	drawCircle,
-	drawLine,
-	drawPoly,
-	drawText,
-	fillRect,
+	drawCommands,
 	getBackgroundColour,
 	getText,
 	postInvalidate,
@@ -101,10 +127,17 @@ void get_random_seed(void **randseed, int *randseedsize)
 	*randseedsize = sizeof(struct timeval);
 }
 
+/* R.color.game_background, for when there's no GameView to ask:
+ * puzzlesgen draws with this library but never loads it through JNI. */
+#define DEFAULT_BACKGROUND_ARGB 0xffcccccc
+
 void frontend_default_colour(frontend *fe, float *output)
 {
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jint argb = (*env)->CallIntMethod(env, gameView, getBackgroundColour);
+	jint argb = DEFAULT_BACKGROUND_ARGB;
+	if (gameView) {
+		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+		argb = (*env)->CallIntMethod(env, gameView, getBackgroundColour);
+	}
 	output[0] = ((argb & 0x00ff0000) >> 16) / 255.0f;
 	output[1] = ((argb & 0x0000ff00) >> 8) / 255.0f;
 	output[2] = (argb & 0x000000ff) / 255.0f;
@@ -121,82 +154,145 @@ void android_status_bar(void *handle, char *text)
 
 #define CHECK_DR_HANDLE if ((frontend*)handle != fe) return;
 
+/* Hand Java everything drawn since the last time, to replay in order. */
+static void android_flush_draw(frontend *f)
+{
+	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+	jobject bufj;
+	f->text_pending = FALSE;
+	if (f->cmds.len == 0) return;
+	bufj = (*env)->NewDirectByteBuffer(env, f->cmds.words, f->cmds.len * sizeof(int));
+	if (bufj) {
+		(*env)->CallVoidMethod(env, gameView, drawCommands, bufj);
+		(*env)->DeleteLocalRef(env, bufj);
+	}
+	f->cmds.len = 0;
+}
+
+static int android_raster_lock(frontend *f)
+{
+	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+	BitmapInfo info;
+	void *pixels;
+	int format;
+	if (!rasterBitmap || !bitmapLockPixels || raster_ncolours(f->raster) == 0) return FALSE;
+	if (bitmapGetInfo(env, rasterBitmap, &info) < 0) return FALSE;
+	if (info.format == BITMAP_FORMAT_RGB_565) format = RASTER_RGB565;
+	else if (info.format == BITMAP_FORMAT_RGBA_8888) format = RASTER_RGBA8888;
+	else return FALSE;
+	if (bitmapLockPixels(env, rasterBitmap, &pixels) < 0) return FALSE;
+	raster_set_target(f->raster, pixels, info.width, info.height, info.stride, format);
+	raster_set_origin(f->raster, rasterOX + f->ox, rasterOY + f->oy);
+	if (f->clipped)
+		raster_drawing.clip(f->raster, f->clip_x, f->clip_y, f->clip_w, f->clip_h);
+	return TRUE;
+}
+
+static void android_raster_unlock(frontend *f)
+{
+	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+	bitmapUnlockPixels(env, rasterBitmap);
+	f->rastering = FALSE;
+}
+
+/*
+ * Whether to draw natively now. Text queued for Java has to land
+ * before anything drawn after it, so we let go of the pixels while
+ * Java draws it.
+ */
+static int android_rastering(frontend *f)
+{
+	if (f->rastering && f->text_pending) {
+		android_raster_unlock(f);
+		android_flush_draw(f);
+		f->rastering = android_raster_lock(f);
+	}
+	return f->rastering;
+}
+
 void android_start_draw(void *handle)
 {
 	CHECK_DR_HANDLE
-//	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+	fe->rastering = android_raster_lock(fe);
 }
 
 void android_clip(void *handle, int x, int y, int w, int h)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, clipRect, x + fe->ox, y + fe->oy, w, h);
+	fe->clipped = TRUE;
+	fe->clip_x = x;
+	fe->clip_y = y;
+	fe->clip_w = w;
+	fe->clip_h = h;
+	if (fe->rastering) raster_drawing.clip(fe->raster, x, y, w, h);
+	drawbuf_clip(&fe->cmds, x + fe->ox, y + fe->oy, w, h);  // for text, even if rastering
 }
 
 void android_unclip(void *handle)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, unClip, fe->ox, fe->oy);
+	fe->clipped = FALSE;
+	if (fe->rastering) raster_drawing.unclip(fe->raster);
+	drawbuf_unclip(&fe->cmds, fe->ox, fe->oy);
 }
 
 void android_draw_text(void *handle, int x, int y, int fonttype, int fontsize,
 		int align, int colour, char *text)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jstring js = (*env)->NewStringUTF(env, text);
-	if( js == NULL ) return;
-	(*env)->CallVoidMethod(env, gameView, drawText, x + fe->ox, y + fe->oy,
-			(fonttype == FONT_FIXED ? 0x10 : 0x0) | align,
-			fontsize, colour, js);
-	(*env)->DeleteLocalRef(env, js);
+	drawbuf_text(&fe->cmds, x + fe->ox, y + fe->oy, fonttype, fontsize, align, colour, text);
+	if (fe->rastering) fe->text_pending = TRUE;
 }
 
 void android_draw_rect(void *handle, int x, int y, int w, int h, int colour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, fillRect, x + fe->ox, y + fe->oy, w, h, colour);
+	if (android_rastering(fe))
+		raster_drawing.draw_rect(fe->raster, x, y, w, h, colour);
+	else
+		drawbuf_rect(&fe->cmds, x + fe->ox, y + fe->oy, w, h, colour);
 }
 
 void android_draw_line(void *handle, int x1, int y1, int x2, int y2, 
 		int colour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, drawLine, x1 + fe->ox, y1 + fe->oy, x2 + fe->ox, y2 + fe->oy, colour);
+	if (android_rastering(fe))
+		raster_drawing.draw_line(fe->raster, x1, y1, x2, y2, colour);
+	else
+		drawbuf_line(&fe->cmds, x1 + fe->ox, y1 + fe->oy, x2 + fe->ox, y2 + fe->oy, colour);
 }
 
 void android_draw_poly(void *handle, int *coords, int npoints,
 		int fillcolour, int outlinecolour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jintArray coordsj = (*env)->NewIntArray(env, npoints*2);
-	if (coordsj == NULL) return;
-	(*env)->SetIntArrayRegion(env, coordsj, 0, npoints*2, coords);
-	(*env)->CallVoidMethod(env, gameView, drawPoly, coordsj, fe->ox, fe->oy, outlinecolour, fillcolour);
-	(*env)->DeleteLocalRef(env, coordsj);  // prevent ref table exhaustion on e.g. large Mines grids...
+	if (android_rastering(fe))
+		raster_drawing.draw_polygon(fe->raster, coords, npoints, fillcolour, outlinecolour);
+	else
+		drawbuf_polygon(&fe->cmds, coords, npoints, fe->ox, fe->oy, fillcolour, outlinecolour);
 }
 
 void android_draw_circle(void *handle, int cx, int cy, int radius,
 		 int fillcolour, int outlinecolour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, drawCircle, cx+fe->ox, cy+fe->oy, radius, outlinecolour, fillcolour);
+	if (android_rastering(fe))
+		raster_drawing.draw_circle(fe->raster, cx, cy, radius, fillcolour, outlinecolour);
+	else
+		drawbuf_circle(&fe->cmds, cx + fe->ox, cy + fe->oy, radius, fillcolour, outlinecolour);
 }
 
 struct blitter {
 	int handle, w, h, x, y;
+	blitter *raster;  // raster.c's, if saved while rastering
 };
 
 blitter *android_blitter_new(void *handle, int w, int h)
 {
 	blitter *bl = snew(blitter);
 	bl->handle = -1;
+	bl->raster = NULL;
 	bl->w = w;
 	bl->h = h;
 	return bl;
@@ -206,8 +302,10 @@ void android_blitter_free(void *handle, blitter *bl)
 {
 	if (bl->handle != -1) {
 		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+		android_flush_draw((frontend*)handle);  // queued commands may use it
 		(*env)->CallVoidMethod(env, gameView, blitterFree, bl->handle);
 	}
+	if (bl->raster) raster_drawing.blitter_free(((frontend*)handle)->raster, bl->raster);
 	sfree(bl);
 }
 
@@ -215,29 +313,51 @@ void android_blitter_save(void *handle, blitter *bl, int x, int y)
 {
 	CHECK_DR_HANDLE
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	if (bl->handle == -1)
-		bl->handle = (*env)->CallIntMethod(env, gameView, blitterAlloc, bl->w, bl->h);
 	bl->x = x;
 	bl->y = y;
-	(*env)->CallVoidMethod(env, gameView, blitterSave, bl->handle, x + fe->ox, y + fe->oy);
+	if (android_rastering(fe)) {
+		if (!bl->raster) bl->raster = raster_drawing.blitter_new(fe->raster, bl->w, bl->h);
+		raster_drawing.blitter_save(fe->raster, bl->raster, x, y);
+		return;
+	}
+	if (bl->handle == -1)
+		bl->handle = (*env)->CallIntMethod(env, gameView, blitterAlloc, bl->w, bl->h);
+	drawbuf_blitter_save(&fe->cmds, bl->handle, x + fe->ox, y + fe->oy);
 }
 
 void android_blitter_load(void *handle, blitter *bl, int x, int y)
 {
 	CHECK_DR_HANDLE
-	assert(bl->handle != -1);
 	if (x == BLITTER_FROMSAVED && y == BLITTER_FROMSAVED) {
 		x = bl->x;
 		y = bl->y;
 	}
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, blitterLoad, bl->handle, x + fe->ox, y + fe->oy);
+	// if it was saved the other way, the view has been zoomed since and will be redrawn
+	if (android_rastering(fe)) {
+		if (bl->raster) raster_drawing.blitter_load(fe->raster, bl->raster, x, y);
+		return;
+	}
+	if (bl->handle == -1) return;
+	drawbuf_blitter_load(&fe->cmds, bl->handle, x + fe->ox, y + fe->oy);
+}
+
+/* Already merged by drawing.c; GameView invalidates just these areas once they're drawn. */
+void android_draw_update(void *handle, int x, int y, int w, int h)
+{
+	CHECK_DR_HANDLE
+	drawbuf_update(&fe->cmds, x + fe->ox, y + fe->oy, w, h);
+	fe->updated = TRUE;
 }
 
 void android_end_draw(void *handle)
 {
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, postInvalidate);
+	frontend *f = (frontend*)handle;
+	if (f->rastering) android_raster_unlock(f);
+	android_flush_draw(f);
+	if (!f->updated) (*env)->CallVoidMethod(env, gameView, postInvalidate);
+	f->updated = FALSE;
+	f->frames_drawn++;
 }
 
 void android_changed_state(void *handle, int can_undo, int can_redo)
@@ -262,7 +382,7 @@ const struct drawing_api android_drawing = {
 	android_draw_line,
 	android_draw_poly,
 	android_draw_circle,
-	NULL, // draw_update,
+	android_draw_update,
 	android_clip,
 	android_unclip,
 	android_start_draw,
@@ -299,17 +419,39 @@ void JNICALL resizeEvent(JNIEnv *env, jobject _obj, jint width, jint height)
 	midend_force_redraw(fe->me);
 }
 
-void JNICALL timerTick(JNIEnv *env, jobject _obj)
+static jlong monotonic_nanos(void)
 {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);  // as System.nanoTime()
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Called once a display frame (or as near as Java can manage), with that frame's time. */
+void JNICALL timerTick(JNIEnv *env, jobject _obj, jlong frameTimeNanos, jlong intervalNanos)
+{
+	double tplus;
+	jlong start;
+	int drawn;
 	if (! fe->timer_active) return;
 	pthread_setspecific(envKey, env);
-	struct timeval now;
-	float elapsed;
-	gettimeofday(&now, NULL);
-	elapsed = ((now.tv_usec - fe->last_time.tv_usec) * 0.000001F +
-			(now.tv_sec - fe->last_time.tv_sec));
-		midend_timer(fe->me, elapsed);  // may clear timer_active
-	fe->last_time = now;
+	if (pacer_tick(&fe->pacer, intervalNanos / 1e9, (frameTimeNanos - fe->last_tick) / 1e9, &tplus)) {
+		drawn = fe->frames_drawn;
+		start = monotonic_nanos();
+		midend_timer(fe->me, (float)tplus);  // may clear timer_active
+		if (fe->frames_drawn != drawn) pacer_frame(&fe->pacer, (monotonic_nanos() - start) / 1e9);
+	}
+	fe->last_tick = frameTimeNanos;
+}
+
+jstring JNICALL getFrameStats(JNIEnv *env, jobject _obj)
+{
+	char *stats;
+	jstring ret;
+	if (!fe || fe->pacer.stats.frames == 0) return NULL;
+	stats = pacer_stats(&fe->pacer);
+	ret = (*env)->NewStringUTF(env, stats);
+	sfree(stats);
+	return ret;
 }
 
 void deactivate_timer(frontend *_fe)
@@ -328,7 +470,8 @@ void activate_timer(frontend *_fe)
 	if (!fe->timer_active) {
 		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 		(*env)->CallVoidMethod(env, obj, requestTimer, TRUE);
-		gettimeofday(&fe->last_time, NULL);
+		fe->last_tick = monotonic_nanos();
+		pacer_start(&fe->pacer);
 	}
 	fe->timer_active = TRUE;
 }
@@ -491,44 +634,33 @@ void JNICALL configCancel(JNIEnv *env, jobject _obj)
 	fe->cfg = NULL;
 }
 
-void android_serialise_write(void *ctx, void *buf, int len)
-{
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jbyteArray bytesj = (*env)->NewByteArray(env, len);
-	if (bytesj == NULL) return;
-	(*env)->SetByteArrayRegion(env, bytesj, 0, len, buf);
-	(*env)->CallVoidMethod(env, obj, serialiseWrite, bytesj);
-	(*env)->DeleteLocalRef(env, bytesj);
-}
-
 void JNICALL serialise(JNIEnv *env, jobject _obj)
 {
+	struct serialise_buf sb = { NULL, 0, 0 };
+	jobject bufj;
 	if (!fe) return;
 	pthread_setspecific(envKey, env);
-	midend_serialise(fe->me, android_serialise_write, (void*)0);
-}
-
-static const char* deserialise_readptr = NULL;
-static int deserialise_readlen = 0;
-
-int android_deserialise_read(void *ctx, void *buf, int len)
-{
-	int l = min(len, deserialise_readlen);
-	if (l < 0) return FALSE;
-	else if (l == 0) return len == 0;
-	memcpy( buf, deserialise_readptr, l );
-	deserialise_readptr += l;
-	deserialise_readlen -= l;
-	return l == len;
+	midend_serialise(fe->me, serialise_buf_write, &sb);
+	// One call into Java for the whole save, which reads it in place
+	if (sb.len > 0) {
+		bufj = (*env)->NewDirectByteBuffer(env, sb.buf, sb.len);
+		if (bufj != NULL) {
+			(*env)->CallVoidMethod(env, obj, serialiseWrite, bufj);
+			(*env)->DeleteLocalRef(env, bufj);
+		}
+	}
+	sfree(sb.buf);
 }
 
 int deserialiseOrIdentify(frontend *new_fe, jstring s, jboolean identifyOnly) {
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 	const char * c = (*env)->GetStringUTFChars(env, s, NULL);
-	deserialise_readptr = c;
-	deserialise_readlen = strlen(deserialise_readptr);
+	struct mem_read mr;
+	mr.p = c;
+	mr.len = strlen(c);
 	char *name;
-	const char *error = identify_game(&name, android_deserialise_read, NULL);
+	// Only reads as far as the game name
+	const char *error = identify_game(&name, mem_read, &mr);
 	int whichBackend = -1;
 	if (! error) {
 		int i;
@@ -542,9 +674,10 @@ int deserialiseOrIdentify(frontend *new_fe, jstring s, jboolean identifyOnly) {
 	if (! error && ! identifyOnly) {
 		thegame = gamelist[whichBackend];
 		new_fe->me = midend_new(new_fe, gamelist[whichBackend], &android_drawing, new_fe);
-		deserialise_readptr = c;
-		deserialise_readlen = strlen(deserialise_readptr);
-		error = midend_deserialise(new_fe->me, android_deserialise_read, NULL);
+		midend_set_undo_budget(new_fe->me, UNDO_BUDGET);
+		mr.p = c;
+		mr.len = strlen(c);
+		error = midend_deserialise(new_fe->me, mem_read, &mr);
 	}
 	(*env)->ReleaseStringUTFChars(env, s, c);
 	if (error) {
@@ -580,6 +713,7 @@ jstring JNICALL htmlHelpTopic(JNIEnv *env, jobject _obj)
 
 void android_completed()
 {
+	if (!obj) return;
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 	(*env)->CallVoidMethod(env, obj, completed);
 }
@@ -685,13 +819,18 @@ char * get_text(const char *s)
 {
 	if (!s || ! s[0] || !fe) return (char*)s;  // slightly naughty cast...
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+	// Only threads that Java called in on have an env; a worker thread
+	// (e.g. generating a game) gets the untranslated string.
+	if (!env) return (char*)s;
 	jstring j = (jstring)(*env)->CallObjectMethod(env, obj, getText, (*env)->NewStringUTF(env, s));
 	const char * c = (*env)->GetStringUTFChars(env, j, NULL);
 	// TODO get rid of this horrible hack
+	pthread_mutex_lock(&gettexted_lock);
 	char * ret = gettexted[next_gettexted];
 	next_gettexted = (next_gettexted + 1) % GETTEXTED_COUNT;
 	strncpy(ret, c, GETTEXTED_SIZE);
 	ret[GETTEXTED_SIZE-1] = '\0';
+	pthread_mutex_unlock(&gettexted_lock);
 	(*env)->ReleaseStringUTFChars(env, j, c);
 	return ret;
 }
@@ -707,6 +846,7 @@ int startPlayingIntGameID(frontend* new_fe, jstring jsGameID, jstring backend)
 		return;
 	}
 	new_fe->me = midend_new(new_fe, g, &android_drawing, new_fe);
+	midend_set_undo_budget(new_fe->me, UNDO_BUDGET);
 	const char * gameIDjs = (*env)->GetStringUTFChars(env, jsGameID, NULL);
 	char * gameID = dupstr(gameIDjs);
 	(*env)->ReleaseStringUTFChars(env, jsGameID, gameIDjs);
@@ -724,12 +864,21 @@ jfloatArray JNICALL getColours(JNIEnv *env, jobject _obj)
 	int n;
 	float* colours;
 	colours = midend_colours(fe->me, &n);
+	raster_set_colours(fe->raster, colours, n);
 	jfloatArray jColours = (*env)->NewFloatArray(env, n*3);
-	if (jColours == NULL) return NULL;
-	(*env)->SetFloatArrayRegion(env, jColours, 0, n*3, colours);
+	if (jColours != NULL) (*env)->SetFloatArrayRegion(env, jColours, 0, n*3, colours);
+	sfree(colours);
 	return jColours;
 }
 
+void JNICALL setRasterTarget(JNIEnv *env, jobject _obj, jobject bitmap, jint originX, jint originY)
+{
+	if (rasterBitmap) (*env)->DeleteGlobalRef(env, rasterBitmap);
+	rasterBitmap = bitmap ? (*env)->NewGlobalRef(env, bitmap) : NULL;
+	rasterOX = originX;
+	rasterOY = originY;
+}
+
 jobjectArray JNICALL getPresets(JNIEnv *env, jobject _obj)
 {
 	int n = midend_num_presets(fe->me);
@@ -766,6 +915,8 @@ void startPlayingInt(JNIEnv *env, jobject _obj, jobject _gameView, jstring backe
 	frontend *new_fe = snew(frontend);
 	memset(new_fe, 0, sizeof(frontend));
 	new_fe->ox = -1;
+	new_fe->raster = raster_new();
+	pacer_init(&new_fe->pacer, 0);
 	jstring whichBackend;
 	if (isGameID) {
 		whichBackend = backend;
@@ -778,6 +929,8 @@ void startPlayingInt(JNIEnv *env, jobject _obj, jobject _gameView, jstring backe
 
 	if (fe) {
 		if (fe->me) midend_free(fe->me);  // might use gameView (e.g. blitters)
+		drawbuf_free(&fe->cmds);
+		raster_free(fe->raster);
 		sfree(fe);
 	}
 	fe = new_fe;
@@ -807,6 +960,13 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 	JNIEnv *env;
 	if ((*jvm)->GetEnv(jvm, (void **)&env, JNI_VERSION_1_2)) return JNI_ERR;
 	pthread_key_create(&envKey, NULL);
+	void *jnigraphics = dlopen("libjnigraphics.so", RTLD_NOW);
+	if (jnigraphics) {
+		bitmapGetInfo = dlsym(jnigraphics, "AndroidBitmap_getInfo");
+		bitmapLockPixels = dlsym(jnigraphics, "AndroidBitmap_lockPixels");
+		bitmapUnlockPixels = dlsym(jnigraphics, "AndroidBitmap_unlockPixels");
+		if (!bitmapGetInfo || !bitmapUnlockPixels) bitmapLockPixels = NULL;
+	}
 	pthread_setspecific(envKey, env);
 	cls = (*env)->FindClass(env, "name/boyle/chris/sgtpuzzles/GamePlay");
 	vcls = (*env)->FindClass(env, "name/boyle/chris/sgtpuzzles/GameView");
@@ -823,23 +983,16 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 			(*env)->GetStaticFieldID(env, arrowModeCls, "ARROWS_DIAGONALS", "Lname/boyle/chris/sgtpuzzles/SmallKeyboard$ArrowMode;")));
 	blitterAlloc   = (*env)->GetMethodID(env, vcls, "blitterAlloc", "(II)I");
 	blitterFree    = (*env)->GetMethodID(env, vcls, "blitterFree", "(I)V");
-	blitterLoad    = (*env)->GetMethodID(env, vcls, "blitterLoad", "(III)V");
-	blitterSave    = (*env)->GetMethodID(env, vcls, "blitterSave", "(III)V");
 	changedState   = (*env)->GetMethodID(env, cls,  "changedState", "(ZZ)V");
-	clipRect       = (*env)->GetMethodID(env, vcls, "clipRect", "(IIII)V");
 	dialogAdd      = (*env)->GetMethodID(env, cls,  "dialogAdd", "(IILjava/lang/String;Ljava/lang/String;I)V");
 	dialogInit     = (*env)->GetMethodID(env, cls,  "dialogInit", "(ILjava/lang/String;)V");
 	dialogShow     = (*env)->GetMethodID(env, cls,  "dialogShow", "()V");
-	drawCircle     = (*env)->GetMethodID(env, vcls, "drawCircle", "(IIIII)V");
-	drawLine       = (*env)->GetMethodID(env, vcls, "drawLine", "(IIIII)V");
-	drawPoly       = (*env)->GetMethodID(env, vcls,  "drawPoly", "([IIIII)V");
-	drawText       = (*env)->GetMethodID(env, vcls, "drawText", "(IIIIILjava/lang/String;)V");
-	fillRect       = (*env)->GetMethodID(env, vcls, "fillRect", "(IIIII)V");
+	drawCommands   = (*env)->GetMethodID(env, vcls, "drawCommands", "(Ljava/nio/ByteBuffer;)V");
 	getBackgroundColour = (*env)->GetMethodID(env, vcls, "getDefaultBackgroundColour", "()I");
 	getText        = (*env)->GetMethodID(env, cls,  "gettext", "(Ljava/lang/String;)Ljava/lang/String;");
 	postInvalidate = (*env)->GetMethodID(env, vcls, "postInvalidate", "()V");
 	requestTimer   = (*env)->GetMethodID(env, cls,  "requestTimer", "(Z)V");
-	serialiseWrite = (*env)->GetMethodID(env, cls,  "serialiseWrite", "([B)V");
+	serialiseWrite = (*env)->GetMethodID(env, cls,  "serialiseWrite", "(Ljava/nio/ByteBuffer;)V");
 	setStatus      = (*env)->GetMethodID(env, cls,  "setStatus", "(Ljava/lang/String;)V");
 	showToast      = (*env)->GetMethodID(env, cls,  "showToast", "(Ljava/lang/String;Z)V");
 	unClip         = (*env)->GetMethodID(env, vcls, "unClip", "(II)V");
@@ -850,7 +1003,8 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 	JNINativeMethod methods[] = {
 		{ "keyEvent", "(III)V", keyEvent },
 		{ "resizeEvent", "(II)V", resizeEvent },
-		{ "timerTick", "()V", timerTick },
+		{ "timerTick", "(JJ)V", timerTick },
+		{ "getFrameStats", "()Ljava/lang/String;", getFrameStats },
 		{ "configSetString", "(Ljava/lang/String;Ljava/lang/String;)V", configSetString },
 		{ "configSetBool", "(Ljava/lang/String;I)V", configSetBool },
 		{ "configSetChoice", "(Ljava/lang/String;I)V", configSetChoice },
@@ -873,6 +1027,7 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 		{ "getPresets", "()[Ljava/lang/String;", getPresets },
 		{ "getGameTitle", "()Ljava/lang/String;", getGameTitle },
 		{ "getUIVisibility", "()I", getUIVisibility },
+		{ "setRasterTarget", "(Landroid/graphics/Bitmap;II)V", setRasterTarget },
 	};
 	(*env)->RegisterNatives(env, cls, methods, sizeof(methods)/sizeof(JNINativeMethod));
 
@@ -1553,6 +1553,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 /* vim: set shiftwidth=4 tabstop=8: */
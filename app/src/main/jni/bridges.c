@@ -124,9 +124,6 @@ struct game_params {
 /* flags used by the error checker */
 #define G_WARN          0x0080
 
-/* flags used by the solver etc. */
-#define G_SWEEP         0x1000
-
 #define G_FLAGSH        (G_LINEH|G_MARKH|G_NOLINEH)
 #define G_FLAGSV        (G_LINEV|G_MARKV|G_NOLINEV)
 
@@ -1157,7 +1154,7 @@ static void map_group(game_state *state)
      * bridge squares. */
     for (x = 0; x < state->w; x++) {
         for (y = 0; y < state->h; y++) {
-            GRID(state,x,y) &= ~(G_SWEEP|G_WARN); /* for group_full. */
+            GRID(state,x,y) &= ~G_WARN; /* for group_full. */
 
             is = INDEX(state, gridi, x, y);
             if (!is) continue;
@@ -1180,7 +1177,7 @@ static void map_group(game_state *state)
                 for (x2 = x; x2 <= is_join->x; x2++) {
                     for (y2 = y; y2 <= is_join->y; y2++) {
                         d2 = DINDEX(x2,y2);
-                        if (d1 != d2) dsf_merge(dsf,d1,d2);
+                        if (d1 != d2) dsf_merge_by_size(dsf,NULL,d1,d2);
                     }
                 }
             }
@@ -1188,56 +1185,66 @@ static void map_group(game_state *state)
     }
 }
 
-static int map_group_check(game_state *state, int canon, int warn,
-                           int *nislands_r)
+static int map_group_check(game_state *state, int canon, int *nislands_r)
 {
     int *dsf = state->solver->dsf, nislands = 0;
-    int x, y, i, allfull = 1;
+    int i, allfull = 1;
     struct island *is;
 
     for (i = 0; i < state->n_islands; i++) {
         is = &state->islands[i];
         if (dsf_canonify(dsf, DINDEX(is->x,is->y)) != canon) continue;
 
-        GRID(state, is->x, is->y) |= G_SWEEP;
         nislands++;
         if (island_countbridges(is) != is->count)
             allfull = 0;
     }
-    if (warn && allfull && nislands != state->n_islands) {
-        /* we're full and this island group isn't the whole set.
-         * Mark all squares with this dsf canon as ERR. */
-        for (x = 0; x < state->w; x++) {
-            for (y = 0; y < state->h; y++) {
-                if (dsf_canonify(dsf, DINDEX(x,y)) == canon) {
-                    GRID(state,x,y) |= G_WARN;
-                }
-            }
-        }
-
-    }
     if (nislands_r) *nislands_r = nislands;
     return allfull;
 }
 
 static int map_group_full(game_state *state, int *ngroups_r)
 {
-    int *dsf = state->solver->dsf, ngroups = 0;
-    int i, anyfull = 0;
+    int *dsf = state->solver->dsf, wh = state->w*state->h, ngroups = 0;
+    int *comp = snewn(wh, int), *nislands, *allfull, ncomps;
+    int i, x, y, anyfull = 0;
     struct island *is;
 
-    /* NB this assumes map_group (or sth else) has cleared G_SWEEP. */
-
+    /* Count each group's islands, and whether they're all full, in one
+     * pass rather than calling map_group_check for each. */
+    dsf_flatten(dsf, wh, comp, NULL, &ncomps);
+    nislands = snewn(ncomps, int);
+    allfull = snewn(ncomps, int);
+    for (i = 0; i < ncomps; i++) {
+        nislands[i] = 0;
+        allfull[i] = 1;
+    }
     for (i = 0; i < state->n_islands; i++) {
+        int c;
         is = &state->islands[i];
-        if (GRID(state,is->x,is->y) & G_SWEEP) continue;
-
-        ngroups++;
-        if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
-                            1, NULL))
+        c = comp[DINDEX(is->x,is->y)];
+        if (nislands[c]++ == 0)
+            ngroups++;
+        if (island_countbridges(is) != is->count)
+            allfull[c] = 0;
+    }
+    for (i = 0; i < ncomps; i++)
+        if (nislands[i] && allfull[i])
             anyfull = 1;
+
+    /* Any full group that isn't the whole set is an error: mark all
+     * its squares. */
+    for (x = 0; x < state->w; x++) {
+        for (y = 0; y < state->h; y++) {
+            int c = comp[DINDEX(x,y)];
+            if (nislands[c] && allfull[c] && nislands[c] != state->n_islands)
+                GRID(state,x,y) |= G_WARN;
+        }
     }
 
+    sfree(comp);
+    sfree(nislands);
+    sfree(allfull);
     *ngroups_r = ngroups;
     return anyfull;
 }
@@ -1291,7 +1298,7 @@ static void solve_join(struct island *is, int direction, int n, int is_max)
         d1 = DINDEX(is->x, is->y);
         d2 = DINDEX(is_orth->x, is_orth->y);
         if (dsf_canonify(dsf, d1) != dsf_canonify(dsf, d2))
-            dsf_merge(dsf, d1, d2);
+            dsf_merge_by_size(dsf, NULL, d1, d2);
     }
 }
 
@@ -1489,7 +1496,7 @@ static int solve_island_subgroup(struct island *is, int direction)
 
     /* Check group membership for is->dsf; if it's full return 1. */
     if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
-                        0, &nislands)) {
+                        &nislands)) {
         if (nislands < state->n_islands) {
             /* we have a full subgroup that isn't the whole set.
              * This isn't allowed. */
@@ -3243,6 +3250,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 /* vim: set shiftwidth=4 tabstop=8: */
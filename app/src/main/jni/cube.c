@@ -1791,4 +1791,5 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
@@ -1662,6 +1662,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 /* vim: set shiftwidth=4 :set textwidth=80: */
@@ -0,0 +1,229 @@
+/*
+ * drawbuf.c: record drawing primitives into a flat array of words,
+ * and play them back.
+ *
+ * The Android front end records a whole frame between start_draw and
+ * end_draw and passes it to Java in one call, where otherwise every
+ * rectangle and every piece of text would be a JNI call of its own
+ * (and text and polygons a Java object each as well). The format is
+ * described in puzzles.h; GameView.drawCommands is the other reader
+ * of it, so the two have to change together.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "puzzles.h"
+
+static int *drawbuf_extend(struct drawbuf *db, int n)
+{
+    int *ret;
+
+    if (db->len + n > db->size) {
+        db->size = (db->len + n) * 5 / 4 + 256;
+        db->words = sresize(db->words, db->size, int);
+    }
+    ret = db->words + db->len;
+    db->len += n;
+    return ret;
+}
+
+void drawbuf_free(struct drawbuf *db)
+{
+    sfree(db->words);
+    db->words = NULL;
+    db->len = db->size = 0;
+}
+
+void drawbuf_rect(struct drawbuf *db, int x, int y, int w, int h, int colour)
+{
+    int *p = drawbuf_extend(db, 6);
+
+    p[0] = DRAWBUF_RECT;
+    p[1] = x;
+    p[2] = y;
+    p[3] = w;
+    p[4] = h;
+    p[5] = colour;
+}
+
+void drawbuf_line(struct drawbuf *db, int x1, int y1, int x2, int y2,
+                  int colour)
+{
+    int *p = drawbuf_extend(db, 6);
+
+    p[0] = DRAWBUF_LINE;
+    p[1] = x1;
+    p[2] = y1;
+    p[3] = x2;
+    p[4] = y2;
+    p[5] = colour;
+}
+
+void drawbuf_polygon(struct drawbuf *db, const int *coords, int npoints,
+                     int ox, int oy, int fillcolour, int outlinecolour)
+{
+    int *p = drawbuf_extend(db, 4 + 2 * npoints);
+    int i;
+
+    p[0] = DRAWBUF_POLYGON;
+    p[1] = npoints;
+    p[2] = fillcolour;
+    p[3] = outlinecolour;
+    for (i = 0; i < npoints; i++) {
+        p[4 + 2*i] = coords[2*i] + ox;
+        p[5 + 2*i] = coords[2*i+1] + oy;
+    }
+}
+
+void drawbuf_circle(struct drawbuf *db, int cx, int cy, int radius,
+                    int fillcolour, int outlinecolour)
+{
+    int *p = drawbuf_extend(db, 6);
+
+    p[0] = DRAWBUF_CIRCLE;
+    p[1] = cx;
+    p[2] = cy;
+    p[3] = radius;
+    p[4] = fillcolour;
+    p[5] = outlinecolour;
+}
+
+void drawbuf_text(struct drawbuf *db, int x, int y, int fonttype,
+                  int fontsize, int align, int colour, const char *text)
+{
+    int len = strlen(text), nwords = (len + 3) / 4;
+    int *p = drawbuf_extend(db, 8 + nwords);
+
+    p[0] = DRAWBUF_TEXT;
+    p[1] = x;
+    p[2] = y;
+    p[3] = fonttype;
+    p[4] = fontsize;
+    p[5] = align;
+    p[6] = colour;
+    p[7] = len;
+    if (nwords > 0) {
+        p[7 + nwords] = 0;             /* the padding */
+        memcpy(p + 8, text, len);
+    }
+}
+
+void drawbuf_clip(struct drawbuf *db, int x, int y, int w, int h)
+{
+    int *p = drawbuf_extend(db, 5);
+
+    p[0] = DRAWBUF_CLIP;
+    p[1] = x;
+    p[2] = y;
+    p[3] = w;
+    p[4] = h;
+}
+
+void drawbuf_unclip(struct drawbuf *db, int ox, int oy)
+{
+    int *p = drawbuf_extend(db, 3);
+
+    p[0] = DRAWBUF_UNCLIP;
+    p[1] = ox;
+    p[2] = oy;
+}
+
+void drawbuf_update(struct drawbuf *db, int x, int y, int w, int h)
+{
+    int *p = drawbuf_extend(db, 5);
+
+    p[0] = DRAWBUF_UPDATE;
+    p[1] = x;
+    p[2] = y;
+    p[3] = w;
+    p[4] = h;
+}
+
+static void drawbuf_blitter(struct drawbuf *db, int op, int id, int x, int y)
+{
+    int *p = drawbuf_extend(db, 4);
+
+    p[0] = op;
+    p[1] = id;
+    p[2] = x;
+    p[3] = y;
+}
+
+void drawbuf_blitter_save(struct drawbuf *db, int id, int x, int y)
+{
+    drawbuf_blitter(db, DRAWBUF_BLITTER_SAVE, id, x, y);
+}
+
+void drawbuf_blitter_load(struct drawbuf *db, int id, int x, int y)
+{
+    drawbuf_blitter(db, DRAWBUF_BLITTER_LOAD, id, x, y);
+}
+
+void drawbuf_replay(const struct drawbuf *db, const drawing_api *api,
+                    void *handle, blitter **blitters)
+{
+    const int *p = db->words, *end = db->words + db->len;
+    char *text = NULL;
+    int textsize = 0;
+
+    while (p < end) {
+        switch (p[0]) {
+          case DRAWBUF_RECT:
+            api->draw_rect(handle, p[1], p[2], p[3], p[4], p[5]);
+            p += 6;
+            break;
+          case DRAWBUF_LINE:
+            api->draw_line(handle, p[1], p[2], p[3], p[4], p[5]);
+            p += 6;
+            break;
+          case DRAWBUF_POLYGON:
+            /* draw_polygon doesn't write to its coordinates */
+            api->draw_polygon(handle, (int *)p + 4, p[1], p[2], p[3]);
+            p += 4 + 2 * p[1];
+            break;
+          case DRAWBUF_CIRCLE:
+            api->draw_circle(handle, p[1], p[2], p[3], p[4], p[5]);
+            p += 6;
+            break;
+          case DRAWBUF_TEXT:
+            if (p[7] >= textsize) {
+                textsize = p[7] + 1;
+                text = sresize(text, textsize, char);
+            }
+            memcpy(text, p + 8, p[7]);
+            text[p[7]] = '\0';
+            api->draw_text(handle, p[1], p[2], p[3], p[4], p[5], p[6], text);
+            p += 8 + (p[7] + 3) / 4;
+            break;
+          case DRAWBUF_CLIP:
+            api->clip(handle, p[1], p[2], p[3], p[4]);
+            p += 5;
+            break;
+          case DRAWBUF_UNCLIP:
+            api->unclip(handle);
+            p += 3;
+            break;
+          case DRAWBUF_BLITTER_SAVE:
+            if (blitters)
+                api->blitter_save(handle, blitters[p[1]], p[2], p[3]);
+            p += 4;
+            break;
+          case DRAWBUF_BLITTER_LOAD:
+            if (blitters)
+                api->blitter_load(handle, blitters[p[1]], p[2], p[3]);
+            p += 4;
+            break;
+          case DRAWBUF_UPDATE:
+            if (api->draw_update)
+                api->draw_update(handle, p[1], p[2], p[3], p[4]);
+            p += 5;
+            break;
+          default:
+            assert(!"Unknown drawbuf command");
+            p = end;
+            break;
+        }
+    }
+    sfree(text);
+}
@@ -5,7 +5,10 @@
  * 
  * Mostly just looks up calls in a vtable and passes them through
  * unchanged. However, on the printing side it tracks print colours
- * so the front end API doesn't have to.
+ * so the front end API doesn't have to; and draw_updates are saved
+ * up until end_draw and merged, so that a front end which repaints
+ * each one separately isn't asked to repaint every tile of a big
+ * redraw on its own.
  * 
  * FIXME:
  * 
@@ -38,6 +41,21 @@ struct print_colour {
     float grey;
 };
 
+/*
+ * By default, two update rectangles are merged if the rectangle
+ * covering both repaints no more than a quarter as much again as
+ * they cover between them. Beyond MAX_UPDATES of them, the pairs that
+ * waste least are merged regardless: at end_draw, or early if there
+ * get to be several times that many (which would otherwise make that
+ * quadratic search slow).
+ */
+#define DEFAULT_UPDATE_TOLERANCE 0.25F
+#define MAX_UPDATES 16
+
+struct update_rect {
+    int x1, y1, x2, y2;		       /* x2, y2 exclusive */
+};
+
 struct drawing {
     const drawing_api *api;
     void *handle;
@@ -48,6 +66,9 @@ struct drawing {
      * this may set it to NULL. */
     midend *me;
     char *laststatus;
+    struct update_rect *updates;
+    int nupdates, updatesize;
+    float update_tolerance;
 };
 
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
@@ -60,11 +81,15 @@ drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
     dr->scale = 1.0F;
     dr->me = me;
     dr->laststatus = NULL;
+    dr->updates = NULL;
+    dr->nupdates = dr->updatesize = 0;
+    dr->update_tolerance = DEFAULT_UPDATE_TOLERANCE;
     return dr;
 }
 
 void drawing_free(drawing *dr)
 {
+    sfree(dr->updates);
     sfree(dr->laststatus);
     sfree(dr->colours);
     sfree(dr);
@@ -129,10 +154,128 @@ void draw_circle(drawing *dr, int cx, int cy, int radius,
 			 outlinecolour);
 }
 
+/*
+ * How much more the rectangle covering both a and b would repaint
+ * than a and b do between them, which goes in *covered.
+ */
+static double update_waste(const struct update_rect *a,
+                           const struct update_rect *b, double *covered)
+{
+    double both, overlap = 0;
+    int ix1 = max(a->x1, b->x1), iy1 = max(a->y1, b->y1);
+    int ix2 = min(a->x2, b->x2), iy2 = min(a->y2, b->y2);
+
+    if (ix1 < ix2 && iy1 < iy2)
+        overlap = (double)(ix2 - ix1) * (iy2 - iy1);
+    *covered = (double)(a->x2 - a->x1) * (a->y2 - a->y1) +
+        (double)(b->x2 - b->x1) * (b->y2 - b->y1) - overlap;
+    both = (double)(max(a->x2, b->x2) - min(a->x1, b->x1)) *
+        (max(a->y2, b->y2) - min(a->y1, b->y1));
+    return both - *covered;
+}
+
+static void update_merge(struct update_rect *a, const struct update_rect *b)
+{
+    a->x1 = min(a->x1, b->x1);
+    a->y1 = min(a->y1, b->y1);
+    a->x2 = max(a->x2, b->x2);
+    a->y2 = max(a->y2, b->y2);
+}
+
+/*
+ * Merge the least wasteful pairs of update rectangles until there are
+ * no more than `limit'.
+ */
+static void reduce_updates(drawing *dr, int limit)
+{
+    int i, j;
+
+    while (dr->nupdates > limit) {
+	double best = -1, waste, covered;
+	int bi = 0, bj = 1;
+
+	for (i = 0; i < dr->nupdates; i++)
+	    for (j = i + 1; j < dr->nupdates; j++) {
+		waste = update_waste(&dr->updates[i], &dr->updates[j], &covered);
+		if (best < 0 || waste < best) {
+		    best = waste;
+		    bi = i;
+		    bj = j;
+		}
+	    }
+	update_merge(&dr->updates[bi], &dr->updates[bj]);
+	dr->updates[bj] = dr->updates[--dr->nupdates];
+    }
+}
+
+/*
+ * Set how much extra area, as a proportion of what was actually
+ * updated, may be repainted in order to merge two update rectangles
+ * into one. 0 merges only where nothing is wasted (neighbouring
+ * tiles in a row, say); a negative tolerance turns merging off, and
+ * each draw_update goes straight through to the front end.
+ */
+void drawing_set_update_tolerance(drawing *dr, float tolerance)
+{
+    dr->update_tolerance = tolerance;
+}
+
 void draw_update(drawing *dr, int x, int y, int w, int h)
 {
-    if (dr->api->draw_update)
+    struct update_rect r;
+    int i;
+
+    if (!dr->api->draw_update || w <= 0 || h <= 0)
+	return;
+    if (dr->update_tolerance < 0) {
 	dr->api->draw_update(dr->handle, x, y, w, h);
+	return;
+    }
+
+    r.x1 = x;
+    r.y1 = y;
+    r.x2 = x + w;
+    r.y2 = y + h;
+
+    /*
+     * Merge the new rectangle into any it fits with well enough;
+     * since the result is bigger, it might now fit with some it
+     * didn't before, so start again each time.
+     */
+    for (i = 0; i < dr->nupdates; i++) {
+	struct update_rect *u = &dr->updates[i];
+	double covered;
+
+	if (u->x1 <= r.x1 && u->y1 <= r.y1 && u->x2 >= r.x2 && u->y2 >= r.y2)
+	    return;		       /* already covered */
+	if (update_waste(u, &r, &covered) <= dr->update_tolerance * covered) {
+	    update_merge(&r, u);
+	    dr->updates[i] = dr->updates[--dr->nupdates];
+	    i = -1;
+	}
+    }
+
+    if (dr->nupdates >= dr->updatesize) {
+	dr->updatesize = dr->nupdates * 3 / 2 + 16;
+	dr->updates = sresize(dr->updates, dr->updatesize, struct update_rect);
+    }
+    dr->updates[dr->nupdates++] = r;
+    if (dr->nupdates > 4 * MAX_UPDATES)
+	reduce_updates(dr, MAX_UPDATES);
+}
+
+/* Pass on the updates saved up since start_draw. */
+static void flush_updates(drawing *dr)
+{
+    int i;
+
+    reduce_updates(dr, MAX_UPDATES);
+    for (i = 0; i < dr->nupdates; i++) {
+	struct update_rect *u = &dr->updates[i];
+	dr->api->draw_update(dr->handle, u->x1, u->y1,
+			     u->x2 - u->x1, u->y2 - u->y1);
+    }
+    dr->nupdates = 0;
 }
 
 void clip(drawing *dr, int x, int y, int w, int h)
@@ -147,11 +290,13 @@ void unclip(drawing *dr)
 
 void start_draw(drawing *dr)
 {
+    dr->nupdates = 0;
     dr->api->start_draw(dr->handle);
 }
 
 void end_draw(drawing *dr)
 {
+    flush_updates(dr);
     dr->api->end_draw(dr->handle);
 }
 
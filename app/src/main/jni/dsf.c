@@ -99,6 +99,33 @@ int dsf_size(int *dsf, int index) {
     return dsf[dsf_canonify(dsf, index)] >> 2;
 }
 
+void dsf_flatten(int *dsf, int size, int *labels, int *sizes,
+                 int *ncomponents)
+{
+    int i, n = 0;
+
+    /*
+     * Canonifying each element in turn leaves every element pointing
+     * straight at its root, and visits each class first at its least
+     * element, so that's the order the classes get numbered in
+     * whichever element is the root. The label of a class is kept at
+     * its root until the loop reaches the root itself.
+     */
+    for (i = 0; i < size; i++)
+        labels[i] = -1;
+    for (i = 0; i < size; i++) {
+        int root = dsf_canonify(dsf, i);
+        if (labels[root] < 0) {
+            if (sizes)
+                sizes[n] = dsf[root] >> 2;
+            labels[root] = n++;
+        }
+        labels[i] = labels[root];
+    }
+    if (ncomponents)
+        *ncomponents = n;
+}
+
 int edsf_canonify(int *dsf, int index, int *inverse_return)
 {
     int start_index = index, canonical_index;
@@ -190,3 +217,57 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse)
 
 /*    fprintf(stderr, "dsf[%2d] = %2d\n", v2, dsf[v2]); */
 }
+
+/*
+ * Merging by size rather than by index. The representation is the
+ * same as above, so the other functions here work on the result;
+ * but the root of each class is now whichever of the two merged
+ * classes' roots had the larger class under it, which keeps every
+ * tree logarithmically shallow however the merges come. The price
+ * is that the canonical element is no longer the class's least
+ * element. A caller which needs that can keep it in a second array
+ * of the same size, initialised by dsf_init_mins, and get it back
+ * with dsf_minimum.
+ */
+void dsf_init_mins(int *mins, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) mins[i] = i;
+}
+
+int dsf_minimum(int *dsf, int *mins, int index)
+{
+    return mins[dsf_canonify(dsf, index)];
+}
+
+void dsf_merge_by_size(int *dsf, int *mins, int v1, int v2)
+{
+    edsf_merge_by_size(dsf, mins, v1, v2, FALSE);
+}
+
+void edsf_merge_by_size(int *dsf, int *mins, int v1, int v2, int inverse)
+{
+    int i1, i2;
+
+    v1 = edsf_canonify(dsf, v1, &i1);
+    inverse ^= i1;
+    v2 = edsf_canonify(dsf, v2, &i2);
+    inverse ^= i2;
+
+    if (v1 == v2) {
+        assert(!inverse);
+        return;
+    }
+
+    assert(inverse == 0 || inverse == 1);
+    if ((dsf[v1] >> 2) < (dsf[v2] >> 2)) {
+        int v3 = v1;
+        v1 = v2;
+        v2 = v3;
+    }
+    dsf[v1] += (dsf[v2] >> 2) << 2;
+    dsf[v2] = (v1 << 2) | !!inverse;
+    if (mins && mins[v2] < mins[v1])
+        mins[v1] = mins[v2];
+}
@@ -912,4 +912,5 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
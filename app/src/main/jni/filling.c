@@ -299,6 +299,7 @@ static const int dy[4] = {0, 0, -1, 1};
 struct solver_state
 {
     int *dsf;
+    int *mins;                         /* least square of each class */
     int *board;
     int *connected;
     int nempty;
@@ -410,16 +411,16 @@ static int rhofree(int *hop, int start) {
 }
 #endif
 
-static void merge(int *dsf, int *connected, int a, int b) {
+static void merge(int *dsf, int *mins, int *connected, int a, int b) {
     int c;
     assert(dsf);
     assert(connected);
     assert(rhofree(connected, a));
     assert(rhofree(connected, b));
-    a = dsf_canonify(dsf, a);
-    b = dsf_canonify(dsf, b);
+    a = dsf_minimum(dsf, mins, a);
+    b = dsf_minimum(dsf, mins, b);
     if (a == b) return;
-    dsf_merge(dsf, a, b);
+    dsf_merge_by_size(dsf, mins, a, b);
     c = connected[a];
     connected[a] = connected[b];
     connected[b] = c;
@@ -449,7 +450,7 @@ static void expand(struct solver_state *s, int w, int h, int t, int f) {
         const int idx = w*y + x;
         if (x < 0 || x >= w || y < 0 || y >= h) continue;
         if (s->board[idx] != s->board[t]) continue;
-        merge(s->dsf, s->connected, t, idx);
+        merge(s->dsf, s->mins, s->connected, t, idx);
     }
     --s->nempty;
 }
@@ -572,7 +573,7 @@ static void filled_square(struct solver_state *s, int w, int h, int i) {
 	const int idx = w*y + x;
 	if (x < 0 || x >= w || y < 0 || y >= h) continue;
 	if (s->board[i] == s->board[idx])
-	    merge(s->dsf, s->connected, i, idx);
+	    merge(s->dsf, s->mins, s->connected, i, idx);
     }
 }
 
@@ -649,7 +650,7 @@ static int learn_blocked_expansion(struct solver_state *s, int w, int h) {
         int j;
 
 	if (s->board[i] == EMPTY) continue;
-        j = dsf_canonify(s->dsf, i);
+        j = dsf_minimum(s->dsf, s->mins, i);
 
         /* (but only for each connected component) */
         if (i != j) continue;
@@ -739,7 +740,7 @@ static int learn_critical_square(struct solver_state *s, int w, int h) {
     for (i = 0; i < sz; ++i) {
 	int j;
 	if (s->board[i] == EMPTY) continue;
-	if (i != dsf_canonify(s->dsf, i)) continue;
+	if (i != dsf_minimum(s->dsf, s->mins, i)) continue;
 	if (dsf_size(s->dsf, i) == s->board[i]) continue;
 	assert(s->board[i] != 1);
 	/* for each empty square */
@@ -768,6 +769,8 @@ static int solver(const int *orig, int w, int h, char **solution) {
     struct solver_state ss;
     ss.board = memdup(orig, sz, sizeof (int));
     ss.dsf = snew_dsf(sz); /* eqv classes: connected components */
+    ss.mins = snewn(sz, int);
+    dsf_init_mins(ss.mins, sz);
     ss.connected = snewn(sz, int); /* connected[n] := n.next; */
     /* cyclic disjoint singly linked lists, same partitioning as dsf.
      * The lists lets you iterate over a partition given any member */
@@ -797,6 +800,7 @@ static int solver(const int *orig, int w, int h, char **solution) {
     }
 
     sfree(ss.dsf);
+    sfree(ss.mins);
     sfree(ss.board);
     sfree(ss.connected);
 
@@ -837,10 +841,18 @@ static int filled(int *board, int *randomize, int k, int n) {
 }
 */
 
-static int *g_board;
+/*
+ * Sort positions by decreasing board value. The value travels with
+ * each position rather than through a global, so that generation is
+ * re-entrant; qsort makes the same comparisons either way, so the
+ * resulting order (and hence the puzzle) is unchanged.
+ */
+struct valued_pos {
+    int value, pos;
+};
 static int compare(const void *pa, const void *pb) {
-    if (!g_board) return 0;
-    return g_board[*(const int *)pb] - g_board[*(const int *)pa];
+    return ((const struct valued_pos *)pb)->value -
+        ((const struct valued_pos *)pa)->value;
 }
 
 static void minimize_clue_set(int *board, int w, int h, int *randomize) {
@@ -885,8 +897,17 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     }
 
     make_board(board, w, h, rs);
-    g_board = board;
-    qsort(randomize, sz, sizeof (int), compare);
+    {
+        struct valued_pos *vp = snewn(sz, struct valued_pos);
+        for (i = 0; i < sz; ++i) {
+            vp[i].value = board[randomize[i]];
+            vp[i].pos = randomize[i];
+        }
+        qsort(vp, sz, sizeof (struct valued_pos), compare);
+        for (i = 0; i < sz; ++i)
+            randomize[i] = vp[i].pos;
+        sfree(vp);
+    }
     minimize_clue_set(board, w, h, randomize);
 
     for (i = 0; i < sz; ++i) {
@@ -1053,6 +1074,7 @@ struct game_drawstate {
     int started;
     int *v, *flags;
     int *dsf_scratch, *border_scratch;
+    int *label_scratch, *size_scratch; /* flattened dsf_scratch */
 };
 
 static char *interpret_move(const game_state *state, game_ui *ui,
@@ -1197,9 +1219,13 @@ static game_state *execute_move(const game_state *state, const char *move)
         const int h = new_state->shared->params.h;
         const int sz = w * h;
         int *dsf = make_dsf(NULL, new_state->board, w, h);
+        int *labels = snewn(sz, int), *sizes = snewn(sz, int);
         int i;
-        for (i = 0; i < sz && new_state->board[i] == dsf_size(dsf, i); ++i);
+        dsf_flatten(dsf, sz, labels, sizes, NULL);
+        for (i = 0; i < sz && new_state->board[i] == sizes[labels[i]]; ++i);
         sfree(dsf);
+        sfree(labels);
+        sfree(sizes);
         if (i == sz)
             new_state->completed = TRUE;
     }
@@ -1290,6 +1316,8 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
 	ds->v[i] = ds->flags[i] = -1;
     ds->border_scratch = snewn(ds->params.w * ds->params.h, int);
     ds->dsf_scratch = NULL;
+    ds->label_scratch = snewn(ds->params.w * ds->params.h, int);
+    ds->size_scratch = snewn(ds->params.w * ds->params.h, int);
 
     return ds;
 }
@@ -1300,6 +1328,8 @@ static void game_free_drawstate(drawing *dr, game_drawstate *ds)
     sfree(ds->flags);
     sfree(ds->border_scratch);
     sfree(ds->dsf_scratch);
+    sfree(ds->label_scratch);
+    sfree(ds->size_scratch);
     sfree(ds);
 }
 
@@ -1458,6 +1488,8 @@ static void draw_grid(drawing *dr, game_drawstate *ds, const game_state *state,
      * highlights and hints.
      */
     ds->dsf_scratch = make_dsf(ds->dsf_scratch, state->board, w, h);
+    dsf_flatten(ds->dsf_scratch, w*h, ds->label_scratch, ds->size_scratch,
+                NULL);
 
     /*
      * Work out where we're putting borders between the cells.
@@ -1480,8 +1512,8 @@ static void draw_grid(drawing *dr, game_drawstate *ds, const game_state *state,
 
                 v1 = state->board[y*w+x];
                 v2 = state->board[(y+dy)*w+(x+dx)];
-                s1 = dsf_size(ds->dsf_scratch, y*w+x);
-                s2 = dsf_size(ds->dsf_scratch, (y+dy)*w+(x+dx));
+                s1 = ds->size_scratch[ds->label_scratch[y*w+x]];
+                s2 = ds->size_scratch[ds->label_scratch[(y+dy)*w+(x+dx)]];
 
                 /*
                  * We only ever draw a border between two cells if
@@ -1527,16 +1559,16 @@ static void draw_grid(drawing *dr, game_drawstate *ds, const game_state *state,
             } else if (ui && ui->sel && ui->sel[i]) {
                 flags |= HIGH_BG;
             } else if (v) {
-                int size = dsf_size(ds->dsf_scratch, i);
+                int size = ds->size_scratch[ds->label_scratch[i]];
                 if (size == v)
                     flags |= CORRECT_BG;
                 else if (size > v)
                     flags |= ERROR_BG;
 		else {
-		    int rt = dsf_canonify(ds->dsf_scratch, i), j;
+		    int rt = ds->label_scratch[i], j;
 		    for (j = 0; j < w*h; ++j) {
 			int k;
-			if (dsf_canonify(ds->dsf_scratch, j) != rt) continue;
+			if (ds->label_scratch[j] != rt) continue;
 			for (k = 0; k < 4; ++k) {
 			    const int xx = j % w + dx[k], yy = j / w + dy[k];
 			    if (xx >= 0 && xx < w && yy >= 0 && yy < h &&
@@ -1773,6 +1805,7 @@ const struct game thegame = {
     FALSE,				   /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_NUMPAD,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER /* solver? hah! */
@@ -379,9 +379,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             tree234 *pick, *cov, *osize;
             int limit;
 
-            pick = newtree234(sqcmp_pick);
-            cov = newtree234(sqcmp_cov);
-            osize = newtree234(sqcmp_osize);
+            pick = newpooltree234(sqcmp_pick);
+            cov = newpooltree234(sqcmp_cov);
+            osize = newpooltree234(sqcmp_osize);
 
             memset(matrix, 0, wh * wh);
             for (i = 0; i < wh; i++) {
@@ -490,7 +490,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
              */
             {
                 struct sq *sq;
-                while ((sq = delpos234(pick, 0)) != NULL)
+                iter234 it;
+                for (sq = first234(pick, &it); sq; sq = next234(&it))
                     sfree(sq);
             }
             freetree234(pick);
@@ -1332,4 +1333,5 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
@@ -1248,12 +1248,20 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     for (i = 0; i < sz; i++) scratch[i] = i;
 
 generate:
+    if (random_cancelled(rs)) {
+        free_game(state);
+        sfree(scratch);
+        return NULL;
+    }
     clear_game(state, 1);
     ntries++;
+    PROFILE_COUNT("galaxies.boards");
 
     /* generate_pass(state, rs, scratch, 10, GP_DOTS); */
     /* generate_pass(state, rs, scratch, 100, 0); */
+    PROFILE_BEGIN("galaxies.generate_pass");
     generate_pass(state, rs, scratch, 100, GP_DOTS);
+    PROFILE_END("galaxies.generate_pass");
 
     game_update_dots(state);
 
@@ -1274,7 +1282,9 @@ generate:
     copy = dup_game(state);
     clear_game(copy, 0);
     dbg_state(copy);
+    PROFILE_BEGIN("galaxies.solve");
     diff = solver_state(copy, params->diff);
+    PROFILE_END("galaxies.solve");
     free_game(copy);
 
     assert(diff != DIFF_IMPOSSIBLE);
@@ -1285,7 +1295,10 @@ generate:
          * couldn't handle at all).
          */
         if (diff > params->diff ||
-            ntries < MAXTRIES) goto generate;
+            ntries < MAXTRIES) {
+            PROFILE_COUNT("galaxies.wrong_difficulty");
+            goto generate;
+        }
     }
 
 #ifdef STANDALONE_PICTURE_GENERATOR
@@ -2626,7 +2639,7 @@ static char *interpret_move(const game_state *state, game_ui *ui,
 static int check_complete(const game_state *state, int *dsf, int *colours)
 {
     int w = state->w, h = state->h;
-    int x, y, i, ret;
+    int x, y, i, ret, ncomps, *comp;
 
     int free_dsf;
     struct sqdata {
@@ -2652,9 +2665,9 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
     for (y = 0; y < h; y++)
         for (x = 0; x < w; x++) {
             if (y+1 < h && !(SPACE(state, 2*x+1, 2*y+2).flags & F_EDGE_SET))
-                dsf_merge(dsf, y*w+x, (y+1)*w+x);
+                dsf_merge_by_size(dsf, NULL, y*w+x, (y+1)*w+x);
             if (x+1 < w && !(SPACE(state, 2*x+2, 2*y+1).flags & F_EDGE_SET))
-                dsf_merge(dsf, y*w+x, y*w+(x+1));
+                dsf_merge_by_size(dsf, NULL, y*w+x, y*w+(x+1));
         }
 
     /*
@@ -2674,8 +2687,10 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
      * First, go through the grid finding the bounding box of each
      * component.
      */
-    sqdata = snewn(w*h, struct sqdata);
-    for (i = 0; i < w*h; i++) {
+    comp = snewn(w*h, int);
+    dsf_flatten(dsf, w*h, comp, NULL, &ncomps);
+    sqdata = snewn(ncomps, struct sqdata);
+    for (i = 0; i < ncomps; i++) {
         sqdata[i].minx = w+1;
         sqdata[i].miny = h+1;
         sqdata[i].maxx = sqdata[i].maxy = -1;
@@ -2683,7 +2698,7 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
     }
     for (y = 0; y < h; y++)
         for (x = 0; x < w; x++) {
-            i = dsf_canonify(dsf, y*w+x);
+            i = comp[y*w+x];
             if (sqdata[i].minx > x)
                 sqdata[i].minx = x;
             if (sqdata[i].maxx < x)
@@ -2700,17 +2715,17 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
      * and figure out where its centre of symmetry has to be if
      * it's anywhere.
      */
-    for (i = 0; i < w*h; i++)
+    for (i = 0; i < ncomps; i++)
         if (sqdata[i].valid) {
             int cx, cy;
             cx = sqdata[i].cx = sqdata[i].minx + sqdata[i].maxx + 1;
             cy = sqdata[i].cy = sqdata[i].miny + sqdata[i].maxy + 1;
             if (!(SPACE(state, sqdata[i].cx, sqdata[i].cy).flags & F_DOT))
                 sqdata[i].valid = FALSE;   /* no dot at centre of symmetry */
-            if (dsf_canonify(dsf, (cy-1)/2*w+(cx-1)/2) != i ||
-                dsf_canonify(dsf, (cy)/2*w+(cx-1)/2) != i ||
-                dsf_canonify(dsf, (cy-1)/2*w+(cx)/2) != i ||
-                dsf_canonify(dsf, (cy)/2*w+(cx)/2) != i)
+            if (comp[(cy-1)/2*w+(cx-1)/2] != i ||
+                comp[(cy)/2*w+(cx-1)/2] != i ||
+                comp[(cy-1)/2*w+(cx)/2] != i ||
+                comp[(cy)/2*w+(cx)/2] != i)
                 sqdata[i].valid = FALSE;   /* dot at cx,cy isn't ours */
             if (SPACE(state, sqdata[i].cx, sqdata[i].cy).flags & F_DOT_BLACK)
                 sqdata[i].colour = 2;
@@ -2739,7 +2754,7 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
                 int cx, cy;
                 for (cy = (y-1) >> 1; cy <= y >> 1; cy++)
                     for (cx = (x-1) >> 1; cx <= x >> 1; cx++) {
-                        i = dsf_canonify(dsf, cy*w+cx);
+                        i = comp[cy*w+cx];
                         if (x != sqdata[i].cx || y != sqdata[i].cy)
                             sqdata[i].valid = FALSE;
                     }
@@ -2753,8 +2768,8 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
                 int cx1 = (x-1) >> 1, cx2 = x >> 1;
                 int cy1 = (y-1) >> 1, cy2 = y >> 1;
                 assert((cx1==cx2) ^ (cy1==cy2));
-                i = dsf_canonify(dsf, cy1*w+cx1);
-                if (i == dsf_canonify(dsf, cy2*w+cx2))
+                i = comp[cy1*w+cx1];
+                if (i == comp[cy2*w+cx2])
                     sqdata[i].valid = FALSE;
             }
         }
@@ -2769,11 +2784,11 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
         for (x = 0; x < w; x++) {
             int x2, y2;
 
-            i = dsf_canonify(dsf, y*w+x);
+            i = comp[y*w+x];
 
             x2 = sqdata[i].cx - 1 - x;
             y2 = sqdata[i].cy - 1 - y;
-            if (i != dsf_canonify(dsf, y2*w+x2))
+            if (i != comp[y2*w+x2])
                 sqdata[i].valid = FALSE;
         }
 
@@ -2786,7 +2801,7 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
      */
     ret = TRUE;
     for (i = 0; i < w*h; i++) {
-        int ci = dsf_canonify(dsf, i);
+        int ci = comp[i];
         int thisok = sqdata[ci].valid;
         if (colours)
             colours[i] = thisok ? sqdata[ci].colour : 0;
@@ -2794,6 +2809,7 @@ static int check_complete(const game_state *state, int *dsf, int *colours)
     }
 
     sfree(sqdata);
+    sfree(comp);
     if (free_dsf)
 	sfree(dsf);
 
@@ -3605,6 +3621,7 @@ const struct game thegame = {
 #endif
     FALSE, game_timing_state,
     REQUIRE_RBUTTON,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -789,6 +789,12 @@ done
     soln = snewn(a, digit);
 
     while (1) {
+	if (random_cancelled(rs)) {
+	    desc = NULL;
+	    goto cleanup;
+	}
+	PROFILE_COUNT("keen.grids");
+
 	/*
 	 * First construct a latin square to be the solution.
 	 */
@@ -1072,14 +1078,22 @@ done
 	 */
 	if (diff > 0) {
 	    memset(soln, 0, a);
+	    PROFILE_BEGIN("keen.solve");
 	    ret = solver(w, dsf, clues, soln, diff-1);
-	    if (ret <= diff-1)
+	    PROFILE_END("keen.solve");
+	    if (ret <= diff-1) {
+		PROFILE_COUNT("keen.too_easy");
 		continue;
+	    }
 	}
 	memset(soln, 0, a);
+	PROFILE_BEGIN("keen.solve");
 	ret = solver(w, dsf, clues, soln, diff);
-	if (ret != diff)
+	PROFILE_END("keen.solve");
+	if (ret != diff) {
+	    PROFILE_COUNT("keen.too_hard");
 	    continue;		       /* go round again */
+	}
 
 	/*
 	 * I wondered if at this point it would be worth trying to
@@ -1130,6 +1144,7 @@ done
 	(*aux)[i+1] = '0' + soln[i];
     (*aux)[a+1] = '\0';
 
+  cleanup:
     sfree(grid);
     sfree(order);
     sfree(revorder);
@@ -2377,6 +2392,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
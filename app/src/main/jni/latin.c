@@ -1091,7 +1091,7 @@ void latin_debug(digit *sq, int o)
  * Generation.
  */
 
-digit *latin_generate(int o, random_state *rs)
+digit *latin_generate_alg(int o, random_state *rs, int alg)
 {
     digit *sq;
     int *edges, *backedges, *capacity, *flow;
@@ -1114,6 +1114,7 @@ digit *latin_generate(int o, random_state *rs)
      * support functions in maxflow.c.
      */
 
+    PROFILE_BEGIN("latin.generate");
     sq = snewn(o*o, digit);
 
     /*
@@ -1199,8 +1200,8 @@ digit *latin_generate(int o, random_state *rs)
 	/*
 	 * Run maxflow.
 	 */
-	j = maxflow_with_scratch(scratch, o*2+2, 2*o, 2*o+1, ne,
-				 edges, backedges, capacity, flow, NULL);
+	j = maxflow_with_scratch_alg(alg, scratch, o*2+2, 2*o, 2*o+1, ne,
+				     edges, backedges, capacity, flow, NULL);
 	assert(j == o);   /* by the above theorem, this must have succeeded */
 
 	/*
@@ -1229,6 +1230,7 @@ digit *latin_generate(int o, random_state *rs)
     sfree(num);
     sfree(col);
     sfree(row);
+    PROFILE_END("latin.generate");
 
     /*
      * ... and return our completed latin square.
@@ -1236,6 +1238,11 @@ digit *latin_generate(int o, random_state *rs)
     return sq;
 }
 
+digit *latin_generate(int o, random_state *rs)
+{
+    return latin_generate_alg(o, rs, MAXFLOW_EDMONDS_KARP);
+}
+
 digit *latin_generate_rect(int w, int h, random_state *rs)
 {
     int o = max(w, h), x, y;
@@ -112,6 +112,10 @@ void latin_solver_debug(unsigned char *cube, int o);
 
 digit *latin_generate(int o, random_state *rs);
 
+/* The same with a choice of maxflow algorithm (MAXFLOW_* from
+ * maxflow.h); latin_generate uses Edmonds-Karp. */
+digit *latin_generate_alg(int o, random_state *rs, int alg);
+
 /* The order of the latin rectangle is max(w,h). */
 digit *latin_generate_rect(int w, int h, random_state *rs);
 
@@ -643,21 +643,37 @@ static game_params *custom_params(const config_item *cfg)
     return ret;
 }
 
+/*
+ * validate_params hands back messages the caller doesn't free, so
+ * ours are constant strings, one for each size limit in GRIDLIST.
+ */
+static char const *const amin_errors[] = {
+    NULL,
+    "Width and height for this grid type must both be at least 1",
+    "Width and height for this grid type must both be at least 2",
+    "Width and height for this grid type must both be at least 3",
+};
+static char const *const omin_errors[] = {
+    NULL, NULL,
+    "At least one of width and height for this grid type must be at least 2",
+    "At least one of width and height for this grid type must be at least 3",
+    "At least one of width and height for this grid type must be at least 4",
+};
+/* _("Width and height for this grid type must both be at least 1"), _("Width and height for this grid type must both be at least 2"), _("Width and height for this grid type must both be at least 3"), _("At least one of width and height for this grid type must be at least 2"), _("At least one of width and height for this grid type must be at least 3"), _("At least one of width and height for this grid type must be at least 4") */
+
 static char *validate_params(const game_params *params, int full)
 {
-    static char err[128];
-    int l = grid_size_limits[params->type].amin;
+    int l;
     if (params->type < 0 || params->type >= NUM_GRID_TYPES)
         return _("Illegal grid type");
-    if (params->w < l || params->h < l) {
-        sprintf(err, _("Width and height for this grid type must both be at least %d"), l);
-        return err;
-    }
+    l = grid_size_limits[params->type].amin;
+    assert(l < lenof(amin_errors) && amin_errors[l]);
+    if (params->w < l || params->h < l)
+        return (char *)_(amin_errors[l]);
     l = grid_size_limits[params->type].omin;
-    if (params->w < l && params->h < l) {
-        sprintf(err, _("At least one of width and height for this grid type must be at least %d"), l);
-        return err;
-    }
+    assert(l < lenof(omin_errors) && omin_errors[l]);
+    if (params->w < l && params->h < l)
+        return (char *)_(omin_errors[l]);
 
     /*
      * This shouldn't be able to happen at all, since decode_params
@@ -1206,7 +1222,7 @@ static int merge_dots(solver_state *sstate, int edge_index)
         return TRUE;
     } else {
         len = sstate->looplen[i] + sstate->looplen[j];
-        dsf_merge(sstate->dotdsf, i, j);
+        dsf_merge_by_size(sstate->dotdsf, NULL, i, j);
         i = dsf_canonify(sstate->dotdsf, i);
         sstate->looplen[i] = len;
         return FALSE;
@@ -1232,7 +1248,7 @@ static int merge_lines(solver_state *sstate, int i, int j, int inverse
     j = edsf_canonify(sstate->linedsf, j, &inv_tmp);
     inverse ^= inv_tmp;
 
-    edsf_merge(sstate->linedsf, i, j, inverse);
+    edsf_merge_by_size(sstate->linedsf, NULL, i, j, inverse);
 
 #ifdef SHOW_WORKING
     if (i != j) {
@@ -1377,8 +1393,10 @@ static int game_has_unique_soln(const game_state *state, int diff)
 {
     int ret;
     solver_state *sstate_new;
-    solver_state *sstate = new_solver_state((game_state *)state, diff);
+    solver_state *sstate;
 
+    PROFILE_BEGIN("loopy.solve");
+    sstate = new_solver_state((game_state *)state, diff);
     sstate_new = solve_game_rec(sstate);
 
     assert(sstate_new->solver_status != SOLVER_MISTAKE);
@@ -1386,6 +1404,7 @@ static int game_has_unique_soln(const game_state *state, int diff)
 
     free_solver_state(sstate_new);
     free_solver_state(sstate);
+    PROFILE_END("loopy.solve");
 
     return ret;
 }
@@ -1409,6 +1428,7 @@ static game_state *remove_clues(game_state *state, random_state *rs,
         face_list[n] = n;
     }
 
+    PROFILE_BEGIN("loopy.remove_clues");
     shuffle(face_list, num_faces, sizeof(int), rs);
 
     for (n = 0; n < num_faces; ++n) {
@@ -1423,6 +1443,7 @@ static game_state *remove_clues(game_state *state, random_state *rs,
         }
     }
     sfree(face_list);
+    PROFILE_END("loopy.remove_clues");
 
     return ret;
 }
@@ -1448,6 +1469,13 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 
     newboard_please:
 
+    if (random_cancelled(rs)) {
+        free_game(state);
+        sfree(grid_desc);
+        return NULL;
+    }
+
+    PROFILE_COUNT("loopy.boards");
     memset(state->lines, LINE_UNKNOWN, g->num_edges);
     memset(state->line_errors, 0, g->num_edges);
 
@@ -1457,7 +1485,14 @@ static char *new_game_desc(const game_params *params, random_state *rs,
      * can loop for ever if the params are suitably unfavourable, but
      * preventing games smaller than 4x4 seems to stop this happening */
     do {
+        if (random_cancelled(rs)) {
+            free_game(state);
+            sfree(grid_desc);
+            return NULL;
+        }
+        PROFILE_BEGIN("loopy.loopgen");
         add_full_clues(state, rs);
+        PROFILE_END("loopy.loopgen");
     } while (!game_has_unique_soln(state, params->diff));
 
     state_new = remove_clues(state, rs, params->diff);
@@ -1469,6 +1504,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 #ifdef SHOW_WORKING
         fprintf(stderr, "Rejecting board, it is too easy\n");
 #endif
+        PROFILE_COUNT("loopy.too_easy");
         goto newboard_please;
     }
 
@@ -3613,6 +3649,7 @@ const struct game thegame = {
     FALSE /* wants_statusbar */,
     FALSE, game_timing_state,
     0,                                       /* mouse_priorities */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -4,8 +4,59 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
 #include "puzzles.h"
 
+/*
+ * Optional accounting of the heap in use through these wrappers, for
+ * benchmarks. It costs one flag test per call while switched off.
+ * Blocks are counted by their usable size, and may have been
+ * allocated before counting started, so `heap_current' can go
+ * negative; the peak is relative to the last malloc_stats_reset().
+ * We also count the number of blocks allocated.
+ */
+static int heap_counting = FALSE;
+static long heap_current = 0, heap_peak = 0, heap_allocs = 0;
+
+static void heap_count(long delta)
+{
+    long now = __atomic_add_fetch(&heap_current, delta, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&heap_peak, &peak, now, TRUE,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void malloc_stats_enable(int enable)
+{
+    __atomic_store_n(&heap_counting, enable, __ATOMIC_RELAXED);
+}
+
+void malloc_stats_reset(void)
+{
+    __atomic_store_n(&heap_current, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&heap_peak, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&heap_allocs, 0, __ATOMIC_RELAXED);
+}
+
+long malloc_stats_peak(void)
+{
+    return __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+}
+
+long malloc_stats_current(void)
+{
+    return __atomic_load_n(&heap_current, __ATOMIC_RELAXED);
+}
+
+long malloc_stats_allocs(void)
+{
+    return __atomic_load_n(&heap_allocs, __ATOMIC_RELAXED);
+}
+
+#define COUNTING() __atomic_load_n(&heap_counting, __ATOMIC_RELAXED)
+
 /*
  * smalloc should guarantee to return a useful pointer - Halibut
  * can do nothing except die when it's out of memory anyway.
@@ -15,6 +66,10 @@ void *smalloc(size_t size) {
     p = malloc(size);
     if (!p)
 	fatal("out of memory");
+    if (COUNTING()) {
+        heap_count((long)malloc_usable_size(p));
+        __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    }
     return p;
 }
 
@@ -23,6 +78,8 @@ void *smalloc(size_t size) {
  */
 void sfree(void *p) {
     if (p) {
+        if (COUNTING())
+            heap_count(-(long)malloc_usable_size(p));
 	free(p);
     }
 }
@@ -32,13 +89,22 @@ void sfree(void *p) {
  */
 void *srealloc(void *p, size_t size) {
     void *q;
+    long before = 0;
+    int counting = COUNTING();
     if (p) {
+        if (counting)
+            before = (long)malloc_usable_size(p);
 	q = realloc(p, size);
     } else {
 	q = malloc(size);
     }
     if (!q)
 	fatal("out of memory");
+    if (counting) {
+        heap_count((long)malloc_usable_size(q) - before);
+        if (!p)
+            __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    }
     return q;
 }
 
@@ -1437,10 +1437,20 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 
     while (1) {
 
+        if (random_cancelled(rs)) {
+            sfree(*aux);
+            *aux = NULL;
+            ret = NULL;
+            goto cleanup;
+        }
+        PROFILE_COUNT("map.maps");
+
         /*
          * Create the map.
          */
+        PROFILE_BEGIN("map.genmap");
         genmap(w, h, n, map, rs);
+        PROFILE_END("map.genmap");
 
 #ifdef GENERATION_DIAGNOSTICS
         for (y = 0; y < h; y++) {
@@ -1472,7 +1482,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
         /*
          * Colour the map.
          */
+        PROFILE_BEGIN("map.fourcolour");
         fourcolour(graph, n, ngraph, colouring, rs);
+        PROFILE_END("map.fourcolour");
 
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < n; i++)
@@ -1531,6 +1543,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             if (cfreq[i] == 0)
                 continue;
 
+        PROFILE_BEGIN("map.remove_clues");
         shuffle(regions, n, sizeof(*regions), rs);
 
         if (sc) free_scratch(sc);
@@ -1544,14 +1557,17 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 
             memcpy(colouring2, colouring, n*sizeof(int));
             colouring2[j] = -1;
+            PROFILE_BEGIN("map.solve");
             solveret = map_solver(sc, graph, n, ngraph, colouring2,
 				  params->diff);
+            PROFILE_END("map.solve");
             assert(solveret >= 0);	       /* mustn't be impossible! */
             if (solveret == 1) {
                 cfreq[colouring[j]]--;
                 colouring[j] = -1;
             }
         }
+        PROFILE_END("map.remove_clues");
 
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < n; i++)
@@ -1585,6 +1601,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 		if (tries-- <= 0)
 		    mindiff = 0;       /* give up and go for Easy */
 	    }
+            PROFILE_COUNT("map.too_easy");
             continue;
 	}
 
@@ -1697,7 +1714,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 	assert(retlen < retsize);
     }
 
-    free_scratch(sc);
+  cleanup:
+    if (sc) free_scratch(sc);
     sfree(regions);
     sfree(colouring2);
     sfree(colouring);
@@ -1711,7 +1729,7 @@ static char *parse_edge_list(const game_params *params, const char **desc,
                              int *map)
 {
     int w = params->w, h = params->h, wh = w*h, n = params->n;
-    int i, k, pos, state;
+    int k, pos, state;
     const char *p = *desc;
 
     dsf_init(map+wh, wh);
@@ -1767,15 +1785,7 @@ static char *parse_edge_list(const game_params *params, const char **desc,
     /*
      * Now go through again and allocate region numbers.
      */
-    pos = 0;
-    for (i = 0; i < wh; i++)
-	map[i] = -1;
-    for (i = 0; i < wh; i++) {
-	k = dsf_canonify(map+wh, i);
-	if (map[k] < 0)
-	    map[k] = pos++;
-	map[i] = map[k];
-    }
+    dsf_flatten(map+wh, wh, map, NULL, &pos);
     if (pos != n)
 	return _("Edge list defines the wrong number of regions");
 
@@ -3295,6 +3305,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -8,6 +8,14 @@
  * that should be, but it's claimed on the Internet that it's been
  * proved, and that's good enough for me. I prefer BFS to DFS
  * anyway :-)
+ *
+ * There's also Dinic's algorithm, which does the BFS once per
+ * _length_ of shortest path rather than once per path: it labels
+ * each vertex with its distance from the source, and then pushes
+ * flow along every shortest path it can find by DFS over the edges
+ * that go one step further from the source, before doing the BFS
+ * again. It gives a different (but equally maximal) flow, so it has
+ * to be asked for: see maxflow_alg.
  */
 
 #include <assert.h>
@@ -18,21 +26,16 @@
 
 #include "puzzles.h"		       /* for snewn/sfree */
 
-int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
-			 int ne, const int *edges, const int *backedges,
-			 const int *capacity, int *flow, int *cut)
+/*
+ * Scan the edges and backedges arrays to find the index of the
+ * first edge from, and to, each node. Shared by both algorithms.
+ */
+static void maxflow_index_edges(int nv, int ne, const int *edges,
+				const int *backedges,
+				int *firstedge, int *firstbackedge)
 {
-    int *todo = (int *)scratch;
-    int *prev = todo + nv;
-    int *firstedge = todo + 2*nv;
-    int *firstbackedge = todo + 3*nv;
-    int i, j, head, tail, from, to;
-    int totalflow;
+    int i, j;
 
-    /*
-     * Scan the edges array to find the index of the first edge
-     * from each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*i])
@@ -41,10 +44,6 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 	firstedge[j++] = ne;
     assert(j == nv);
 
-    /*
-     * Scan the backedges array to find the index of the first edge
-     * _to_ each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*backedges[i]+1])
@@ -52,6 +51,36 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     while (j < nv)
 	firstbackedge[j++] = ne;
     assert(j == nv);
+}
+
+/*
+ * The spare capacity of an edge of the residual network, given as in
+ * the `prev' array below: 2*i for edge i followed forwards, 2*i+1
+ * for it followed backwards. -1 means unlimited.
+ */
+static int maxflow_spare(int e, const int *capacity, const int *flow)
+{
+    if (e & 1)
+	return flow[e / 2];	       /* backward edge */
+    else if (capacity[e / 2] >= 0)
+	return capacity[e / 2] - flow[e / 2];   /* forward edge */
+    else
+	return -1;		       /* unlimited forward edge */
+}
+
+static int maxflow_edmonds_karp(void *scratch, int nv, int source, int sink,
+				int ne, const int *edges,
+				const int *backedges, const int *capacity,
+				int *flow, int *cut)
+{
+    int *todo = (int *)scratch;
+    int *prev = todo + nv;
+    int *firstedge = todo + 2*nv;
+    int *firstbackedge = todo + 3*nv;
+    int i, j, head, tail, from, to;
+    int totalflow;
+
+    maxflow_index_edges(nv, ne, edges, backedges, firstedge, firstbackedge);
 
     /*
      * Start the flow off at zero on every edge.
@@ -147,12 +176,7 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 		/*
 		 * Determine the spare capacity of this edge.
 		 */
-		if (i & 1)
-		    spare = flow[i / 2];   /* backward edge */
-		else if (capacity[i / 2] >= 0)
-		    spare = capacity[i / 2] - flow[i / 2];   /* forward edge */
-		else
-		    spare = -1;	       /* unlimited forward edge */
+		spare = maxflow_spare(i, capacity, flow);
 
 		assert(spare != 0);
 
@@ -218,9 +242,183 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     }
 }
 
+static int maxflow_dinic(void *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *capacity, int *flow, int *cut)
+{
+    int *todo = (int *)scratch;
+    int *level = todo + nv;
+    int *firstedge = todo + 2*nv;
+    int *firstbackedge = todo + 3*nv;
+    int *nextedge = todo + 4*nv;
+    int *nextbackedge = todo + 5*nv;
+    int *path = todo + 6*nv;
+    int i, j, head, tail, from, to, depth;
+    int totalflow;
+
+    maxflow_index_edges(nv, ne, edges, backedges, firstedge, firstbackedge);
+
+    for (i = 0; i < ne; i++)
+	flow[i] = 0;
+    totalflow = 0;
+
+    while (1) {
+	/*
+	 * Label every vertex with its distance from the source in the
+	 * residual network, or -1 if it can't be reached. We can stop
+	 * at the sink's distance, since no shortest path goes
+	 * further.
+	 */
+	for (i = 0; i < nv; i++)
+	    level[i] = -1;
+	head = tail = 0;
+	todo[tail++] = source;
+	level[source] = 0;
+	while (head < tail) {
+	    from = todo[head++];
+	    if (level[sink] >= 0 && level[from] >= level[sink])
+		break;
+	    for (i = firstedge[from]; i < ne && edges[2*i] == from; i++) {
+		to = edges[2*i+1];
+		if (level[to] < 0 && maxflow_spare(2*i, capacity, flow)) {
+		    level[to] = level[from] + 1;
+		    todo[tail++] = to;
+		}
+	    }
+	    for (i = firstbackedge[from];
+		 i < ne && edges[2*(j = backedges[i])+1] == from; i++) {
+		to = edges[2*j];
+		if (level[to] < 0 && flow[j] > 0) {
+		    level[to] = level[from] + 1;
+		    todo[tail++] = to;
+		}
+	    }
+	}
+
+	if (level[sink] < 0) {
+	    /*
+	     * No augmenting path, so we're done; the vertices we
+	     * reached are the source side of the cut.
+	     */
+	    if (cut) {
+		for (i = 0; i < nv; i++)
+		    cut[i] = (level[i] >= 0 ? 0 : 1);
+	    }
+	    return totalflow;
+	}
+
+	/*
+	 * Now find paths from the source to the sink that go one
+	 * level further at every step, and push as much flow along
+	 * each as it will take, until there are none left. nextedge
+	 * and nextbackedge keep our place in each vertex's edges:
+	 * an edge we've passed over is either not one step further
+	 * on, full, or leads only to dead ends, and none of those
+	 * can change before the next BFS. A dead end has its level
+	 * cleared so that nothing goes there again.
+	 *
+	 * `path' holds the edges followed from the source so far,
+	 * coded as in maxflow_spare, so the vertex we came from is
+	 * edges[e] and the one we went to edges[e^1].
+	 */
+	for (i = 0; i < nv; i++) {
+	    nextedge[i] = firstedge[i];
+	    nextbackedge[i] = firstbackedge[i];
+	}
+	depth = 0;
+	from = source;
+	while (1) {
+	    int e = -1;
+
+	    if (from == sink) {
+		int max = -1, spare;
+
+		for (i = 0; i < depth; i++) {
+		    spare = maxflow_spare(path[i], capacity, flow);
+		    assert(spare != 0);
+		    if (max < 0 || (spare >= 0 && spare < max))
+			max = spare;
+		}
+		/* As above, an entirely unlimited path is an error. */
+		assert(max > 0);
+		for (i = 0; i < depth; i++) {
+		    if (path[i] & 1)
+			flow[path[i] / 2] -= max;
+		    else
+			flow[path[i] / 2] += max;
+		}
+		totalflow += max;
+
+		/*
+		 * At least one edge on the path is now full; start
+		 * again from the source, and we'll skip it.
+		 */
+		depth = 0;
+		from = source;
+		continue;
+	    }
+
+	    for (i = nextedge[from]; i < ne && edges[2*i] == from; i++) {
+		to = edges[2*i+1];
+		if (level[to] == level[from] + 1 &&
+		    maxflow_spare(2*i, capacity, flow)) {
+		    e = 2*i;
+		    break;
+		}
+	    }
+	    nextedge[from] = i;
+	    if (e < 0) {
+		for (i = nextbackedge[from];
+		     i < ne && edges[2*(j = backedges[i])+1] == from; i++) {
+		    to = edges[2*j];
+		    if (level[to] == level[from] + 1 && flow[j] > 0) {
+			e = 2*j+1;
+			break;
+		    }
+		}
+		nextbackedge[from] = i;
+	    }
+
+	    if (e >= 0) {
+		path[depth++] = e;
+		from = edges[e ^ 1];
+	    } else if (depth > 0) {
+		level[from] = -1;
+		from = edges[path[--depth]];
+	    } else {
+		break;		       /* nothing more from the source */
+	    }
+	}
+    }
+}
+
+int maxflow_with_scratch_alg(int alg, void *scratch, int nv, int source,
+			     int sink, int ne, const int *edges,
+			     const int *backedges, const int *capacity,
+			     int *flow, int *cut)
+{
+    assert(alg == MAXFLOW_EDMONDS_KARP || alg == MAXFLOW_DINIC);
+    if (alg == MAXFLOW_DINIC)
+	return maxflow_dinic(scratch, nv, source, sink, ne, edges,
+			     backedges, capacity, flow, cut);
+    else
+	return maxflow_edmonds_karp(scratch, nv, source, sink, ne, edges,
+				    backedges, capacity, flow, cut);
+}
+
+int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *capacity, int *flow, int *cut)
+{
+    return maxflow_with_scratch_alg(MAXFLOW_EDMONDS_KARP, scratch, nv,
+				    source, sink, ne, edges, backedges,
+				    capacity, flow, cut);
+}
+
 int maxflow_scratch_size(int nv)
 {
-    return (nv * 4) * sizeof(int);
+    /* Enough for either algorithm. */
+    return (nv * 7) * sizeof(int);
 }
 
 void maxflow_setup_backedges(int ne, const int *edges, int *backedges)
@@ -343,9 +541,9 @@ void maxflow_setup_backedges(int ne, const int *edges, int *backedges)
 
 }
 
-int maxflow(int nv, int source, int sink,
-	    int ne, const int *edges, const int *capacity,
-	    int *flow, int *cut)
+int maxflow_alg(int alg, int nv, int source, int sink,
+		int ne, const int *edges, const int *capacity,
+		int *flow, int *cut)
 {
     void *scratch;
     int *backedges;
@@ -369,8 +567,8 @@ int maxflow(int nv, int source, int sink,
     /*
      * Call the main function.
      */
-    ret = maxflow_with_scratch(scratch, nv, source, sink, ne, edges,
-			       backedges, capacity, flow, cut);
+    ret = maxflow_with_scratch_alg(alg, scratch, nv, source, sink, ne,
+				   edges, backedges, capacity, flow, cut);
 
     /*
      * Free the scratch space.
@@ -383,11 +581,37 @@ int maxflow(int nv, int source, int sink,
     return ret;
 }
 
+int maxflow(int nv, int source, int sink,
+	    int ne, const int *edges, const int *capacity,
+	    int *flow, int *cut)
+{
+    return maxflow_alg(MAXFLOW_EDMONDS_KARP, nv, source, sink, ne, edges,
+		       capacity, flow, cut);
+}
+
 #ifdef TESTMODE
 
 #define MAXEDGES 256
 #define MAXVERTICES 128
 #define ADDEDGE(i,j) do{edges[ne*2] = (i); edges[ne*2+1] = (j); ne++;}while(0)
+#define RANDOM_NETWORKS 200000
+#define RANDOM_MAXVERTICES 13
+#define RANDOM_MAXEDGES 60
+
+#include <stdarg.h>
+#include <string.h>
+
+void fatal(char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal error: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
 
 int compare_edge(const void *av, const void *bv)
 {
@@ -410,7 +634,7 @@ int main(void)
 {
     int edges[MAXEDGES*2], ne, nv;
     int capacity[MAXEDGES], flow[MAXEDGES], cut[MAXVERTICES];
-    int source, sink, p, q, i, j, ret;
+    int source, sink, p, q, i, j, k, t, alg, ret;
 
     /*
      * Use this algorithm to find a maximal complete matching in a
@@ -444,16 +668,81 @@ int main(void)
     /* capacity[ne] = 1; ADDEDGE(p+2,q+4); */
     qsort(edges, ne, 2*sizeof(int), compare_edge);
 
-    ret = maxflow(nv, source, sink, ne, edges, capacity, flow, cut);
+    for (alg = MAXFLOW_EDMONDS_KARP; alg <= MAXFLOW_DINIC; alg++) {
+	ret = maxflow_alg(alg, nv, source, sink, ne, edges, capacity,
+			  flow, cut);
 
-    printf("ret = %d\n", ret);
+	printf("%s: ret = %d\n", alg == MAXFLOW_DINIC ? "dinic" :
+	       "edmonds-karp", ret);
 
-    for (i = 0; i < ne; i++)
-	printf("flow %d: %d -> %d\n", flow[i], edges[2*i], edges[2*i+1]);
+	for (i = 0; i < ne; i++)
+	    printf("flow %d: %d -> %d\n", flow[i], edges[2*i], edges[2*i+1]);
+
+	for (i = 0; i < nv; i++)
+	    if (cut[i] == 0)
+		printf("difficult set includes %d\n", i);
+    }
 
-    for (i = 0; i < nv; i++)
-	if (cut[i] == 0)
-	    printf("difficult set includes %d\n", i);
+    /*
+     * Now check the two algorithms against each other on a lot of
+     * small random networks: each must find a flow which keeps to the
+     * capacities and is conserved at every vertex but the source and
+     * sink, with a cut whose capacity is the size of the flow (which
+     * makes both maximal, so they must be the same size).
+     */
+    srand(1);
+    for (t = 0; t < RANDOM_NETWORKS; t++) {
+	int total[2];
+
+	nv = 2 + rand() % (RANDOM_MAXVERTICES - 1);
+	source = 0;
+	sink = 1;
+	ne = 0;
+	for (k = rand() % RANDOM_MAXEDGES; k > 0; k--) {
+	    p = rand() % nv;
+	    q = rand() % nv;
+	    if (p == q)
+		continue;
+	    for (i = 0; i < ne; i++)
+		if (edges[2*i] == p && edges[2*i+1] == q)
+		    break;
+	    if (i == ne)
+		ADDEDGE(p, q);
+	}
+	qsort(edges, ne, 2*sizeof(int), compare_edge);
+	for (i = 0; i < ne; i++)
+	    capacity[i] = rand() % 4;
+
+	for (alg = MAXFLOW_EDMONDS_KARP; alg <= MAXFLOW_DINIC; alg++) {
+	    int net[MAXVERTICES], cutsize = 0;
+
+	    total[alg] = maxflow_alg(alg, nv, source, sink, ne, edges,
+				     capacity, flow, cut);
+
+	    memset(net, 0, nv * sizeof(int));
+	    for (i = 0; i < ne; i++) {
+		p = edges[2*i];
+		q = edges[2*i+1];
+		if (flow[i] < 0 || flow[i] > capacity[i])
+		    fatal("network %d: flow out of bounds", t);
+		net[p] -= flow[i];
+		net[q] += flow[i];
+		if (cut[p] == 0 && cut[q] == 1)
+		    cutsize += capacity[i];
+		else if (cut[p] == 1 && cut[q] == 0 && flow[i] != 0)
+		    fatal("network %d: flow back across cut", t);
+	    }
+	    for (i = 0; i < nv; i++)
+		if (net[i] != (i == source ? -total[alg] :
+			       i == sink ? total[alg] : 0))
+		    fatal("network %d: flow not conserved at %d", t, i);
+	    if (cut[source] != 0 || cut[sink] != 1 || cutsize != total[alg])
+		fatal("network %d: cut does not match flow", t);
+	}
+	if (total[MAXFLOW_EDMONDS_KARP] != total[MAXFLOW_DINIC])
+	    fatal("network %d: algorithms disagree", t);
+    }
+    printf("%d random networks ok\n", RANDOM_NETWORKS);
 
     return 0;
 }
@@ -8,6 +8,10 @@
  * that should be, but it's claimed on the Internet that it's been
  * proved, and that's good enough for me. I prefer BFS to DFS
  * anyway :-)
+ *
+ * Dinic's algorithm is also available, which finds all the shortest
+ * augmenting paths of each length in one go and so takes far fewer
+ * passes over the network on large ones.
  */
 
 #ifndef MAXFLOW_MAXFLOW_H
@@ -76,6 +80,7 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 int maxflow_scratch_size(int nv);
 void maxflow_setup_backedges(int ne, const int *edges, int *backedges);
 
+
 /*
  * Simplified version of the above function. All parameters are the
  * same, except that `scratch' and `backedges' are constructed
@@ -92,4 +97,23 @@ int maxflow(int nv, int source, int sink,
 	    int ne, const int *edges, const int *capacity,
 	    int *flow, int *cut);
 
+/*
+ * The same two functions with a choice of algorithm: maxflow and
+ * maxflow_with_scratch use Edmonds-Karp. Each algorithm always gives
+ * the same flow for the same network and edge order, but not the same
+ * flow as the other; so a generator that picks its puzzle from the
+ * flow must stay with the one it used before, for old random seeds to
+ * make the same puzzles. Where only the size of the flow or the cut
+ * matters, Dinic is the quicker on big networks. Scratch space from
+ * maxflow_scratch_size is big enough for either.
+ */
+enum { MAXFLOW_EDMONDS_KARP, MAXFLOW_DINIC };
+int maxflow_with_scratch_alg(int alg, void *scratch, int nv, int source,
+			     int sink, int ne, const int *edges,
+			     const int *backedges, const int *capacity,
+			     int *flow, int *cut);
+int maxflow_alg(int alg, int nv, int source, int sink,
+		int ne, const int *edges, const int *capacity,
+		int *flow, int *cut);
+
 #endif /* MAXFLOW_MAXFLOW_H */
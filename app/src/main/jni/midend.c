@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include "puzzles.h"
 
@@ -23,11 +24,21 @@ enum { NEWGAME, MOVE, SOLVE, RESTART };/* for midend_state_entry.movetype */
 #define special(type) ( (type) != MOVE )
 
 struct midend_state_entry {
-    game_state *state;
+    game_state *state;                 /* NULL if not yet rebuilt */
     char *movestr;
     int movetype;
+    char *checkpoint;                  /* from a save file; see below */
 };
 
+/*
+ * For games with encode_state, save files carry a checkpoint of every
+ * CHECKPOINT_INTERVAL'th state, and of the current one. On loading, we
+ * decode the checkpoint nearest before the current position and only
+ * replay the moves after it; the states before that are left NULL,
+ * with their checkpoints kept, until undo reaches them.
+ */
+#define CHECKPOINT_INTERVAL 64
+
 struct midend {
     frontend *frontend;
     random_state *random;
@@ -87,6 +98,11 @@ struct midend {
 
     void (*game_id_change_notify_function)(void *);
     void *game_id_change_notify_ctx;
+
+    puzzle_pool *pool;
+    int race;                  /* threads to race new seeds on */
+    int undo_budget;           /* game_states to keep, or 0 for all */
+    int undo_floor;            /* earliest state undo can get back to */
 };
 
 #define ensure(me) do { \
@@ -137,6 +153,10 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->params = ourgame->default_params();
     me->game_id_change_notify_function = NULL;
     me->game_id_change_notify_ctx = NULL;
+    me->pool = NULL;
+    me->race = 1;
+    me->undo_budget = 0;
+    me->undo_floor = 0;
 
     /*
      * Allow environment-based changing of the default settings by
@@ -194,18 +214,23 @@ const game *midend_which_game(midend *me)
 static void midend_purge_states(midend *me)
 {
     while (me->nstates > me->statepos) {
-        me->ourgame->free_game(me->states[--me->nstates].state);
+        if (me->states[--me->nstates].state)
+            me->ourgame->free_game(me->states[me->nstates].state);
         if (me->states[me->nstates].movestr)
             sfree(me->states[me->nstates].movestr);
+        sfree(me->states[me->nstates].checkpoint);
     }
 }
 
 static void midend_free_game(midend *me)
 {
+    me->undo_floor = 0;
     while (me->nstates > 0) {
         me->nstates--;
-	me->ourgame->free_game(me->states[me->nstates].state);
+        if (me->states[me->nstates].state)
+            me->ourgame->free_game(me->states[me->nstates].state);
 	sfree(me->states[me->nstates].movestr);
+	sfree(me->states[me->nstates].checkpoint);
     }
 
     if (me->drawstate) {
@@ -360,58 +385,90 @@ void midend_force_redraw(midend *me)
 
 void midend_new_game(midend *me)
 {
-    midend_free_game(me);
-
-    assert(me->nstates == 0);
+    midend_try_new_game(me, NULL, 0.0);
+}
 
+/*
+ * As midend_new_game, except that generation gives up once *cancel
+ * becomes nonzero or `timeout' seconds have passed (if positive). In
+ * that case we return FALSE and leave the current game untouched.
+ */
+int midend_try_new_game(midend *me, const volatile int *cancel,
+                        double timeout)
+{
     if (me->genmode == GOT_DESC) {
+        midend_free_game(me);
 	me->genmode = GOT_NOTHING;
     } else {
-        random_state *rs;
+        game_params *newparams;
+        char *newseed = NULL, *newdesc = NULL, *newaux = NULL;
+        /*
+         * If this midend has been instantiated without providing a
+         * drawing API, it is non-interactive. This means that it's
+         * being used for bulk game generation, and hence we should
+         * pass the non-interactive flag to new_desc.
+         */
+        int interactive = (me->drawing != NULL);
 
         if (me->genmode == GOT_SEED) {
-            me->genmode = GOT_NOTHING;
+            newparams = me->ourgame->dup_params(me->curparams);
+            newseed = dupstr(me->seedstr);
         } else {
+	    newparams = me->ourgame->dup_params(me->params);
+
             /*
-             * Generate a new random seed. 15 digits comes to about
-             * 48 bits, which should be more than enough.
-             * 
-             * I'll avoid putting a leading zero on the number,
-             * just in case it confuses anybody who thinks it's
-             * processed as an integer rather than a string.
+             * If we have a pool of ready-made games for these
+             * parameters, take one: it comes with the seed it was
+             * generated from, so it's just as if we'd generated it
+             * here.
              */
-            char newseed[16];
-            int i;
-            newseed[15] = '\0';
-            newseed[0] = '1' + (char)random_upto(me->random, 9);
-            for (i = 1; i < 15; i++)
-                newseed[i] = '0' + (char)random_upto(me->random, 10);
-            sfree(me->seedstr);
-            me->seedstr = dupstr(newseed);
-
-	    if (me->curparams)
-		me->ourgame->free_params(me->curparams);
-	    me->curparams = me->ourgame->dup_params(me->params);
+            if (me->pool)
+                pool_take(me->pool, me->ourgame, newparams, interactive,
+                          &newseed, &newdesc, &newaux);
+
+            if (!newdesc && me->race > 1)
+                newdesc = race_new_desc(me->ourgame, newparams,
+                                        me->random, me->race, interactive,
+                                        cancel, timeout, &newseed, &newaux);
+            else if (!newdesc)
+                newseed = new_seed_string(me->random);
+        }
+
+        if (!newdesc && newseed) {
+            random_state *rs = random_new_seed(newseed);
+            random_set_cancel(rs, cancel);
+            if (timeout > 0)
+                random_set_timeout(rs, timeout);
+            newdesc = me->ourgame->new_desc(newparams, rs, &newaux,
+                                            interactive);
+            random_free(rs);
+        }
+
+        if (!newdesc) {
+            /* Cancelled: forget the attempt. */
+            me->ourgame->free_params(newparams);
+            sfree(newseed);
+            sfree(newaux);
+            return FALSE;
         }
 
+        midend_free_game(me);
+        me->genmode = GOT_NOTHING;
+        if (me->curparams)
+            me->ourgame->free_params(me->curparams);
+        me->curparams = newparams;
+        sfree(me->seedstr);
+        me->seedstr = newseed;
 	sfree(me->desc);
 	sfree(me->privdesc);
         sfree(me->aux_info);
-	me->aux_info = NULL;
-
-        rs = random_new(me->seedstr, strlen(me->seedstr));
-	/*
-	 * If this midend has been instantiated without providing a
-	 * drawing API, it is non-interactive. This means that it's
-	 * being used for bulk game generation, and hence we should
-	 * pass the non-interactive flag to new_desc.
-	 */
-        me->desc = me->ourgame->new_desc(me->curparams, rs,
-					 &me->aux_info, (me->drawing != NULL));
+        me->desc = newdesc;
 	me->privdesc = NULL;
-        random_free(rs);
+        me->aux_info = newaux;
     }
 
+    assert(me->nstates == 0);
+
     ensure(me);
 
     /*
@@ -452,6 +509,7 @@ void midend_new_game(midend *me)
 
     me->states[me->nstates].movestr = NULL;
     me->states[me->nstates].movetype = NEWGAME;
+    me->states[me->nstates].checkpoint = NULL;
     me->nstates++;
     me->statepos = 1;
     me->drawstate = me->ourgame->new_drawstate(me->drawing,
@@ -467,11 +525,12 @@ void midend_new_game(midend *me)
     if (me->game_id_change_notify_function)
         me->game_id_change_notify_function(me->game_id_change_notify_ctx);
     changed_state(me->drawing, 0, 0);
+    return TRUE;
 }
 
 int midend_can_undo(midend *me)
 {
-    return (me->statepos > 1);
+    return (me->statepos > me->undo_floor + 1);
 }
 
 int midend_can_redo(midend *me)
@@ -479,31 +538,164 @@ int midend_can_redo(midend *me)
     return (me->statepos < me->nstates);
 }
 
+/*
+ * Rebuild whichever of states[start..end-1] are missing. Each is made
+ * by executing its move on the one before, except that the first may
+ * have nothing before it, in which case it must have a checkpoint.
+ * Returns the index of the first state that couldn't be made, or
+ * `end'.
+ */
+static int midend_replay(midend *me, struct midend_state_entry *states,
+                         int start, int end)
+{
+    int i;
+
+    for (i = start; i < end; i++) {
+        if (states[i].state)
+            continue;                  /* states[0], or a restart */
+        if (!states[i-1].state) {
+            if (!states[i].checkpoint)
+                return i;              /* just above the undo floor */
+            states[i].state =
+                me->ourgame->decode_state(states[0].state,
+                                          states[i].checkpoint);
+        } else {
+            states[i].state = me->ourgame->execute_move(states[i-1].state,
+                                                        states[i].movestr);
+        }
+        if (!states[i].state)
+            return i;
+        sfree(states[i].checkpoint);
+        states[i].checkpoint = NULL;
+    }
+    return end;
+}
+
+/*
+ * Find where to start rebuilding states[i]: the latest state no later
+ * than it, and no earlier than `floor', which has either a checkpoint
+ * or a state before it.
+ */
+static int midend_replay_start(struct midend_state_entry *states, int i,
+                               int floor)
+{
+    while (i > floor && !states[i-1].state && !states[i].checkpoint)
+        i--;
+    return i;
+}
+
+/*
+ * Make sure states[i] exists, for undo or redo. midend_deserialise
+ * only checks the moves from the current position's checkpoint on, so
+ * this may find a move in the save file that doesn't execute. Then
+ * nothing before it can be reached: we tell the user, raise the undo
+ * floor to the first state after it that has a checkpoint (or already
+ * exists), and return FALSE. The caller can try again if states[i] is
+ * still above the floor.
+ */
+static int midend_build_state(midend *me, int i)
+{
+    while (!me->states[i].state) {
+        int start, got;
+
+        if (i < me->undo_floor)
+            return FALSE;
+        start = midend_replay_start(me->states, i, me->undo_floor);
+        got = midend_replay(me, me->states, start, i+1);
+        if (got > i)
+            break;
+        if (me->states[got].checkpoint && !me->states[got-1].state) {
+            /* Undecodable checkpoint: go further back instead. */
+            sfree(me->states[got].checkpoint);
+            me->states[got].checkpoint = NULL;
+            continue;
+        }
+        if (got >= me->statepos - 1)
+            return FALSE;              /* checked at load time */
+#ifdef ANDROID
+        if (me->states[got-1].state)
+            android_toast(_("Save file contained an invalid move"), FALSE);
+#endif
+        for (me->undo_floor = got + 1;
+             !me->states[me->undo_floor].state &&
+                 !me->states[me->undo_floor].checkpoint;
+             me->undo_floor++);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * With an undo budget, we keep only about that many game_states in the
+ * history, and free the rest once we've moved away from them, for
+ * midend_build_state to make again if undo or redo comes back. We keep
+ * states[0] and restarts (which there's nothing to rebuild from),
+ * every `step'th state, and the states from the last of those before
+ * the one behind the current position up to the one ahead of it, so
+ * that stepping back through the history replays each move only once
+ * per pass. `step' is the power of two that keeps the total within
+ * the budget, or failing that as small as it can be.
+ */
+static void midend_trim_states(midend *me)
+{
+    int step, best, lo, i;
+
+    if (me->undo_budget <= 0 || me->nstates <= me->undo_budget)
+        return;
+
+    for (best = step = 1; step < me->nstates; step *= 2) {
+        if (me->nstates / step + step < me->nstates / best + best)
+            best = step;
+        if (me->nstates / step + step <= me->undo_budget) {
+            best = step;
+            break;
+        }
+    }
+    step = best;
+    lo = me->statepos > 2 ? (me->statepos-2) / step * step : 0;
+
+    for (i = 1; i < me->nstates; i++) {
+        if (me->states[i].state && me->states[i].movetype != RESTART &&
+            i % step != 0 && i != me->undo_floor &&
+            (i < lo || i > me->statepos)) {
+            me->ourgame->free_game(me->states[i].state);
+            me->states[i].state = NULL;
+        }
+    }
+}
+
 static int midend_undo(midend *me)
 {
-    if (me->statepos > 1) {
+    while (midend_can_undo(me) && !midend_build_state(me, me->statepos-2))
+        ;                              /* the floor has gone up: try again */
+    if (midend_can_undo(me)) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
                                        me->states[me->statepos-1].state,
                                        me->states[me->statepos-2].state);
 	me->statepos--;
         me->dir = -1;
-        changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+        midend_trim_states(me);
+        changed_state(me->drawing, midend_can_undo(me), me->statepos < me->nstates);
         return 1;
-    } else
+    } else {
+        /* We may have just found there's nothing left to undo. */
+        changed_state(me->drawing, FALSE, me->statepos < me->nstates);
         return 0;
+    }
 }
 
 static int midend_redo(midend *me)
 {
-    if (me->statepos < me->nstates) {
+    if (me->statepos < me->nstates && midend_build_state(me, me->statepos)) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
                                        me->states[me->statepos-1].state,
                                        me->states[me->statepos].state);
 	me->statepos++;
         me->dir = +1;
-        changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+        midend_trim_states(me);
+        changed_state(me->drawing, midend_can_undo(me), me->statepos < me->nstates);
         return 1;
     } else
         return 0;
@@ -522,14 +714,16 @@ static void midend_finish_move(midend *me)
         ((me->dir > 0 && !special(me->states[me->statepos-1].movetype)) ||
          (me->dir < 0 && me->statepos < me->nstates &&
           !special(me->states[me->statepos].movetype)))) {
-	flashtime = me->ourgame->flash_length(me->oldstate ? me->oldstate :
-					      me->states[me->statepos-2].state,
-					      me->states[me->statepos-1].state,
-					      me->oldstate ? me->dir : +1,
-					      me->ui);
-	if (flashtime > 0) {
-	    me->flash_pos = 0.0F;
-	    me->flash_time = flashtime;
+        if (me->oldstate || midend_build_state(me, me->statepos-2)) {
+	    flashtime = me->ourgame->flash_length(me->oldstate ? me->oldstate :
+						  me->states[me->statepos-2].state,
+						  me->states[me->statepos-1].state,
+						  me->oldstate ? me->dir : +1,
+						  me->ui);
+	    if (flashtime > 0) {
+		me->flash_pos = 0.0F;
+		me->flash_time = flashtime;
+	    }
 	}
     }
 
@@ -578,13 +772,15 @@ void midend_restart_game(midend *me)
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = dupstr(me->desc);
     me->states[me->nstates].movetype = RESTART;
+    me->states[me->nstates].checkpoint = NULL;
     me->statepos = ++me->nstates;
+    midend_trim_states(me);
     if (me->ui) {
         me->ourgame->changed_state(me->ui,
                                    me->states[me->statepos-2].state,
                                    me->states[me->statepos-1].state);
     }
-    changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+    changed_state(me->drawing, midend_can_undo(me), me->statepos < me->nstates);
     me->anim_time = 0.0;
     midend_finish_move(me);
     midend_redraw(me);
@@ -593,8 +789,12 @@ void midend_restart_game(midend *me)
 
 static int midend_really_process_key(midend *me, int x, int y, int button)
 {
-    game_state *oldstate =
-        me->ourgame->dup_game(me->states[me->statepos - 1].state);
+    /*
+     * The state before the move, for animating it. Most input (drags,
+     * cursor movement) doesn't make a move at all, so we only copy
+     * the current state once we know it's about to change.
+     */
+    game_state *oldstate = NULL;
     int type = MOVE, gottype = FALSE, ret = 1;
     float anim_time;
     game_state *s;
@@ -622,15 +822,22 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 	    midend_stop_anim(me);
 	    type = me->states[me->statepos-1].movetype;
 	    gottype = TRUE;
-	    if (!midend_undo(me))
+	    if (!midend_can_undo(me))
 		goto done;
+	    oldstate = me->ourgame->dup_game(me->states[me->statepos-1].state);
+	    if (!midend_undo(me))
+		goto done;	       /* a bad move in the save file */
 	} else if (button == 'r') {
 	    midend_stop_anim(me);
-	    if (!midend_redo(me))
+	    if (!midend_can_redo(me))
 		goto done;
+	    oldstate = me->ourgame->dup_game(me->states[me->statepos-1].state);
+	    if (!midend_redo(me))
+		goto done;	       /* a bad move in the save file */
 	} else if (button == '\x13' && me->ourgame->can_solve) {
-	    if (midend_solve(me))
-		goto done;
+	    /* midend_solve starts its own animation, if any. */
+	    midend_solve(me);
+	    goto done;
 	} else if (button == 'q' || button == 'Q' || button == '\x11') {
 	    ret = 0;
 	    goto done;
@@ -656,20 +863,23 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             goto done;
         } else if (s) {
 	    midend_stop_anim(me);
+	    oldstate = me->ourgame->dup_game(me->states[me->statepos-1].state);
             midend_purge_states(me);
             ensure(me);
             assert(movestr != NULL);
             me->states[me->nstates].state = s;
             me->states[me->nstates].movestr = movestr;
             me->states[me->nstates].movetype = MOVE;
+            me->states[me->nstates].checkpoint = NULL;
             me->statepos = ++me->nstates;
             me->dir = +1;
+            midend_trim_states(me);
 	    if (me->ui) {
 		me->ourgame->changed_state(me->ui,
 					   me->states[me->statepos-2].state,
 					   me->states[me->statepos-1].state);
             }
-            changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+            changed_state(me->drawing, midend_can_undo(me), me->statepos < me->nstates);
         } else {
             goto done;
         }
@@ -1425,13 +1635,15 @@ char *midend_solve(midend *me)
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = movestr;
     me->states[me->nstates].movetype = SOLVE;
+    me->states[me->nstates].checkpoint = NULL;
     me->statepos = ++me->nstates;
+    midend_trim_states(me);
     if (me->ui) {
         me->ourgame->changed_state(me->ui,
                                    me->states[me->statepos-2].state,
                                    me->states[me->statepos-1].state);
     }
-    changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+    changed_state(me->drawing, midend_can_undo(me), me->statepos < me->nstates);
     me->dir = +1;
     if (me->ourgame->flags & SOLVE_ANIMATES) {
 	me->oldstate = me->ourgame->dup_game(me->states[me->statepos-2].state);
@@ -1497,32 +1709,389 @@ char *midend_rewrite_statusbar(midend *me, char *text)
     }
 }
 
-#define SERIALISE_MAGIC "Simon Tatham's Portable Puzzle Collection"
-#define SERIALISE_VERSION "1"
+/*
+ * Save files come in two forms holding the same sequence of records,
+ * each a key of up to 8 characters and a string value.
+ *
+ * The text form is a line per record: the key padded to exactly 8
+ * characters, a colon, the length of the value in decimal, another
+ * colon, the value itself (exactly that many bytes, no matter what
+ * they contain), then a newline (of reasonably flexible form).
+ *
+ * The binary form starts with SERIALISE_BINARY_MAGIC and a header
+ * giving the game name, so identify_game can stop there. Then each
+ * record is a byte identifying its key by its position in
+ * save_keys[] plus one (or 0, followed by the key's length and the
+ * key, for any other), then the length of the value, then the value.
+ * Lengths are varints: seven bits per byte, least significant first,
+ * with the top bit set on all but the last byte.
+ *
+ * Each record converts exactly from one form to the other, so
+ * save_convert can go either way without losing anything.
+ *
+ * Only puzzlesgen writes the binary form (--convert, and --bench
+ * --save to time it). The app keeps its saves in Java strings, so it
+ * writes text, though midend_deserialise would take either.
+ */
+static const char *const save_keys[] = {
+    "SAVEFILE", "VERSION", "GAME", "PARAMS", "CPARAMS", "SEED", "DESC",
+    "PRIVDESC", "AUXINFO", "UI", "TIME", "NSTATES", "STATEPOS", "MOVE",
+    "SOLVE", "RESTART", "CHECKPT",
+};
+#define NSAVEKEYS lenof(save_keys)
+#define BINARY_MAGIC_LEN (sizeof(SERIALISE_BINARY_MAGIC) - 1)
+
+struct save_writer {
+    void (*write)(void *ctx, void *buf, int len);
+    void *wctx;
+    int binary;
+    char *line;                        /* scratch, kept between records */
+    int linesize;
+};
 
-void midend_serialise(midend *me,
-                      void (*write)(void *ctx, void *buf, int len),
-                      void *wctx)
+static int put_varint(unsigned char *p, unsigned len)
+{
+    int n = 0;
+
+    while (len >= 0x80) {
+        p[n++] = (len & 0x7F) | 0x80;
+        len >>= 7;
+    }
+    p[n++] = len;
+    return n;
+}
+
+/*
+ * Start a save file. The binary form needs the game name up front.
+ */
+static void save_write_start(struct save_writer *sw, const char *name)
+{
+    unsigned char buf[BINARY_MAGIC_LEN + 5];
+    int len = strlen(name), n;
+
+    if (!sw->binary)
+        return;
+    memcpy(buf, SERIALISE_BINARY_MAGIC, BINARY_MAGIC_LEN);
+    n = BINARY_MAGIC_LEN + put_varint(buf + BINARY_MAGIC_LEN, len);
+    sw->write(sw->wctx, buf, n);
+    sw->write(sw->wctx, (void *)name, len);
+}
+
+/*
+ * Write one record of a save file in a single call to `write', which
+ * may be expensive (on Android it used to be a trip into Java for
+ * each fragment).
+ */
+static void save_write_record(struct save_writer *sw, const char *key,
+                              const char *val, int len)
+{
+    int hlen, i;
+
+    if (sw->linesize < len + 80) {
+        sw->linesize = len + 80;
+        sw->line = sresize(sw->line, sw->linesize, char);
+    }
+    if (!sw->binary) {
+        hlen = sprintf(sw->line, "%-8.8s:%d:", key, len);
+        memcpy(sw->line + hlen, val, len);
+        sw->line[hlen + len] = '\n';
+        sw->write(sw->wctx, sw->line, hlen + len + 1);
+        return;
+    }
+
+    for (i = 0; i < NSAVEKEYS; i++)
+        if (!strcmp(key, save_keys[i]))
+            break;
+    hlen = 0;
+    if (i < NSAVEKEYS) {
+        sw->line[hlen++] = i + 1;
+    } else {
+        int klen = strlen(key) < 8 ? strlen(key) : 8;
+        sw->line[hlen++] = 0;
+        sw->line[hlen++] = klen;
+        memcpy(sw->line + hlen, key, klen);
+        hlen += klen;
+    }
+    hlen += put_varint((unsigned char *)sw->line + hlen, len);
+    memcpy(sw->line + hlen, val, len);
+    sw->write(sw->wctx, sw->line, hlen + len);
+}
+
+struct save_reader {
+    int (*read)(void *ctx, void *buf, int len);
+    void *rctx;
+    int binary;
+    int peeked;                        /* first byte of a text file, or -1 */
+    char *game;                        /* from the binary header */
+};
+
+/* SAVE_EOF is between records; SAVE_TRUNCATED in the middle of one. */
+enum { SAVE_RECORD, SAVE_EOF, SAVE_TRUNCATED, SAVE_BADLY_FORMATTED };
+
+static int save_read(struct save_reader *sr, void *buf, int len)
+{
+    if (len > 0 && sr->peeked >= 0) {
+        *(unsigned char *)buf = sr->peeked;
+        sr->peeked = -1;
+        buf = (unsigned char *)buf + 1;
+        len--;
+    }
+    return len == 0 || sr->read(sr->rctx, buf, len);
+}
+
+static int get_varint(struct save_reader *sr, int *ret)
+{
+    unsigned char c;
+    unsigned val = 0;
+    int shift;
+
+    for (shift = 0; shift < 32; shift += 7) {
+        if (!save_read(sr, &c, 1))
+            return SAVE_TRUNCATED;
+        val |= (unsigned)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            if (val >= INT_MAX)        /* so that len+1 fits */
+                return SAVE_BADLY_FORMATTED;
+            *ret = val;
+            return SAVE_RECORD;
+        }
+    }
+    return SAVE_BADLY_FORMATTED;
+}
+
+/*
+ * Read a string of `len' bytes into a fresh buffer with a terminating
+ * NUL. The length comes from the file, so we don't trust it for the
+ * size of the allocation: we grow the buffer as the data arrives, so a
+ * bogus length runs out of input before it runs out of memory.
+ */
+#define SAVE_READ_CHUNK 65536
+
+static int save_read_string(struct save_reader *sr, int len, char **ret)
 {
+    char *buf;
+    int got = 0, size;
+
+    assert(len >= 0 && len < INT_MAX);
+    size = min(len, SAVE_READ_CHUNK);
+    buf = snewn(size + 1, char);
+    while (got < len) {
+        int n = min(len - got, SAVE_READ_CHUNK);
+        if (got + n > size) {
+            size = (size < len / 2 ? size * 2 : len);
+            size = max(size, got + n);
+            buf = sresize(buf, size + 1, char);
+        }
+        if (!save_read(sr, buf + got, n)) {
+            sfree(buf);
+            return FALSE;
+        }
+        got += n;
+    }
+    buf[len] = '\0';
+    *ret = buf;
+    return TRUE;
+}
+
+/*
+ * Find out which form a save file is in. For the binary one, this
+ * reads the header and leaves the game name in sr->game; for text, we
+ * look at only one byte. Returns FALSE if there isn't even that.
+ */
+static int save_read_start(struct save_reader *sr,
+                           int (*read)(void *ctx, void *buf, int len),
+                           void *rctx)
+{
+    unsigned char magic[BINARY_MAGIC_LEN];
+    int len;
+
+    sr->read = read;
+    sr->rctx = rctx;
+    sr->binary = FALSE;
+    sr->peeked = -1;
+    sr->game = NULL;
+
+    if (!read(rctx, magic, 1))
+        return FALSE;
+    if (magic[0] != (unsigned char)SERIALISE_BINARY_MAGIC[0]) {
+        sr->peeked = magic[0];
+        return TRUE;
+    }
+    if (!read(rctx, magic + 1, BINARY_MAGIC_LEN - 1) ||
+        memcmp(magic, SERIALISE_BINARY_MAGIC, BINARY_MAGIC_LEN) ||
+        get_varint(sr, &len) != SAVE_RECORD ||
+        !save_read_string(sr, len, &sr->game))
+        return FALSE;
+    sr->binary = TRUE;
+    return TRUE;
+}
+
+/*
+ * Read the next record into `key' and a fresh string `*val'.
+ */
+static int save_read_record(struct save_reader *sr, char key[9], char **val,
+                            int *vallen)
+{
+    int len;
+
+    *val = NULL;
+    if (sr->binary) {
+        unsigned char tag;
+        int ret;
+
+        if (!save_read(sr, &tag, 1))
+            return SAVE_EOF;
+        if (tag == 0) {
+            unsigned char klen;
+            if (!save_read(sr, &klen, 1))
+                return SAVE_TRUNCATED;
+            if (klen > 8)
+                return SAVE_BADLY_FORMATTED;
+            if (!save_read(sr, key, klen))
+                return SAVE_TRUNCATED;
+            key[klen] = '\0';
+        } else if (tag <= NSAVEKEYS) {
+            strcpy(key, save_keys[tag - 1]);
+        } else {
+            return SAVE_BADLY_FORMATTED;
+        }
+        if ((ret = get_varint(sr, &len)) != SAVE_RECORD)
+            return ret;
+    } else {
+        char c;
+
+        do {
+            if (!save_read(sr, key, 1))
+                return SAVE_EOF;
+        } while (key[0] == '\r' || key[0] == '\n');
+
+        if (!save_read(sr, key+1, 8))
+            return SAVE_TRUNCATED;
+        if (key[8] != ':')
+            return SAVE_BADLY_FORMATTED;
+        len = strcspn(key, ": ");
+        assert(len <= 8);
+        key[len] = '\0';
+
+        len = 0;
+        while (1) {
+            if (!save_read(sr, &c, 1))
+                return SAVE_TRUNCATED;
+            if (c == ':')
+                break;
+            else if (c >= '0' && c <= '9' && len <= (INT_MAX - 9) / 10)
+                len = (len * 10) + (c - '0');
+            else
+                return SAVE_BADLY_FORMATTED;
+        }
+    }
+
+    if (!save_read_string(sr, len, val)) {
+        *val = NULL;
+        return SAVE_TRUNCATED;
+    }
+    if (vallen)
+        *vallen = len;
+    return SAVE_RECORD;
+}
+
+/*
+ * Copy a save file from one form to the other (or the same), record
+ * by record, without interpreting it beyond checking it is a save
+ * file. Returns NULL on success, or an error message.
+ */
+char *save_convert(int (*read)(void *ctx, void *buf, int len), void *rctx,
+                   void (*write)(void *ctx, void *buf, int len), void *wctx,
+                   int binary)
+{
+    struct save_reader sr;
+    struct save_writer sw;
+    char key[9], **keys = NULL, **vals = NULL, *game = NULL, *ret = NULL;
+    int *lens = NULL, n = 0, size = 0, i, got;
+
+    if (!save_read_start(&sr, read, rctx))
+        return _("Data does not appear to be a saved game file");
+
+    /*
+     * The binary header needs the game name, which comes a few
+     * records in, so read everything before writing anything.
+     */
+    while (1) {
+        if (n >= size) {
+            size = n + 128;
+            keys = sresize(keys, size, char *);
+            vals = sresize(vals, size, char *);
+            lens = sresize(lens, size, int);
+        }
+        got = save_read_record(&sr, key, &vals[n], &lens[n]);
+        if (got == SAVE_EOF)
+            break;                     /* the whole file */
+        if (n == 0 && got != SAVE_RECORD) {
+            ret = _("Data does not appear to be a saved game file");
+            goto cleanup;
+        } else if (got == SAVE_TRUNCATED) {
+            ret = _("Saved data ended unexpectedly");
+            goto cleanup;
+        } else if (got != SAVE_RECORD) {
+            ret = _("Data was incorrectly formatted for a saved game file");
+            goto cleanup;
+        }
+        keys[n] = dupstr(key);
+        if (n == 0 && (strcmp(key, "SAVEFILE") ||
+                       strcmp(vals[0], SERIALISE_MAGIC))) {
+            sfree(vals[0]);
+            sfree(keys[0]);
+            ret = _("Data does not appear to be a saved game file");
+            goto cleanup;
+        }
+        if (!game && !strcmp(key, "GAME"))
+            game = vals[n];
+        n++;
+    }
+    if (!game) {
+        ret = _("Saved data ended unexpectedly");
+        goto cleanup;
+    }
+
+    sw.write = write;
+    sw.wctx = wctx;
+    sw.binary = binary;
+    sw.line = NULL;
+    sw.linesize = 0;
+    save_write_start(&sw, game);
+    for (i = 0; i < n; i++)
+        save_write_record(&sw, keys[i], vals[i], lens[i]);
+    sfree(sw.line);
+
+    cleanup:
+    for (i = 0; i < n; i++) {
+        sfree(keys[i]);
+        sfree(vals[i]);
+    }
+    sfree(keys);
+    sfree(vals);
+    sfree(lens);
+    sfree(sr.game);
+    return ret;
+}
+
+static void midend_serialise_int(midend *me,
+                                 void (*write)(void *ctx, void *buf, int len),
+                                 void *wctx, int binary)
+{
+    struct save_writer sw;
     int i;
 
     /*
-     * Each line of the save file contains three components. First
-     * exactly 8 characters of header word indicating what type of
-     * data is contained on the line; then a colon followed by a
-     * decimal integer giving the length of the main string on the
-     * line; then a colon followed by the string itself (exactly as
-     * many bytes as previously specified, no matter what they
-     * contain). Then a newline (of reasonably flexible form).
+     * See above for the layout of the file.
      */
-#define wr(h,s) do { \
-    char hbuf[80]; \
-    char *str = (s); \
-    sprintf(hbuf, "%-8.8s:%d:", (h), (int)strlen(str)); \
-    write(wctx, hbuf, strlen(hbuf)); \
-    write(wctx, str, strlen(str)); \
-    write(wctx, "\n", 1); \
-} while (0)
+    sw.write = write;
+    sw.wctx = wctx;
+    sw.binary = binary;
+    sw.line = NULL;
+    sw.linesize = 0;
+    save_write_start(&sw, me->ourgame->name);
+#define wr(h,s) save_write_record(&sw, (h), (s), strlen(s))
 
     /*
      * Magic string identifying the file, and version number of the
@@ -1627,9 +2196,23 @@ void midend_serialise(midend *me,
      * constructed from either privdesc or desc), enough
      * information for execute_move() to reconstruct it from the
      * previous one.
+     *
+     * Some of them also get a checkpoint, which comes just before
+     * the move it belongs to, because loading stops as soon as it
+     * has read the last move. Older versions ignore it.
      */
     for (i = 1; i < me->nstates; i++) {
         assert(me->states[i].movetype != NEWGAME);   /* only state 0 */
+        if (me->ourgame->encode_state && me->states[i].movetype != RESTART &&
+            (i % CHECKPOINT_INTERVAL == 0 || i == me->statepos-1)) {
+            if (me->states[i].state) {
+                char *s = me->ourgame->encode_state(me->states[i].state);
+                wr("CHECKPT", s);
+                sfree(s);
+            } else if (me->states[i].checkpoint) {
+                wr("CHECKPT", me->states[i].checkpoint);
+            }
+        }
         switch (me->states[i].movetype) {
           case MOVE:
             wr("MOVE", me->states[i].movestr);
@@ -1643,9 +2226,28 @@ void midend_serialise(midend *me,
         }
     }
 
+    sfree(sw.line);
 #undef wr
 }
 
+void midend_serialise(midend *me,
+                      void (*write)(void *ctx, void *buf, int len),
+                      void *wctx)
+{
+    midend_serialise_int(me, write, wctx, FALSE);
+}
+
+/*
+ * The same, in the binary form. midend_deserialise reads either. Not
+ * used by the app (see above).
+ */
+void midend_serialise_binary(midend *me,
+                             void (*write)(void *ctx, void *buf, int len),
+                             void *wctx)
+{
+    midend_serialise_int(me, write, wctx, TRUE);
+}
+
 /*
  * This function returns NULL on success, or an error message.
  * Accepts me == null, to identify the game only.
@@ -1658,6 +2260,7 @@ char *midend_deserialise(midend *me,
     int started = FALSE;
     int i;
 
+    struct save_reader sr;
     char *val = NULL;
     /* Initially all errors give the same report */
     char *ret = _("Data does not appear to be a saved game file");
@@ -1675,60 +2278,28 @@ char *midend_deserialise(midend *me,
     game_ui *ui = NULL;
     struct midend_state_entry *states = NULL;
 
+    if (!save_read_start(&sr, read, rctx))
+        goto cleanup;
+
     /*
      * Loop round and round reading one key/value pair at a time
      * from the serialised stream, until we have enough game states
      * to finish.
      */
     while (nstates <= 0 || statepos < 0 || gotstates < nstates-1) {
-        char key[9], c;
-        int len;
+        char key[9];
 
-        do {
-            if (!read(rctx, key, 1)) {
-                /* unexpected EOF */
-                goto cleanup;
-            }
-        } while (key[0] == '\r' || key[0] == '\n');
-
-        if (!read(rctx, key+1, 8)) {
-            /* unexpected EOF */
-            goto cleanup;
-        }
-
-        if (key[8] != ':') {
+        switch (save_read_record(&sr, key, &val, NULL)) {
+          case SAVE_RECORD:
+            break;
+          case SAVE_BADLY_FORMATTED:
             if (started)
                 ret = _("Data was incorrectly formatted for a saved game file");
-	    goto cleanup;
-        }
-        len = strcspn(key, ": ");
-        assert(len <= 8);
-        key[len] = '\0';
-
-        len = 0;
-        while (1) {
-            if (!read(rctx, &c, 1)) {
-                /* unexpected EOF */
-                goto cleanup;
-            }
-
-            if (c == ':') {
-                break;
-            } else if (c >= '0' && c <= '9') {
-                len = (len * 10) + (c - '0');
-            } else {
-                if (started)
-                    ret = _("Data was incorrectly formatted for a saved game file");
-                goto cleanup;
-            }
-        }
-
-        val = snewn(len+1, char);
-        if (!read(rctx, val, len)) {
-            if (started)
+            goto cleanup;
+          default:
+            /* unexpected EOF */
             goto cleanup;
         }
-        val[len] = '\0';
 
         if (!started) {
             if (strcmp(key, "SAVEFILE") || strcmp(val, SERIALISE_MAGIC)) {
@@ -1818,6 +2389,7 @@ char *midend_deserialise(midend *me,
                     states[i].state = NULL;
                     states[i].movestr = NULL;
                     states[i].movetype = NEWGAME;
+                    states[i].checkpoint = NULL;
                 }
             } else if (!strcmp(key, "STATEPOS")) {
                 statepos = atoi(val);
@@ -1836,6 +2408,14 @@ char *midend_deserialise(midend *me,
                 states[gotstates].movetype = RESTART;
                 states[gotstates].movestr = val;
                 val = NULL;
+            } else if (!strcmp(key, "CHECKPT")) {
+                /* Belongs to the move that follows it. */
+                if (states && gotstates+1 < nstates &&
+                    me->ourgame->decode_state) {
+                    sfree(states[gotstates+1].checkpoint);
+                    states[gotstates+1].checkpoint = val;
+                    val = NULL;
+                }
             }
         }
 
@@ -1882,25 +2462,37 @@ char *midend_deserialise(midend *me,
                                             privdesc ? privdesc : desc);
     for (i = 1; i < nstates; i++) {
         assert(states[i].movetype != NEWGAME);
-        switch (states[i].movetype) {
-          case MOVE:
-          case SOLVE:
-            states[i].state = me->ourgame->execute_move(states[i-1].state,
-                                                        states[i].movestr);
-            if (states[i].state == NULL) {
-                ret = _("Save file contained an invalid move");
-                goto cleanup;
-            }
-            break;
-          case RESTART:
+        if (states[i].movetype == RESTART) {
             if (me->ourgame->validate_desc(params, states[i].movestr)) {
                 ret = _("Save file contained an invalid restart move");
                 goto cleanup;
             }
             states[i].state = me->ourgame->new_game(me, params,
                                                     states[i].movestr);
+        }
+    }
+
+    /*
+     * Build the states from the current position onwards, starting
+     * from a checkpoint or a restart if there's one on the way,
+     * which checks each of their moves. The earlier ones wait for
+     * midend_build_state, which checks theirs as undo reaches them,
+     * so that loading doesn't cost more the longer the history is. A
+     * checkpoint we can't decode is dropped and we start further back.
+     */
+    i = (statepos < nstates ? statepos : nstates) - 1;
+    while (1) {
+        int start = midend_replay_start(states, i > 0 ? i : 0, 0);
+        int got = midend_replay(me, states, start, nstates);
+        if (got == nstates)
             break;
+        if (states[got].checkpoint && !states[got-1].state) {
+            sfree(states[got].checkpoint);
+            states[got].checkpoint = NULL;
+            continue;
         }
+        ret = _("Save file contained an invalid move");
+        goto cleanup;
     }
 
     ui = me->ourgame->new_ui(states[0].state);
@@ -1945,6 +2537,8 @@ char *midend_deserialise(midend *me,
         states = tmp;
     }
     me->statepos = statepos;
+    me->undo_floor = 0;
+    midend_trim_states(me);
 
     {
         game_params *tmp;
@@ -1986,6 +2580,7 @@ char *midend_deserialise(midend *me,
 
     cleanup:
     sfree(val);
+    sfree(sr.game);
     sfree(seed);
     sfree(parstr);
     sfree(cparstr);
@@ -2006,6 +2601,7 @@ char *midend_deserialise(midend *me,
             if (states[i].state)
                 me->ourgame->free_game(states[i].state);
             sfree(states[i].movestr);
+            sfree(states[i].checkpoint);
         }
         sfree(states);
     }
@@ -2026,66 +2622,39 @@ char *identify_game(char **name, int (*read)(void *ctx, void *buf, int len),
     int nstates = 0, statepos = -1, gotstates = 0;
     int started = FALSE;
 
+    struct save_reader sr;
     char *val = NULL;
     /* Initially all errors give the same report */
     char *ret = _("Data does not appear to be a saved game file");
 
     *name = NULL;
 
+    if (!save_read_start(&sr, read, rctx))
+        return ret;
+    if (sr.binary) {
+        /* The header has all we need. */
+        *name = sr.game;
+        return NULL;
+    }
+
     /*
      * Loop round and round reading one key/value pair at a time from
      * the serialised stream, until we've found the game name.
      */
     while (nstates <= 0 || statepos < 0 || gotstates < nstates-1) {
-        char key[9], c;
-        int len;
-
-        do {
-            if (!read(rctx, key, 1)) {
-                /* unexpected EOF */
-                goto cleanup;
-            }
-        } while (key[0] == '\r' || key[0] == '\n');
-
-        if (!read(rctx, key+1, 8)) {
-            /* unexpected EOF */
-            goto cleanup;
-        }
+        char key[9];
 
-        if (key[8] != ':') {
+        switch (save_read_record(&sr, key, &val, NULL)) {
+          case SAVE_RECORD:
+            break;
+          case SAVE_BADLY_FORMATTED:
             if (started)
                 ret = _("Data was incorrectly formatted for a saved game file");
-	    goto cleanup;
-        }
-        len = strcspn(key, ": ");
-        assert(len <= 8);
-        key[len] = '\0';
-
-        len = 0;
-        while (1) {
-            if (!read(rctx, &c, 1)) {
-                /* unexpected EOF */
-                goto cleanup;
-            }
-
-            if (c == ':') {
-                break;
-            } else if (c >= '0' && c <= '9') {
-                len = (len * 10) + (c - '0');
-            } else {
-                if (started)
-                    ret = _("Data was incorrectly formatted for a"
-                    " saved game file");
-                goto cleanup;
-            }
-        }
-
-        val = snewn(len+1, char);
-        if (!read(rctx, val, len)) {
-            if (started)
+            goto cleanup;
+          default:
+            /* unexpected EOF */
             goto cleanup;
         }
-        val[len] = '\0';
 
         if (!started) {
             if (strcmp(key, "SAVEFILE") || strcmp(val, SERIALISE_MAGIC)) {
@@ -2118,6 +2687,61 @@ char *identify_game(char **name, int (*read)(void *ctx, void *buf, int len),
     return ret;
 }
 
+/*
+ * Games with fresh random seeds are taken from this pool when it has
+ * one ready. The pool is not owned by the midend.
+ */
+void midend_set_pool(midend *me, puzzle_pool *pool)
+{
+    me->pool = pool;
+}
+
+/*
+ * Generate games with fresh random seeds by racing this many derived
+ * seeds on separate threads. The winning seed is the one recorded, so
+ * it still regenerates the same game on its own.
+ */
+void midend_set_race(midend *me, int nthreads)
+{
+    me->race = nthreads;
+}
+
+/*
+ * Keep only about this many game_states in the undo history (0 means
+ * keep them all); see midend_trim_states. A game_state's size is up
+ * to the game, so the budget is counted in states, not bytes.
+ */
+void midend_set_undo_budget(midend *me, int nstates)
+{
+    me->undo_budget = nstates;
+    midend_trim_states(me);
+}
+
+/*
+ * How much a front end is willing to repaint needlessly for the sake
+ * of fewer, bigger draw_updates; see drawing_set_update_tolerance.
+ */
+void midend_set_update_tolerance(midend *me, float tolerance)
+{
+    if (me->drawing)
+	drawing_set_update_tolerance(me->drawing, tolerance);
+}
+
+/*
+ * How long the undo history is, and how many of its game_states are
+ * actually held at the moment.
+ */
+void midend_undo_stats(midend *me, int *nstates, int *nheld)
+{
+    int i;
+
+    *nstates = me->nstates;
+    *nheld = 0;
+    for (i = 0; i < me->nstates; i++)
+        if (me->states[i].state)
+            (*nheld)++;
+}
+
 void midend_android_cursor_visibility(midend *me, int visible)
 {
     if (!me->ourgame->android_cursor_visibility) return;
@@ -335,7 +335,7 @@ struct setstore {
 static struct setstore *ss_new(void)
 {
     struct setstore *ss = snew(struct setstore);
-    ss->sets = newtree234(setcmp);
+    ss->sets = newpooltree234(setcmp);
     ss->todo_head = ss->todo_tail = NULL;
     return ss;
 }
@@ -495,6 +495,7 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
     for (xx = x-3; xx < x+3; xx++)
 	for (yy = y-3; yy < y+3; yy++) {
 	    struct set stmp, *s;
+	    iter234 it;
 	    int pos;
 
 	    /*
@@ -505,8 +506,8 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
 	    stmp.mask = 0;
 
 	    if (findrelpos234(ss->sets, &stmp, NULL, REL234_GE, &pos)) {
-		while ((s = index234(ss->sets, pos)) != NULL &&
-		       s->x == xx && s->y == yy) {
+		for (s = iterpos234(ss->sets, pos, &it);
+		     s && s->x == xx && s->y == yy; s = next234(&it)) {
 		    /*
 		     * This set potentially overlaps the input one.
 		     * Compute the intersection to see if they
@@ -523,8 +524,6 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
 			}
 			ret[nret++] = s;
 		    }
-
-		    pos++;
 		}
 	    }
 	}
@@ -1290,7 +1289,8 @@ static int minesolve(int w, int h, int n, signed char *grid,
      */
     {
 	struct set *s;
-	while ((s = delpos234(ss->sets, 0)) != NULL)
+	iter234 it;
+	for (s = first234(ss->sets, &it); s; s = next234(&it))
 	    sfree(s);
 	freetree234(ss->sets);
 	sfree(ss);
@@ -1394,6 +1394,7 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 
     if (!mask && !ctx->allow_big_perturbs)
 	return NULL;
+    PROFILE_COUNT("mines.perturb");
 
     /*
      * Make a list of all the squares in the grid which we can
@@ -1737,6 +1738,12 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 	success = FALSE;
 	ntries++;
 
+	if (random_cancelled(rs)) {
+	    sfree(ret);
+	    return NULL;
+	}
+	PROFILE_COUNT("mines.layouts");
+
 	memset(ret, 0, w*h);
 
 	/*
@@ -1817,8 +1824,10 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		solvegrid[y*w+x] = mineopen(ctx, x, y);
 		assert(solvegrid[y*w+x] == 0); /* by deliberate arrangement */
 
+		PROFILE_BEGIN("mines.solve");
 		solveret =
 		    minesolve(w, h, n, solvegrid, mineopen, mineperturb, ctx, rs);
+		PROFILE_END("mines.solve");
 		if (solveret < 0 || (prevret >= 0 && solveret >= prevret)) {
 		    success = FALSE;
 		    break;
@@ -1950,7 +1959,7 @@ static char *new_mine_layout(int w, int h, int n, int x, int y, int unique,
     grid = minegen(w, h, n, x, y, unique, rs);
 
     if (game_desc)
-        *game_desc = describe_layout(grid, w * h, x, y, TRUE);
+        *game_desc = grid ? describe_layout(grid, w * h, x, y, TRUE) : NULL;
 
     return grid;
 }
@@ -1982,7 +1991,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 	grid = new_mine_layout(params->w, params->h, params->n,
 			       x, y, params->unique, rs, &desc);
 	sfree(grid);
-	return desc;
+	return desc;		       /* NULL if cancelled */
     } else {
 	char *rsdesc, *desc;
 
@@ -3193,6 +3202,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     TRUE, game_timing_state,
     BUTTON_BEATS(LEFT_BUTTON, RIGHT_BUTTON) | REQUIRE_RBUTTON,
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_OBFUSCATOR
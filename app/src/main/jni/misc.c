@@ -9,6 +9,54 @@
 
 #include "puzzles.h"
 
+/*
+ * Make up a new random seed for a game. 15 digits comes to about 48
+ * bits, which should be more than enough.
+ *
+ * I'll avoid putting a leading zero on the number, just in case it
+ * confuses anybody who thinks it's processed as an integer rather
+ * than a string. The prefix picks the fast random number generator
+ * for the new game.
+ */
+char *new_seed_string(random_state *rs)
+{
+    char newseed[16 + sizeof(RANDOM_FAST_PREFIX)];
+    unsigned long digits[14];
+    int i, len;
+
+    len = sprintf(newseed, "%s", RANDOM_FAST_PREFIX);
+    newseed[len] = '1' + (char)random_upto(rs, 9);
+    random_upto_many(rs, 10, digits, 14);
+    for (i = 1; i < 15; i++)
+        newseed[len + i] = '0' + (char)digits[i-1];
+    newseed[len + 15] = '\0';
+    return dupstr(newseed);
+}
+
+void serialise_buf_write(void *ctx, void *buf, int len)
+{
+    struct serialise_buf *sb = (struct serialise_buf *)ctx;
+
+    if (sb->len + len > sb->size) {
+        sb->size = (sb->len + len) * 5 / 4 + 1024;
+        sb->buf = sresize(sb->buf, sb->size, char);
+    }
+    memcpy(sb->buf + sb->len, buf, len);
+    sb->len += len;
+}
+
+int mem_read(void *ctx, void *buf, int len)
+{
+    struct mem_read *mr = (struct mem_read *)ctx;
+
+    if (len < 0 || len > mr->len)
+        return FALSE;
+    memcpy(buf, mr->p, len);
+    mr->p += len;
+    mr->len -= len;
+    return TRUE;
+}
+
 void free_cfg(config_item *cfg)
 {
     config_item *i;
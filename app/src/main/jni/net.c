@@ -1696,6 +1696,65 @@ static void free_game(game_state *state)
     sfree(state);
 }
 
+/*
+ * A checkpoint for the save file: the flags, the last rotation (which
+ * the next one depends on for drawing) and the tiles in hex. The
+ * barriers never change, so they come from the initial state.
+ */
+static char *encode_state(const game_state *state)
+{
+    char buf[80], *hex, *ret;
+
+    sprintf(buf, "%d,%d,%d,%d,%d,", state->completed, state->used_solve,
+            state->last_rotate_x, state->last_rotate_y,
+            state->last_rotate_dir);
+    hex = bin2hex(state->tiles, state->width * state->height);
+    ret = snewn(strlen(buf) + strlen(hex) + 1, char);
+    sprintf(ret, "%s%s", buf, hex);
+    sfree(hex);
+    return ret;
+}
+
+static game_state *decode_state(const game_state *base, const char *encoding)
+{
+    int wh = base->width * base->height;
+    int completed, used_solve, lx, ly, ldir, i, n = 0;
+    unsigned char *tiles;
+    game_state *ret;
+
+    if (sscanf(encoding, "%d,%d,%d,%d,%d,%n", &completed, &used_solve,
+               &lx, &ly, &ldir, &n) < 5 || n == 0 ||
+        strlen(encoding + n) != (size_t)wh * 2 ||
+        lx < 0 || lx >= base->width || ly < 0 || ly >= base->height ||
+        ldir < -1 || ldir > 2)
+        return NULL;
+    tiles = hex2bin(encoding + n, wh);
+
+    /*
+     * Each tile can only have been rotated and perhaps locked, so it
+     * must be the initial one turned some way, with no other bits.
+     */
+    for (i = 0; i < wh; i++) {
+        int t = tiles[i] & 0xF, orig = base->tiles[i] & 0xF;
+
+        if ((tiles[i] & ~(0xF | LOCKED)) ||
+            (t != orig && t != A(orig) && t != C(orig) && t != F(orig))) {
+            sfree(tiles);
+            return NULL;
+        }
+    }
+
+    ret = dup_game(base);
+    ret->completed = completed;
+    ret->used_solve = used_solve;
+    ret->last_rotate_x = lx;
+    ret->last_rotate_y = ly;
+    ret->last_rotate_dir = ldir;
+    memcpy(ret->tiles, tiles, wh);
+    sfree(tiles);
+    return ret;
+}
+
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *aux, char **error)
 {
@@ -3078,4 +3137,5 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    encode_state, decode_state,
 };
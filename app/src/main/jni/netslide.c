@@ -1910,6 +1910,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 /* vim: set shiftwidth=4 tabstop=8: */
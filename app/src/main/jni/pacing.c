@@ -0,0 +1,103 @@
+/*
+ * pacing.c: decide which timer ticks to draw an animation frame on.
+ *
+ * midend_timer already moves animations on by however long it was
+ * told has passed, so a slow frame never makes the ones after it
+ * late. But a front end that ticks on every display refresh will
+ * still ask for a frame on every one of them, and if frames of this
+ * game take longer than that to draw, it spends all its time drawing
+ * positions that are stale before they reach the screen, with
+ * nothing left over for input or for the display itself.
+ *
+ * So we keep an average of how long this game's frames have been
+ * taking, and when that's more than a tick, let that many ticks go
+ * by after each frame before drawing another. (Ticks that came while
+ * the frame was being drawn were missed anyway, so this leaves about
+ * as much time free again as was spent drawing.) The time from the
+ * ticks let go by is kept and passed to midend_timer with the next
+ * tick that draws, so the animation still keeps time; it just has
+ * fewer intermediate positions. We also keep statistics on frame
+ * times, so that it's possible to see which animations are janky.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "puzzles.h"
+
+/* Weight of the newest frame in the average cost. */
+#define COST_WEIGHT 0.25
+/* Never draw less often than this many ticks. */
+#define MAX_WAIT 3
+
+void pacer_init(struct frame_pacer *fp, double interval)
+{
+    memset(fp, 0, sizeof(*fp));
+    fp->interval = interval;
+}
+
+/*
+ * The ticks have started again: forget time owed from before, but
+ * not what we've learnt about the game's frames.
+ */
+void pacer_start(struct frame_pacer *fp)
+{
+    fp->pending = 0;
+    fp->wait = 0;
+}
+
+int pacer_tick(struct frame_pacer *fp, double interval, double elapsed,
+               double *tplus)
+{
+    if (interval > 0)
+        fp->interval = interval;
+    if (elapsed > 0)
+        fp->pending += elapsed;
+    if (fp->wait > 0) {
+        fp->wait--;
+        fp->stats.skipped++;
+        return FALSE;
+    }
+    *tplus = fp->pending;
+    fp->pending = 0;
+    return TRUE;
+}
+
+void pacer_frame(struct frame_pacer *fp, double cost)
+{
+    struct frame_stats *st = &fp->stats;
+    int wait;
+
+    st->frames++;
+    st->total += cost;
+    if (cost > st->worst)
+        st->worst = cost;
+    if (fp->interval > 0 && cost > fp->interval)
+        st->overruns++;
+
+    fp->cost = (fp->cost > 0 ? fp->cost * (1 - COST_WEIGHT) +
+                cost * COST_WEIGHT : cost);
+    if (fp->interval <= 0)
+        return;
+    wait = (int)ceil(fp->cost / fp->interval) - 1;
+    fp->wait = max(0, min(wait, MAX_WAIT));
+}
+
+/*
+ * A line describing the frames since the statistics were last
+ * reset, and reset them.
+ */
+char *pacer_stats(struct frame_pacer *fp)
+{
+    struct frame_stats *st = &fp->stats;
+    char buf[160];
+
+    sprintf(buf, "%d frames, %d ticks skipped, %d over %.1fms;"
+            " mean %.1fms, worst %.1fms", st->frames, st->skipped,
+            st->overruns, fp->interval * 1000,
+            st->frames ? st->total / st->frames * 1000 : 0.0,
+            st->worst * 1000);
+    memset(st, 0, sizeof(*st));
+    return dupstr(buf);
+}
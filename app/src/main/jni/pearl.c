@@ -316,6 +316,7 @@ int pearl_solve(int w, int h, char *clues, char *result,
      * Initially, all edges are unknown, except the ones around the
      * grid border which are known to be disconnected.
      */
+    PROFILE_BEGIN("pearl.solve");
     workspace = snewn(W*H, short);
     for (x = 0; x < W*H; x++)
 	workspace[x] = 0;
@@ -861,6 +862,7 @@ cleanup:
     sfree(dsfsize);
     sfree(dsf);
     sfree(workspace);
+    PROFILE_END("pearl.solve");
     assert(ret >= 0);
     return ret;
 }
@@ -1173,8 +1175,13 @@ static int new_clues(const game_params *params, random_state *rs,
         diff = DIFF_EASY;
 
     while (1) {
+        if (random_cancelled(rs))
+            return 0;		       /* no puzzle at all */
         ngen++;
+        PROFILE_COUNT("pearl.loops");
+	PROFILE_BEGIN("pearl.loopgen");
 	pearl_loopgen(w, h, grid, rs);
+	PROFILE_END("pearl.loopgen");
 
 #ifdef GENERATION_DIAGNOSTICS
 	printf("grid array:\n");
@@ -1255,8 +1262,10 @@ static int new_clues(const game_params *params, random_state *rs,
              */
             ret = pearl_solve(w, h, clues, grid, diff, FALSE);
             assert(ret > 0);	       /* shouldn't be inconsistent! */
-            if (ret != 1)
+            if (ret != 1) {
+                PROFILE_COUNT("pearl.too_hard");
                 continue;		       /* go round and try again */
+            }
 
             /*
              * Check this puzzle isn't too easy.
@@ -1264,8 +1273,10 @@ static int new_clues(const game_params *params, random_state *rs,
             if (diff > DIFF_EASY) {
                 ret = pearl_solve(w, h, clues, grid, diff-1, FALSE);
                 assert(ret > 0);
-                if (ret == 1)
+                if (ret == 1) {
+                    PROFILE_COUNT("pearl.too_easy");
                     continue; /* too easy: try again */
+                }
             }
 
             /*
@@ -1299,6 +1310,7 @@ static int new_clues(const game_params *params, random_state *rs,
             nstraights = nstraightpos;
             ncorners = ncornerpos;
 
+            PROFILE_BEGIN("pearl.remove_clues");
             shuffle(straights, nstraightpos, sizeof(*straights), rs);
             shuffle(corners, ncornerpos, sizeof(*corners), rs);
             while (nstraightpos > 0 || ncornerpos > 0) {
@@ -1334,6 +1346,7 @@ static int new_clues(const game_params *params, random_state *rs,
                 if (ret != 1)
                     clues[y*w+x] = clue;   /* oops, put it back again */
             }
+            PROFILE_END("pearl.remove_clues");
             sfree(cluespace);
         }
 
@@ -1366,7 +1379,11 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     grid = snewn(w*h, char);
     clues = snewn(w*h, char);
 
-    new_clues(params, rs, clues, grid);
+    if (!new_clues(params, rs, clues, grid)) {
+        sfree(grid);
+        sfree(clues);
+        return NULL;		       /* cancelled */
+    }
 
     desc = snewn(w * h + 1, char);
     for (i = j = 0; i < w*h; i++) {
@@ -2571,6 +2588,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
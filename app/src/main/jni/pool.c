@@ -0,0 +1,587 @@
+/*
+ * pool.c: a bounded store of ready-made game descriptions, so that
+ * presets whose generators are slow can be started instantly.
+ *
+ * Entries are kept per (game, fully encoded parameters, interactive
+ * flag). Each entry holds the random seed it was generated from as
+ * well as the description and aux_info, so a game taken from the pool
+ * is indistinguishable from one generated on the spot: its seed still
+ * regenerates exactly the same puzzle.
+ *
+ * A background thread at low priority tops up whichever keys have
+ * been asked for recently. The whole pool can be written to and read
+ * back from a file using the same record format as saved games;
+ * entries from a different save format version, or whose parameters
+ * no longer encode to the same string, are discarded on loading.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#include "puzzles.h"
+
+#define POOL_MAGIC "Simon Tatham's Portable Puzzle Collection pool"
+#define POOL_VERSION "1"
+
+/* Rough per-entry overhead counted against the memory cap. */
+#define ENTRY_OVERHEAD 64
+
+/* Never keep more keys than this, however small their entries. */
+#define MAX_KEYS 32
+
+struct pool_entry {
+    char *seed, *desc, *aux;
+    int size;
+};
+
+struct pool_key {
+    const game *game;
+    char *params;                      /* encode_params(params, TRUE) */
+    int interactive;
+    struct pool_entry *entries;        /* oldest first */
+    int nentries;
+    unsigned long lastused;
+};
+
+struct puzzle_pool {
+    int maxper, maxbytes, bytes;
+    struct pool_key *keys;
+    int nkeys;
+    unsigned long clock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t refiller;
+    int refilling;
+    volatile int quit;                 /* also cancels generation */
+
+    void (*changed)(void *ctx);
+    void *changed_ctx;
+};
+
+puzzle_pool *pool_new(int maxper, int maxbytes)
+{
+    puzzle_pool *pool = snew(puzzle_pool);
+
+    pool->maxper = maxper;
+    pool->maxbytes = maxbytes;
+    pool->bytes = 0;
+    pool->keys = snewn(MAX_KEYS, struct pool_key);
+    pool->nkeys = 0;
+    pool->clock = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    pool->refilling = pool->quit = FALSE;
+    pool->changed = NULL;
+    pool->changed_ctx = NULL;
+
+    return pool;
+}
+
+static void free_entry(struct pool_entry *e)
+{
+    sfree(e->seed);
+    sfree(e->desc);
+    sfree(e->aux);
+}
+
+/* Drop the oldest entry of a key. Caller holds the lock. */
+static void drop_oldest(puzzle_pool *pool, struct pool_key *k)
+{
+    assert(k->nentries > 0);
+    pool->bytes -= k->entries[0].size;
+    free_entry(&k->entries[0]);
+    memmove(k->entries, k->entries + 1,
+            (k->nentries - 1) * sizeof(struct pool_entry));
+    k->nentries--;
+}
+
+static void remove_key(puzzle_pool *pool, int i)
+{
+    struct pool_key *k = &pool->keys[i];
+
+    while (k->nentries > 0)
+        drop_oldest(pool, k);
+    sfree(k->entries);
+    sfree(k->params);
+    pool->keys[i] = pool->keys[--pool->nkeys];
+}
+
+void pool_free(puzzle_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->quit, TRUE, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+    if (pool->refilling)
+        pthread_join(pool->refiller, NULL);
+
+    while (pool->nkeys > 0)
+        remove_key(pool, pool->nkeys - 1);
+    sfree(pool->keys);
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+    sfree(pool);
+}
+
+void pool_set_changed_callback(puzzle_pool *pool,
+                               void (*changed)(void *ctx), void *ctx)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->changed = changed;
+    pool->changed_ctx = ctx;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Find the key for these parameters, creating it (and evicting the
+ * least recently used key if there are too many) if 'create' is set.
+ * Caller holds the lock.
+ */
+static struct pool_key *find_key(puzzle_pool *pool, const game *g,
+                                 const char *params, int interactive,
+                                 int create)
+{
+    struct pool_key *k;
+    int i;
+
+    for (i = 0; i < pool->nkeys; i++) {
+        k = &pool->keys[i];
+        if (k->game == g && k->interactive == interactive &&
+            !strcmp(k->params, params))
+            return k;
+    }
+
+    if (!create)
+        return NULL;
+
+    if (pool->nkeys == MAX_KEYS) {
+        int lru = 0;
+        for (i = 1; i < pool->nkeys; i++)
+            if (pool->keys[i].lastused < pool->keys[lru].lastused)
+                lru = i;
+        remove_key(pool, lru);
+    }
+
+    k = &pool->keys[pool->nkeys++];
+    k->game = g;
+    k->params = dupstr(params);
+    k->interactive = interactive;
+    k->entries = snewn(pool->maxper, struct pool_entry);
+    k->nentries = 0;
+    k->lastused = pool->clock;
+    return k;
+}
+
+/*
+ * Add an entry to a key, then evict entries until we're back under
+ * the memory cap: oldest entries first, from the least recently used
+ * key other than this one where possible. Caller holds the lock.
+ */
+static void add_entry(puzzle_pool *pool, struct pool_key *k,
+                      char *seed, char *desc, char *aux)
+{
+    struct pool_entry *e;
+
+    if (k->nentries == pool->maxper)
+        drop_oldest(pool, k);
+
+    e = &k->entries[k->nentries++];
+    e->seed = seed;
+    e->desc = desc;
+    e->aux = aux;
+    e->size = ENTRY_OVERHEAD + strlen(seed) + strlen(desc) +
+        (aux ? strlen(aux) : 0);
+    pool->bytes += e->size;
+
+    while (pool->bytes > pool->maxbytes) {
+        struct pool_key *victim = NULL;
+        int i;
+
+        for (i = 0; i < pool->nkeys; i++) {
+            struct pool_key *ki = &pool->keys[i];
+            if (ki != k && ki->nentries > 0 &&
+                (!victim || ki->lastused < victim->lastused))
+                victim = ki;
+        }
+        if (!victim) {
+            if (k->nentries == 0)
+                break;
+            victim = k;
+        }
+        drop_oldest(pool, victim);
+    }
+}
+
+void pool_add(puzzle_pool *pool, const game *g, const game_params *params,
+              int interactive, const char *seed, const char *desc,
+              const char *aux)
+{
+    char *encoded = g->encode_params(params, TRUE);
+    struct pool_key *k;
+
+    pthread_mutex_lock(&pool->lock);
+    k = find_key(pool, g, encoded, interactive, TRUE);
+    add_entry(pool, k, dupstr(seed), dupstr(desc), aux ? dupstr(aux) : NULL);
+    pthread_mutex_unlock(&pool->lock);
+
+    sfree(encoded);
+}
+
+int pool_take(puzzle_pool *pool, const game *g, const game_params *params,
+              int interactive, char **seed, char **desc, char **aux)
+{
+    char *encoded = g->encode_params(params, TRUE);
+    struct pool_key *k;
+    int ret = FALSE;
+
+    pthread_mutex_lock(&pool->lock);
+    /*
+     * A miss still registers the key, so that the refill thread starts
+     * generating for these parameters in case they're asked for again.
+     */
+    k = find_key(pool, g, encoded, interactive, TRUE);
+    k->lastused = ++pool->clock;
+    if (k->nentries > 0) {
+        /* Hand over the oldest entry; ownership of its strings passes
+         * to the caller. */
+        struct pool_entry *e = &k->entries[0];
+        *seed = e->seed;
+        *desc = e->desc;
+        *aux = e->aux;
+        pool->bytes -= e->size;
+        memmove(k->entries, k->entries + 1,
+                (k->nentries - 1) * sizeof(struct pool_entry));
+        k->nentries--;
+        ret = TRUE;
+    }
+    pthread_cond_broadcast(&pool->wakeup);
+    if (ret && pool->changed) {
+        /* The entry must not be handed out again after a restart. */
+        void (*changed)(void *) = pool->changed;
+        void *ctx = pool->changed_ctx;
+        pthread_mutex_unlock(&pool->lock);
+        changed(ctx);
+    } else {
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    sfree(encoded);
+    return ret;
+}
+
+int pool_count(puzzle_pool *pool, const game *g, const game_params *params,
+               int interactive)
+{
+    char *encoded = g->encode_params(params, TRUE);
+    struct pool_key *k;
+    int ret;
+
+    pthread_mutex_lock(&pool->lock);
+    k = find_key(pool, g, encoded, interactive, FALSE);
+    ret = k ? k->nentries : 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    sfree(encoded);
+    return ret;
+}
+
+static void *refill_thread(void *vpool)
+{
+    puzzle_pool *pool = (puzzle_pool *)vpool;
+    random_state *seeds;
+    void *randseed;
+    int randseedsize;
+
+#ifdef __linux__
+    /* Only this thread: Linux priorities are per task. */
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+
+    get_random_seed(&randseed, &randseedsize);
+    seeds = random_new(randseed, randseedsize);
+    sfree(randseed);
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit) {
+        struct pool_key *k = NULL;
+        const game *g;
+        game_params *params;
+        char *seed, *desc, *aux = NULL, *err;
+        int interactive, i;
+        random_state *rs;
+
+        /* Top up the most recently used key that isn't full. */
+        for (i = 0; i < pool->nkeys; i++) {
+            struct pool_key *ki = &pool->keys[i];
+            if (ki->nentries < pool->maxper &&
+                (!k || ki->lastused > k->lastused))
+                k = ki;
+        }
+        if (!k) {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+            continue;
+        }
+
+        g = k->game;
+        interactive = k->interactive;
+        params = g->default_params();
+        g->decode_params(params, k->params);
+        seed = new_seed_string(seeds);
+        pthread_mutex_unlock(&pool->lock);
+
+        err = g->validate_params(params, TRUE);
+        if (err) {
+            /* Shouldn't happen, since keys come from real games; stop
+             * trying these parameters. */
+            desc = NULL;
+        } else {
+            rs = random_new_seed(seed);
+            random_set_cancel(rs, &pool->quit);
+            desc = g->new_desc(params, rs, &aux, interactive);
+            random_free(rs);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        /* The key may have been evicted while we were generating. */
+        {
+            char *encoded = g->encode_params(params, TRUE);
+            k = find_key(pool, g, encoded, interactive, desc != NULL);
+            sfree(encoded);
+        }
+        g->free_params(params);
+        if (!desc && pool->quit) {
+            sfree(seed);
+            break;
+        }
+        if (!desc) {
+            if (k)
+                remove_key(pool, k - pool->keys);
+            sfree(seed);
+            continue;
+        }
+        add_entry(pool, k, seed, desc, aux);
+        if (pool->changed) {
+            void (*changed)(void *) = pool->changed;
+            void *ctx = pool->changed_ctx;
+            pthread_mutex_unlock(&pool->lock);
+            changed(ctx);
+            pthread_mutex_lock(&pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    random_free(seeds);
+    return NULL;
+}
+
+void pool_start_refill(puzzle_pool *pool)
+{
+    if (pool->refilling)
+        return;
+    if (pthread_create(&pool->refiller, NULL, refill_thread, pool) == 0)
+        pool->refilling = TRUE;
+}
+
+/* ----------------------------------------------------------------------
+ * Saving and loading.
+ */
+
+void pool_save(puzzle_pool *pool,
+               void (*write)(void *ctx, void *buf, int len), void *wctx)
+{
+    int i, j;
+
+#define wr(h,s) do { \
+    char hbuf[80]; \
+    const char *str = (s); \
+    sprintf(hbuf, "%-8.8s:%d:", (h), (int)strlen(str)); \
+    write(wctx, hbuf, strlen(hbuf)); \
+    write(wctx, (void *)str, strlen(str)); \
+    write(wctx, "\n", 1); \
+} while (0)
+
+    pthread_mutex_lock(&pool->lock);
+
+    wr("POOLFILE", POOL_MAGIC);
+    wr("VERSION", POOL_VERSION "/" SERIALISE_VERSION);
+
+    for (i = 0; i < pool->nkeys; i++) {
+        struct pool_key *k = &pool->keys[i];
+
+        if (k->nentries == 0)
+            continue;
+        wr("GAME", k->game->name);
+        wr("PARAMS", k->params);
+        wr("INTERACT", k->interactive ? "1" : "0");
+        for (j = 0; j < k->nentries; j++) {
+            wr("SEED", k->entries[j].seed);
+            if (k->entries[j].aux)
+                wr("AUXINFO", k->entries[j].aux);
+            wr("DESC", k->entries[j].desc);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+#undef wr
+}
+
+/*
+ * Read one key/value record in saved-game format. Returns FALSE at
+ * end of data or on a malformed record. The length comes from the
+ * file, so rather than allocate it all up front we grow the value as
+ * it arrives, and a bogus length runs out of data first.
+ */
+#define READ_CHUNK 4096
+
+static int read_record(int (*read)(void *ctx, void *buf, int len),
+                       void *rctx, char key[9], char **val)
+{
+    char c;
+    int len, got, size, n;
+
+    do {
+        if (!read(rctx, key, 1))
+            return FALSE;
+    } while (key[0] == '\r' || key[0] == '\n');
+    if (!read(rctx, key+1, 8) || key[8] != ':')
+        return FALSE;
+    key[strcspn(key, ": ")] = '\0';
+
+    len = 0;
+    while (1) {
+        if (!read(rctx, &c, 1))
+            return FALSE;
+        if (c == ':')
+            break;
+        else if (c >= '0' && c <= '9' && len <= (INT_MAX - 9) / 10)
+            len = (len * 10) + (c - '0');
+        else
+            return FALSE;
+    }
+
+    size = min(len, READ_CHUNK);
+    *val = snewn(size+1, char);
+    for (got = 0; got < len; got += n) {
+        n = min(len - got, READ_CHUNK);
+        if (got + n > size) {
+            size = max(size < len / 2 ? size * 2 : len, got + n);
+            *val = sresize(*val, size+1, char);
+        }
+        if (!read(rctx, *val + got, n)) {
+            sfree(*val);
+            return FALSE;
+        }
+    }
+    (*val)[len] = '\0';
+    return TRUE;
+}
+
+/*
+ * Entries we can't use are silently dropped; only a file that isn't
+ * a pool at all, or is from another version, gives an error.
+ */
+char *pool_load(puzzle_pool *pool,
+                int (*read)(void *ctx, void *buf, int len), void *rctx)
+{
+    char key[9], *val = NULL;
+    const game *g = NULL;
+    game_params *params = NULL;
+    struct pool_key *k = NULL;
+    char *parstr = NULL, *seed = NULL, *aux = NULL;
+
+    if (!read_record(read, rctx, key, &val) || strcmp(key, "POOLFILE") ||
+        strcmp(val, POOL_MAGIC)) {
+        sfree(val);
+        return "Data does not appear to be a puzzle pool";
+    }
+    sfree(val);
+    if (!read_record(read, rctx, key, &val) || strcmp(key, "VERSION") ||
+        strcmp(val, POOL_VERSION "/" SERIALISE_VERSION)) {
+        sfree(val);
+        return "Puzzle pool is from a different version";
+    }
+    sfree(val);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (read_record(read, rctx, key, &val)) {
+        if (!strcmp(key, "GAME")) {
+            int i;
+
+            if (params)
+                g->free_params(params);
+            params = NULL;
+            k = NULL;
+            sfree(parstr);
+            parstr = NULL;
+            g = NULL;
+#ifdef COMBINED
+            for (i = 0; i < gamecount; i++)
+                if (!strcmp(gamelist[i]->name, val))
+                    g = gamelist[i];
+#else
+            if (!strcmp(thegame.name, val))
+                g = &thegame;
+#endif
+        } else if (!strcmp(key, "PARAMS") && g) {
+            sfree(parstr);
+            parstr = val;
+            val = NULL;
+        } else if (!strcmp(key, "INTERACT") && g && parstr) {
+            char *encoded;
+            int ok;
+
+            if (params)
+                g->free_params(params);
+            /*
+             * Discard the lot if the parameters no longer round-trip:
+             * the game's parameter encoding must have changed.
+             */
+            params = g->default_params();
+            g->decode_params(params, parstr);
+            encoded = g->encode_params(params, TRUE);
+            ok = !strcmp(encoded, parstr) &&
+                !g->validate_params(params, TRUE);
+            sfree(encoded);
+            k = ok ? find_key(pool, g, parstr, atoi(val) != 0, TRUE) : NULL;
+        } else if (!strcmp(key, "SEED") && k) {
+            sfree(seed);
+            sfree(aux);
+            seed = val;
+            aux = NULL;
+            val = NULL;
+        } else if (!strcmp(key, "AUXINFO") && k && seed) {
+            sfree(aux);
+            aux = val;
+            val = NULL;
+        } else if (!strcmp(key, "DESC") && k && seed) {
+            if (!g->validate_desc(params, val)) {
+                add_entry(pool, k, seed, val, aux);
+                val = NULL;
+            } else {
+                sfree(seed);
+                sfree(aux);
+            }
+            seed = aux = NULL;
+        }
+        sfree(val);
+        val = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (params)
+        g->free_params(params);
+    sfree(parstr);
+    sfree(seed);
+    sfree(aux);
+    return NULL;
+}
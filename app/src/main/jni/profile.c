@@ -0,0 +1,203 @@
+/*
+ * profile.c: named counters and timers for generator instrumentation.
+ *
+ * Everything goes in one table, keyed by the name pointer (names are
+ * string literals, so the same name from the same file is the same
+ * pointer; we fall back to strcmp to merge the rest). Timers are
+ * started and stopped on a per-thread stack, so that generators
+ * running on several threads at once each time their own phases.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "puzzles.h"
+
+#ifdef PROFILING
+
+#define MAX_ENTRIES 256
+#define MAX_DEPTH 32
+
+struct profile_entry {
+    const char *name;
+    unsigned long calls;
+    double total;                      /* seconds; -1 for a counter */
+};
+
+struct profile_stack {
+    int depth;
+    const char *names[MAX_DEPTH];
+    double starts[MAX_DEPTH];
+};
+
+static int profiling = FALSE;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct profile_entry entries[MAX_ENTRIES];
+static int nentries = 0;
+
+static pthread_once_t stack_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stack_key;
+
+static double profile_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void free_stack(void *stack)
+{
+    sfree(stack);
+}
+
+static void make_stack_key(void)
+{
+    pthread_key_create(&stack_key, free_stack);
+}
+
+static struct profile_stack *get_stack(void)
+{
+    struct profile_stack *stack;
+
+    pthread_once(&stack_once, make_stack_key);
+    stack = pthread_getspecific(stack_key);
+    if (!stack) {
+        stack = snew(struct profile_stack);
+        stack->depth = 0;
+        pthread_setspecific(stack_key, stack);
+    }
+    return stack;
+}
+
+/* Add to a table entry, creating it if need be. */
+static void profile_add(const char *name, double seconds)
+{
+    int i;
+
+    pthread_mutex_lock(&profile_lock);
+    for (i = 0; i < nentries; i++)
+        if (entries[i].name == name || !strcmp(entries[i].name, name))
+            break;
+    if (i == nentries) {
+        if (nentries == MAX_ENTRIES) {
+            pthread_mutex_unlock(&profile_lock);
+            return;
+        }
+        entries[i].name = name;
+        entries[i].calls = 0;
+        entries[i].total = -1;
+        nentries++;
+    }
+    entries[i].calls++;
+    if (seconds >= 0)
+        entries[i].total = (entries[i].total < 0 ? 0 : entries[i].total) +
+            seconds;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void profile_count(const char *name)
+{
+    if (!__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+        return;
+    profile_add(name, -1);
+}
+
+void profile_begin(const char *name)
+{
+    struct profile_stack *stack;
+
+    if (!__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+        return;
+    stack = get_stack();
+    if (stack->depth < MAX_DEPTH) {
+        stack->names[stack->depth] = name;
+        stack->starts[stack->depth] = profile_now();
+    }
+    stack->depth++;
+}
+
+void profile_end(const char *name)
+{
+    struct profile_stack *stack;
+    double start;
+
+    if (!__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+        return;
+    stack = get_stack();
+    /*
+     * Profiling may have been switched on part way through a timed
+     * phase, in which case there's nothing to match.
+     */
+    if (stack->depth == 0)
+        return;
+    stack->depth--;
+    if (stack->depth >= MAX_DEPTH)
+        return;
+    assert(stack->names[stack->depth] == name ||
+           !strcmp(stack->names[stack->depth], name));
+    start = stack->starts[stack->depth];
+    profile_add(name, profile_now() - start);
+}
+
+int profile_enable(int enable)
+{
+    __atomic_store_n(&profiling, enable, __ATOMIC_RELAXED);
+    return TRUE;
+}
+
+void profile_reset(void)
+{
+    pthread_mutex_lock(&profile_lock);
+    nentries = 0;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+static int compare_entries(const void *av, const void *bv)
+{
+    const struct profile_entry *a = (const struct profile_entry *)av;
+    const struct profile_entry *b = (const struct profile_entry *)bv;
+    return strcmp(a->name, b->name);
+}
+
+void profile_dump(FILE *fp)
+{
+    struct profile_entry *copy;
+    int n, i;
+
+    pthread_mutex_lock(&profile_lock);
+    n = nentries;
+    copy = snewn(n ? n : 1, struct profile_entry);
+    memcpy(copy, entries, n * sizeof(struct profile_entry));
+    pthread_mutex_unlock(&profile_lock);
+
+    qsort(copy, n, sizeof(struct profile_entry), compare_entries);
+    for (i = 0; i < n; i++) {
+        if (copy[i].total < 0)
+            fprintf(fp, "%s\t%lu\t\n", copy[i].name, copy[i].calls);
+        else
+            fprintf(fp, "%s\t%lu\t%.3f\n", copy[i].name, copy[i].calls,
+                    copy[i].total * 1000);
+    }
+    sfree(copy);
+}
+
+#else
+
+int profile_enable(int enable)
+{
+    return FALSE;
+}
+
+void profile_reset(void)
+{
+}
+
+void profile_dump(FILE *fp)
+{
+}
+
+#endif
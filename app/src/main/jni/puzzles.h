@@ -102,6 +102,8 @@ typedef struct document document;
 typedef struct drawing_api drawing_api;
 typedef struct drawing drawing;
 typedef struct psdata psdata;
+typedef struct puzzle_pool puzzle_pool;
+typedef struct raster raster;
 
 #define ALIGN_VNORMAL 0x000
 #define ALIGN_VCENTRE 0x100
@@ -200,6 +202,7 @@ void clip(drawing *dr, int x, int y, int w, int h);
 void unclip(drawing *dr);
 void start_draw(drawing *dr);
 void draw_update(drawing *dr, int x, int y, int w, int h);
+void drawing_set_update_tolerance(drawing *dr, float tolerance);
 void end_draw(drawing *dr);
 char *text_fallback(drawing *dr, const char *const *strings, int nstrings);
 void status_bar(drawing *dr, char *text);
@@ -247,6 +250,8 @@ game_params *midend_get_params(midend *me);
 void midend_size(midend *me, int *x, int *y, int user_size);
 void midend_reset_tilesize(midend *me);
 void midend_new_game(midend *me);
+int midend_try_new_game(midend *me, const volatile int *cancel,
+                        double timeout);
 void midend_restart_game(midend *me);
 void midend_stop_anim(midend *me);
 int midend_process_key(midend *me, int x, int y, int button);
@@ -280,16 +285,33 @@ char *midend_rewrite_statusbar(midend *me, char *text);
 void midend_serialise(midend *me,
                       void (*write)(void *ctx, void *buf, int len),
                       void *wctx);
+void midend_serialise_binary(midend *me,
+                             void (*write)(void *ctx, void *buf, int len),
+                             void *wctx);
 char *midend_deserialise(midend *me,
                          int (*read)(void *ctx, void *buf, int len),
                          void *rctx);
 char *identify_game(char **name, int (*read)(void *ctx, void *buf, int len),
                     void *rctx);
+char *save_convert(int (*read)(void *ctx, void *buf, int len), void *rctx,
+                   void (*write)(void *ctx, void *buf, int len), void *wctx,
+                   int binary);
 void midend_request_id_changes(midend *me, void (*notify)(void *), void *ctx);
 /* Printing functions supplied by the mid-end */
 char *midend_print_puzzle(midend *me, document *doc, int with_soln);
 int midend_tilesize(midend *me);
 void midend_android_cursor_visibility(midend *me, int visible);
+void midend_set_pool(midend *me, puzzle_pool *pool);
+void midend_set_race(midend *me, int nthreads);
+void midend_set_undo_budget(midend *me, int nstates);
+void midend_undo_stats(midend *me, int *nstates, int *nheld);
+void midend_set_update_tolerance(midend *me, float tolerance);
+
+/* Identification of the save file format, also used by pool.c. */
+#define SERIALISE_MAGIC "Simon Tatham's Portable Puzzle Collection"
+#define SERIALISE_VERSION "1"
+/* The start of a save file in the binary form (see midend.c). */
+#define SERIALISE_BINARY_MAGIC "\x89SGTPUZ\n"
 
 /*
  * malloc.c
@@ -298,6 +320,12 @@ void *smalloc(size_t size);
 void *srealloc(void *p, size_t size);
 void sfree(void *p);
 char *dupstr(const char *s);
+/* Heap accounting through the above, off by default. */
+void malloc_stats_enable(int enable);
+void malloc_stats_reset(void);
+long malloc_stats_peak(void);
+long malloc_stats_current(void);
+long malloc_stats_allocs(void);
 #define snew(type) \
     ( (type *) smalloc (sizeof (type)) )
 #define snewn(number, type) \
@@ -309,6 +337,27 @@ char *dupstr(const char *s);
  * misc.c
  */
 void free_cfg(config_item *cfg);
+char *new_seed_string(random_state *rs);
+/*
+ * A growable buffer to pass to midend_serialise along with
+ * serialise_buf_write, so that the save can be handed on in one piece.
+ * Start it as { NULL, 0, 0 } and sfree buf afterwards.
+ */
+struct serialise_buf {
+    char *buf;
+    int len, size;
+};
+void serialise_buf_write(void *ctx, void *buf, int len);
+/*
+ * The other way: a read function for midend_deserialise and friends
+ * that takes bytes straight from memory, such as a whole save file
+ * already loaded or mapped.
+ */
+struct mem_read {
+    const char *p;
+    int len;
+};
+int mem_read(void *ctx, void *buf, int len);
 void obfuscate_bitmap(unsigned char *bmp, int bits, int decode);
 
 /* allocates output each time. len is always in bytes of binary data.
@@ -361,6 +410,14 @@ int edsf_canonify(int *dsf, int val, int *inverse);
 int dsf_canonify(int *dsf, int val);
 int dsf_size(int *dsf, int val);
 
+/* Canonify every element at once, and number the equivalence classes from 0
+ * in order of their least elements. 'labels' (which must not be the dsf
+ * itself) gets the number of each element's class, 'sizes', if non-NULL, the
+ * size of each class, and 'ncomponents', if non-NULL, the number of classes.
+ * Both arrays need room for 'size' ints. */
+void dsf_flatten(int *dsf, int size, int *labels, int *sizes,
+                 int *ncomponents);
+
 /* Allow the caller to specify that two elements should be in the same
  * equivalence class.  If 'inverse' is TRUE, the elements are actually opposite
  * to one another in some sense.  This function will fail an assertion if the
@@ -370,6 +427,16 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse);
 void dsf_merge(int *dsf, int v1, int v2);
 void dsf_init(int *dsf, int len);
 
+/* As edsf_merge and dsf_merge, but the root of the larger class becomes the
+ * root of the merged one, so the canonical element is no longer the least
+ * element of its class. If 'mins' is non-NULL, it must have been set up by
+ * dsf_init_mins, and keeps the least element of each class for
+ * dsf_minimum. */
+void edsf_merge_by_size(int *dsf, int *mins, int v1, int v2, int inverse);
+void dsf_merge_by_size(int *dsf, int *mins, int v1, int v2);
+void dsf_init_mins(int *mins, int len);
+int dsf_minimum(int *dsf, int *mins, int val);
+
 /*
  * tdq.c
  */
@@ -421,13 +488,29 @@ extern char ver[];
 /*
  * random.c
  */
+/* Game seed strings starting with this use the fast generator. */
+#define RANDOM_FAST_PREFIX "x-"
+/* SHA-1 generator, from any bytes at all. */
 random_state *random_new(const char *seed, int len);
+/* xoshiro256** generator, keyed from the same hash of the seed. */
+random_state *random_new_fast(const char *seed, int len);
+/* Generator for a game's seed string, chosen by RANDOM_FAST_PREFIX. */
+random_state *random_new_seed(const char *seed);
 random_state *random_copy(random_state *tocopy);
 unsigned long random_bits(random_state *state, int bits);
 unsigned long random_upto(random_state *state, unsigned long limit);
+/* Bulk versions: identical output to calling the above repeatedly. */
+void random_fill(random_state *state, void *buf, int len);
+void random_upto_many(random_state *state, unsigned long limit,
+                      unsigned long *out, int n);
 void random_free(random_state *state);
 char *random_state_encode(random_state *state);
 random_state *random_state_decode(const char *input);
+void random_set_cancel(random_state *state, const volatile int *flag);
+void random_set_timeout(random_state *state, double seconds);
+int random_cancelled(random_state *state);
+/* How many times a generator has checked random_cancelled(). */
+unsigned long random_attempts(random_state *state);
 /* random.c also exports SHA, which occasionally comes in useful. */
 #if __STDC_VERSION__ >= 199901L
 #include <stdint.h>
@@ -484,6 +567,163 @@ void free_combi(combi_ctx *combi);
 /* divides w*h rectangle into pieces of size k. Returns w*h dsf. */
 int *divvy_rectangle(int w, int h, int k, random_state *rs);
 
+/*
+ * pool.c: a bounded, thread-safe store of ready-generated games per
+ * (game, params, interactive) key, topped up in the background. Taking
+ * from the pool hands over ownership of the returned strings.
+ */
+puzzle_pool *pool_new(int maxper, int maxbytes);
+void pool_free(puzzle_pool *pool);
+void pool_add(puzzle_pool *pool, const game *g, const game_params *params,
+              int interactive, const char *seed, const char *desc,
+              const char *aux);
+int pool_take(puzzle_pool *pool, const game *g, const game_params *params,
+              int interactive, char **seed, char **desc, char **aux);
+int pool_count(puzzle_pool *pool, const game *g, const game_params *params,
+               int interactive);
+void pool_start_refill(puzzle_pool *pool);
+/* Called whenever an entry has been added (from the refill thread) or
+ * taken, without the pool's lock held. */
+void pool_set_changed_callback(puzzle_pool *pool,
+                               void (*changed)(void *ctx), void *ctx);
+void pool_save(puzzle_pool *pool,
+               void (*write)(void *ctx, void *buf, int len), void *wctx);
+char *pool_load(puzzle_pool *pool,
+                int (*read)(void *ctx, void *buf, int len), void *rctx);
+
+/*
+ * race.c: run new_desc on several derived seeds at once and keep the
+ * first to finish, passing back the seed that won.
+ */
+char *race_new_desc(const game *g, const game_params *params,
+                    random_state *seeds, int nthreads, int interactive,
+                    const volatile int *cancel, double timeout,
+                    char **seed, char **aux);
+
+/*
+ * drawbuf.c: a list of drawing primitives recorded as 32-bit words,
+ * for a front end to hand over to its toolkit in one go rather than a
+ * call at a time, or to play back later through any drawing_api.
+ * Each command is its DRAWBUF_* opcode followed by the arguments in
+ * the order given; a polygon's points follow the polygon, and text is
+ * its length in bytes followed by the UTF-8 itself, padded with zeroes
+ * to a whole word. Blitters are named by the caller's own small
+ * integers. Start it as { NULL, 0, 0 }, empty it by setting len to 0,
+ * and call drawbuf_free after.
+ */
+enum {
+    DRAWBUF_RECT = 1,                  /* x y w h colour */
+    DRAWBUF_LINE,                      /* x1 y1 x2 y2 colour */
+    DRAWBUF_POLYGON,                   /* npoints fill outline, points */
+    DRAWBUF_CIRCLE,                    /* cx cy radius fill outline */
+    DRAWBUF_TEXT,                      /* x y fonttype fontsize align
+                                        * colour nbytes, text */
+    DRAWBUF_CLIP,                      /* x y w h */
+    DRAWBUF_UNCLIP,                    /* ox oy: margins of the area */
+    DRAWBUF_BLITTER_SAVE,              /* id x y */
+    DRAWBUF_BLITTER_LOAD,              /* id x y */
+    DRAWBUF_UPDATE                     /* x y w h */
+};
+struct drawbuf {
+    int *words;
+    int len, size;
+};
+void drawbuf_free(struct drawbuf *db);
+void drawbuf_rect(struct drawbuf *db, int x, int y, int w, int h, int colour);
+void drawbuf_line(struct drawbuf *db, int x1, int y1, int x2, int y2,
+                  int colour);
+/* (ox, oy) is added to each of the points on the way in. */
+void drawbuf_polygon(struct drawbuf *db, const int *coords, int npoints,
+                     int ox, int oy, int fillcolour, int outlinecolour);
+void drawbuf_circle(struct drawbuf *db, int cx, int cy, int radius,
+                    int fillcolour, int outlinecolour);
+void drawbuf_text(struct drawbuf *db, int x, int y, int fonttype,
+                  int fontsize, int align, int colour, const char *text);
+void drawbuf_clip(struct drawbuf *db, int x, int y, int w, int h);
+void drawbuf_unclip(struct drawbuf *db, int ox, int oy);
+void drawbuf_blitter_save(struct drawbuf *db, int id, int x, int y);
+void drawbuf_blitter_load(struct drawbuf *db, int id, int x, int y);
+void drawbuf_update(struct drawbuf *db, int x, int y, int w, int h);
+/*
+ * Play the commands back through `api'. Blitter id i is blitters[i];
+ * if `blitters' is NULL the blitter commands are skipped.
+ */
+void drawbuf_replay(const struct drawbuf *db, const drawing_api *api,
+                    void *handle, blitter **blitters);
+
+/*
+ * raster.c: raster_drawing draws into a buffer of pixels, with a
+ * raster as its handle. The target's rows are `stride' bytes apart;
+ * RASTER_RGBA8888 pixels are the bytes R, G, B and 255, and
+ * RASTER_RGB565 ones native-endian 16-bit words as Android has them.
+ * Every coordinate drawn at is offset by the origin, and colours must
+ * be set before drawing.
+ */
+enum { RASTER_RGBA8888, RASTER_RGB565 };
+extern const struct drawing_api raster_drawing;
+raster *raster_new(void);
+void raster_free(raster *r);
+void raster_set_target(raster *r, void *pixels, int w, int h, int stride,
+                       int format);
+void raster_set_origin(raster *r, int ox, int oy);
+void raster_set_colours(raster *r, const float *colours, int ncolours);
+int raster_ncolours(raster *r);
+
+/*
+ * pacing.c: a frame_pacer sits between a front end's timer ticks,
+ * which come every `interval' seconds, and midend_timer. On each
+ * tick, pacer_tick says whether to draw a frame and, if so, how much
+ * time to pass to midend_timer; after drawing one, pacer_frame is
+ * told how long it took (in seconds), so that slow games draw on
+ * fewer ticks. pacer_stats returns a dynamically allocated summary
+ * of the frames since it was last called.
+ */
+struct frame_stats {
+    int frames, skipped, overruns;
+    double total, worst;
+};
+struct frame_pacer {
+    double interval;                   /* between ticks */
+    double cost;                       /* average time to draw a frame */
+    double pending;                    /* time not yet passed on */
+    int wait;                          /* ticks to let go before drawing */
+    struct frame_stats stats;
+};
+void pacer_init(struct frame_pacer *fp, double interval);
+void pacer_start(struct frame_pacer *fp);
+/* An interval of 0 leaves it as it was. */
+int pacer_tick(struct frame_pacer *fp, double interval, double elapsed,
+               double *tplus);
+void pacer_frame(struct frame_pacer *fp, double cost);
+char *pacer_stats(struct frame_pacer *fp);
+
+/*
+ * profile.c: named counters and timers for finding out where a
+ * generator spends its time. The macros compile to nothing unless
+ * PROFILING is defined, and even then they cost one flag test until
+ * profile_enable(TRUE) is called. Names are string literals, by
+ * convention "game.phase". Timers record a call count alongside the
+ * total time, and may nest, though not inside themselves (so time a
+ * recursive solver from its callers).
+ */
+#ifdef PROFILING
+void profile_count(const char *name);
+void profile_begin(const char *name);
+void profile_end(const char *name);
+#define PROFILE_COUNT(name) profile_count(name)
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END(name) profile_end(name)
+#else
+#define PROFILE_COUNT(name) ((void)0)
+#define PROFILE_BEGIN(name) ((void)0)
+#define PROFILE_END(name) ((void)0)
+#endif
+/* Returns FALSE, and does nothing, if built without PROFILING. */
+int profile_enable(int enable);
+void profile_reset(void);
+/* One line per name used: name, calls, total ms (blank for counters). */
+void profile_dump(FILE *fp);
+
 /*
  * Data structure containing the function calls and data specific
  * to a particular game. This is enclosed in a data structure so
@@ -553,6 +793,16 @@ struct game {
     int is_timed;
     int (*timing_state)(const game_state *state, game_ui *ui);
     int flags;
+    /*
+     * Optional, and may both be NULL: a compact encoding of a whole
+     * game_state, and the way back, given another state of the same
+     * game (the initial one) to share its unchanging parts with.
+     * decode_state returns NULL if it doesn't like the encoding. The
+     * midend writes these into save files as checkpoints, so that it
+     * needn't replay every move to load a game.
+     */
+    char *(*encode_state)(const game_state *state);
+    game_state *(*decode_state)(const game_state *base, const char *encoding);
 };
 
 /*
@@ -0,0 +1,210 @@
+/*
+ * race.c: speculative parallel generation of a new game.
+ *
+ * Several generators (Loopy, Mines, Solo among them) loop until they
+ * happen upon a grid that meets their conditions, so the time taken
+ * for any one seed has a long tail. Here we derive several seeds in a
+ * row from the caller's random state, run new_desc on each of them in
+ * its own thread, and keep whichever finishes first. The winning seed
+ * is handed back to the caller, and since new_desc is deterministic
+ * given its seed, that seed alone regenerates the same puzzle on one
+ * thread later.
+ *
+ * Once there is a winner, the other threads are cancelled through
+ * their random states, and clean up after themselves; the shared state
+ * is freed by whoever lets go of it last. The caller's own cancel flag
+ * is polled while it waits, and passed on in the same way.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "puzzles.h"
+
+/* How often the waiting caller looks at its cancel flag. */
+#define POLL_NSEC 20000000L
+
+struct race {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int refcount;                      /* runners, plus the caller */
+    int nrunning;
+    int finished;                      /* someone has won */
+    volatile int stop;                 /* tells the runners to give up */
+    char *seed, *desc, *aux;           /* the winner's, once there is one */
+};
+
+struct runner {
+    struct race *race;
+    const game *game;
+    game_params *params;
+    char *seed;
+    int interactive;
+    double timeout;
+};
+
+static void race_release(struct race *race)
+{
+    int last;
+
+    last = (--race->refcount == 0);
+    pthread_mutex_unlock(&race->lock);
+    if (last) {
+        pthread_mutex_destroy(&race->lock);
+        pthread_cond_destroy(&race->done);
+        sfree(race->seed);
+        sfree(race->desc);
+        sfree(race->aux);
+        sfree(race);
+    }
+}
+
+static void *race_thread(void *vrunner)
+{
+    struct runner *r = (struct runner *)vrunner;
+    struct race *race = r->race;
+    random_state *rs;
+    char *desc, *aux = NULL;
+
+    rs = random_new_seed(r->seed);
+    random_set_cancel(rs, &race->stop);
+    if (r->timeout > 0)
+        random_set_timeout(rs, r->timeout);
+    desc = r->game->new_desc(r->params, rs, &aux, r->interactive);
+    random_free(rs);
+    r->game->free_params(r->params);
+
+    pthread_mutex_lock(&race->lock);
+    race->nrunning--;
+    if (desc && !race->finished) {
+        race->finished = TRUE;
+        __atomic_store_n(&race->stop, TRUE, __ATOMIC_RELAXED);
+        race->seed = r->seed;
+        race->desc = desc;
+        race->aux = aux;
+        pthread_cond_signal(&race->done);
+    } else {
+        if (race->nrunning == 0)
+            pthread_cond_signal(&race->done);
+        sfree(r->seed);
+        sfree(desc);
+        sfree(aux);
+    }
+    sfree(r);
+    race_release(race);
+    return NULL;
+}
+
+/*
+ * Generate a game description for `params' using up to `nthreads'
+ * seeds derived from `seeds'. Returns the description, and passes
+ * back the seed that produced it and its aux_info (which may be
+ * NULL). If no thread could be started, we generate on the calling
+ * thread from the first derived seed.
+ *
+ * Returns NULL, with *seed and *aux NULL, if *cancel becomes nonzero
+ * or every thread runs out of time.
+ */
+char *race_new_desc(const game *g, const game_params *params,
+                    random_state *seeds, int nthreads, int interactive,
+                    const volatile int *cancel, double timeout,
+                    char **seed, char **aux)
+{
+    struct race *race;
+    char *desc, *first = NULL;
+    int i;
+
+    assert(nthreads >= 1);
+
+    race = snew(struct race);
+    pthread_mutex_init(&race->lock, NULL);
+    pthread_cond_init(&race->done, NULL);
+    race->refcount = 1;
+    race->nrunning = 0;
+    race->finished = FALSE;
+    race->stop = FALSE;
+    race->seed = race->desc = race->aux = NULL;
+
+    /*
+     * Derive all the seeds up front, in order, so that the caller's
+     * random state advances by the same amount whichever thread wins.
+     */
+    pthread_mutex_lock(&race->lock);
+    for (i = 0; i < nthreads; i++) {
+        struct runner *r = snew(struct runner);
+        pthread_attr_t attr;
+        pthread_t thread;
+        int ok;
+
+        r->race = race;
+        r->game = g;
+        r->params = g->dup_params(params);
+        r->seed = new_seed_string(seeds);
+        r->interactive = interactive;
+        r->timeout = timeout;
+        if (i == 0)
+            first = dupstr(r->seed);
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        ok = (pthread_create(&thread, &attr, race_thread, r) == 0);
+        pthread_attr_destroy(&attr);
+        if (ok) {
+            race->refcount++;
+            race->nrunning++;
+        } else {
+            g->free_params(r->params);
+            sfree(r->seed);
+            sfree(r);
+        }
+    }
+
+    if (race->nrunning == 0) {
+        random_state *rs;
+
+        race_release(race);
+        rs = random_new_seed(first);
+        random_set_cancel(rs, cancel);
+        if (timeout > 0)
+            random_set_timeout(rs, timeout);
+        *aux = NULL;
+        desc = g->new_desc(params, rs, aux, interactive);
+        random_free(rs);
+        if (desc) {
+            *seed = first;
+        } else {
+            *seed = NULL;
+            sfree(first);
+        }
+        return desc;
+    }
+    sfree(first);
+
+    while (!race->finished && race->nrunning > 0) {
+        if (cancel) {
+            struct timespec until;
+            if (__atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&race->stop, TRUE, __ATOMIC_RELAXED);
+                break;
+            }
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += POLL_NSEC;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&race->done, &race->lock, &until);
+        } else {
+            pthread_cond_wait(&race->done, &race->lock);
+        }
+    }
+    *seed = race->seed;
+    desc = race->desc;
+    *aux = race->aux;
+    race->seed = race->desc = race->aux = NULL;
+    race_release(race);
+
+    return desc;
+}
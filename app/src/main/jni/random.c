@@ -8,11 +8,19 @@
  * The generator is based on SHA-1. This is almost certainly
  * overkill, but I had the SHA-1 code kicking around and it was
  * easier to reuse it than to do anything else!
+ *
+ * random_new_fast instead keys xoshiro256** from the same hash of
+ * the seed. Game seed strings beginning
+ * with RANDOM_FAST_PREFIX get that (see random_new_seed), and new games
+ * are given seeds of that kind; any other seed still produces the same
+ * SHA-1 stream as ever, so old game IDs keep working.
  */
 
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <stdint.h>
 
 #include "puzzles.h"
 
@@ -31,61 +39,64 @@ static void SHA_Core_Init(uint32 h[5])
     h[4] = 0xc3d2e1f0;
 }
 
+/*
+ * The 80 rounds are unrolled, renaming the five working variables
+ * instead of shuffling them along, and the message schedule is kept in
+ * a rolling window of 16 words rather than expanded to 80 up front.
+ * The random number generator below spends nearly all its time here.
+ */
+#define SHA_F1(b,c,d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA_F2(b,c,d) ((b) ^ (c) ^ (d))
+#define SHA_F3(b,c,d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+#define SHA_W(t) ( (t) < 16 ? w[(t) & 15] : \
+    (w[(t) & 15] = rol(w[((t)-3) & 15] ^ w[((t)-8) & 15] ^ \
+                       w[((t)-14) & 15] ^ w[(t) & 15], 1)) )
+
+#define SHA_ROUND(a,b,c,d,e,f,k,t) do { \
+    e += rol(a, 5) + f(b,c,d) + (k) + SHA_W(t); \
+    b = rol(b, 30); \
+} while (0)
+
+#define SHA_5ROUNDS(f,k,t) do { \
+    SHA_ROUND(a, b, c, d, e, f, k, (t)); \
+    SHA_ROUND(e, a, b, c, d, f, k, (t)+1); \
+    SHA_ROUND(d, e, a, b, c, f, k, (t)+2); \
+    SHA_ROUND(c, d, e, a, b, f, k, (t)+3); \
+    SHA_ROUND(b, c, d, e, a, f, k, (t)+4); \
+} while (0)
+
 static void SHATransform(uint32 * digest, uint32 * block)
 {
-    uint32 w[80];
+    uint32 w[16];
     uint32 a, b, c, d, e;
     int t;
 
     for (t = 0; t < 16; t++)
 	w[t] = block[t];
 
-    for (t = 16; t < 80; t++) {
-	uint32 tmp = w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16];
-	w[t] = rol(tmp, 1);
-    }
-
     a = digest[0];
     b = digest[1];
     c = digest[2];
     d = digest[3];
     e = digest[4];
 
-    for (t = 0; t < 20; t++) {
-	uint32 tmp =
-	    rol(a, 5) + ((b & c) | (d & ~b)) + e + w[t] + 0x5a827999;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 20; t < 40; t++) {
-	uint32 tmp = rol(a, 5) + (b ^ c ^ d) + e + w[t] + 0x6ed9eba1;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 40; t < 60; t++) {
-	uint32 tmp = rol(a,
-			 5) + ((b & c) | (b & d) | (c & d)) + e + w[t] +
-	    0x8f1bbcdc;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
-    for (t = 60; t < 80; t++) {
-	uint32 tmp = rol(a, 5) + (b ^ c ^ d) + e + w[t] + 0xca62c1d6;
-	e = d;
-	d = c;
-	c = rol(b, 30);
-	b = a;
-	a = tmp;
-    }
+    SHA_5ROUNDS(SHA_F1, 0x5a827999, 0);
+    SHA_5ROUNDS(SHA_F1, 0x5a827999, 5);
+    SHA_5ROUNDS(SHA_F1, 0x5a827999, 10);
+    SHA_5ROUNDS(SHA_F1, 0x5a827999, 15);
+    SHA_5ROUNDS(SHA_F2, 0x6ed9eba1, 20);
+    SHA_5ROUNDS(SHA_F2, 0x6ed9eba1, 25);
+    SHA_5ROUNDS(SHA_F2, 0x6ed9eba1, 30);
+    SHA_5ROUNDS(SHA_F2, 0x6ed9eba1, 35);
+    SHA_5ROUNDS(SHA_F3, 0x8f1bbcdc, 40);
+    SHA_5ROUNDS(SHA_F3, 0x8f1bbcdc, 45);
+    SHA_5ROUNDS(SHA_F3, 0x8f1bbcdc, 50);
+    SHA_5ROUNDS(SHA_F3, 0x8f1bbcdc, 55);
+    SHA_5ROUNDS(SHA_F2, 0xca62c1d6, 60);
+    SHA_5ROUNDS(SHA_F2, 0xca62c1d6, 65);
+    SHA_5ROUNDS(SHA_F2, 0xca62c1d6, 70);
+    SHA_5ROUNDS(SHA_F2, 0xca62c1d6, 75);
 
     digest[0] += a;
     digest[1] += b;
@@ -202,12 +213,64 @@ void SHA_Simple(const void *p, int len, unsigned char *output)
  */
 
 struct random_state {
+    int fast;                          /* xoshiro256** rather than SHA-1 */
+    /* SHA-1 generator */
     unsigned char seedbuf[40];
     unsigned char databuf[20];
     int pos;
+    /* xoshiro256**, and the unused bits of its latest output */
+    uint64_t s[4];
+    uint64_t xbuf;
+    int xbits;
+    /*
+     * Cancellation: not part of the random stream, and not encoded,
+     * but carried along by random_copy so that a generator's private
+     * copies can be cancelled too.
+     */
+    const volatile int *cancel;
+    int has_deadline;
+    struct timespec deadline;
+    unsigned long attempts;            /* calls to random_cancelled() */
 };
 
-random_state *random_new(const char *seed, int len)
+/*
+ * SHA_Simple(in, 40, out), done directly: 40 bytes plus padding fit in
+ * a single block, so there's no need to go through SHA_Bytes.
+ */
+static void SHA_40(const unsigned char *in, unsigned char *out)
+{
+    uint32 h[5], block[16];
+    int i;
+
+    for (i = 0; i < 10; i++)
+	block[i] = (((uint32) in[i * 4 + 0]) << 24) |
+	    (((uint32) in[i * 4 + 1]) << 16) |
+	    (((uint32) in[i * 4 + 2]) << 8) |
+	    (((uint32) in[i * 4 + 3]) << 0);
+    block[10] = 0x80000000;
+    for (i = 11; i < 15; i++)
+	block[i] = 0;
+    block[15] = 40 * 8;
+
+    SHA_Core_Init(h);
+    SHATransform(h, block);
+
+    for (i = 0; i < 5; i++) {
+	out[i * 4] = (unsigned char)((h[i] >> 24) & 0xFF);
+	out[i * 4 + 1] = (unsigned char)((h[i] >> 16) & 0xFF);
+	out[i * 4 + 2] = (unsigned char)((h[i] >> 8) & 0xFF);
+	out[i * 4 + 3] = (unsigned char)((h[i]) & 0xFF);
+    }
+}
+
+static int random_is_fast_seed(const char *seed, int len)
+{
+    int plen = strlen(RANDOM_FAST_PREFIX);
+    return len >= plen && !memcmp(seed, RANDOM_FAST_PREFIX, plen);
+}
+
+static random_state *random_new_internal(const char *seed, int len,
+					 int fast)
 {
     random_state *state;
 
@@ -215,12 +278,50 @@ random_state *random_new(const char *seed, int len)
 
     SHA_Simple(seed, len, state->seedbuf);
     SHA_Simple(state->seedbuf, 20, state->seedbuf + 20);
-    SHA_Simple(state->seedbuf, 40, state->databuf);
-    state->pos = 0;
+    state->fast = fast;
+    if (state->fast) {
+	/*
+	 * Key xoshiro from the first 32 of the 40 hashed bytes. The
+	 * all-zero state would be a fixed point, so steer clear of it
+	 * even though we'll never see it.
+	 */
+	int i;
+	memset(state->s, 0, sizeof(state->s));
+	for (i = 0; i < 32; i++)
+	    state->s[i / 8] = (state->s[i / 8] << 8) | state->seedbuf[i];
+	if (!(state->s[0] | state->s[1] | state->s[2] | state->s[3]))
+	    state->s[0] = 1;
+	state->xbuf = 0;
+	state->xbits = 0;
+	memset(state->databuf, 0, sizeof(state->databuf));
+	state->pos = 0;
+    } else {
+	SHA_40(state->seedbuf, state->databuf);
+	state->pos = 0;
+    }
+    state->cancel = NULL;
+    state->has_deadline = FALSE;
+    state->attempts = 0;
 
     return state;
 }
 
+random_state *random_new(const char *seed, int len)
+{
+    return random_new_internal(seed, len, FALSE);
+}
+
+random_state *random_new_fast(const char *seed, int len)
+{
+    return random_new_internal(seed, len, TRUE);
+}
+
+random_state *random_new_seed(const char *seed)
+{
+    int len = strlen(seed);
+    return random_new_internal(seed, len, random_is_fast_seed(seed, len));
+}
+
 random_state *random_copy(random_state *tocopy)
 {
     random_state *result;
@@ -228,28 +329,139 @@ random_state *random_copy(random_state *tocopy)
     memcpy(result->seedbuf, tocopy->seedbuf, sizeof(result->seedbuf));
     memcpy(result->databuf, tocopy->databuf, sizeof(result->databuf));
     result->pos = tocopy->pos;
+    result->fast = tocopy->fast;
+    memcpy(result->s, tocopy->s, sizeof(result->s));
+    result->xbuf = tocopy->xbuf;
+    result->xbits = tocopy->xbits;
+    result->cancel = tocopy->cancel;
+    result->has_deadline = tocopy->has_deadline;
+    result->deadline = tocopy->deadline;
+    result->attempts = 0;
     return result;
 }
 
+/*
+ * Generators which retry until they find a suitable grid call
+ * random_cancelled() at the top of each attempt, and give up
+ * (returning NULL from new_desc) if it returns TRUE. That happens once
+ * *flag becomes nonzero, or once `seconds' have passed since
+ * random_set_timeout() was called. The flag is read atomically, so
+ * whoever sets it from another thread should write it atomically too.
+ */
+void random_set_cancel(random_state *state, const volatile int *flag)
+{
+    state->cancel = flag;
+}
+
+void random_set_timeout(random_state *state, double seconds)
+{
+    clock_gettime(CLOCK_MONOTONIC, &state->deadline);
+    state->deadline.tv_sec += (time_t)seconds;
+    state->deadline.tv_nsec += (long)((seconds - (time_t)seconds) * 1e9);
+    if (state->deadline.tv_nsec >= 1000000000L) {
+        state->deadline.tv_sec++;
+        state->deadline.tv_nsec -= 1000000000L;
+    }
+    state->has_deadline = TRUE;
+}
+
+int random_cancelled(random_state *state)
+{
+    state->attempts++;
+    if (state->cancel && __atomic_load_n(state->cancel, __ATOMIC_RELAXED))
+        return TRUE;
+    if (state->has_deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > state->deadline.tv_sec ||
+            (now.tv_sec == state->deadline.tv_sec &&
+             now.tv_nsec >= state->deadline.tv_nsec))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Since the retry loops call random_cancelled() once per attempt, this
+ * counts them, which is handy for benchmarking.
+ */
+unsigned long random_attempts(random_state *state)
+{
+    return state->attempts;
+}
+
+/*
+ * Step the seed buffer on (as a little-endian counter) and hash it to
+ * get the next 20 bytes of output.
+ */
+static void random_refill(random_state *state)
+{
+    int i;
+
+    for (i = 0; i < 20; i++) {
+	if (state->seedbuf[i] != 0xFF) {
+	    state->seedbuf[i]++;
+	    break;
+	} else
+	    state->seedbuf[i] = 0;
+    }
+    SHA_40(state->seedbuf, state->databuf);
+    state->pos = 0;
+}
+
+#define rol64(x,y) ( ((x) << (y)) | ((x) >> (64-(y))) )
+
+static uint64_t xoshiro_next(random_state *state)
+{
+    uint64_t *s = state->s;
+    uint64_t ret = rol64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rol64(s[3], 45);
+
+    return ret;
+}
+
+/*
+ * The fast generator hands out bits from the top of each 64-bit
+ * output in turn, starting on a fresh output when there aren't
+ * enough left for the request. A request for no bits has to be
+ * caught first, since it would shift xbuf by 64.
+ */
+static unsigned long xoshiro_bits(random_state *state, int bits)
+{
+    unsigned long ret;
+
+    assert(bits >= 0 && bits <= 32);
+    if (bits == 0)
+	return 0;
+
+    if (state->xbits < bits) {
+	state->xbuf = xoshiro_next(state);
+	state->xbits = 64;
+    }
+    ret = (unsigned long)(state->xbuf >> (64 - bits));
+    state->xbuf <<= bits;
+    state->xbits -= bits;
+    return ret;
+}
+
 unsigned long random_bits(random_state *state, int bits)
 {
     unsigned long ret = 0;
     int n;
 
-    for (n = 0; n < bits; n += 8) {
-	if (state->pos >= 20) {
-	    int i;
+    if (state->fast)
+	return xoshiro_bits(state, bits);
 
-	    for (i = 0; i < 20; i++) {
-		if (state->seedbuf[i] != 0xFF) {
-		    state->seedbuf[i]++;
-		    break;
-		} else
-		    state->seedbuf[i] = 0;
-	    }
-	    SHA_Simple(state->seedbuf, 40, state->databuf);
-	    state->pos = 0;
-	}
+    for (n = 0; n < bits; n += 8) {
+	if (state->pos >= 20)
+	    random_refill(state);
 	ret = (ret << 8) | state->databuf[state->pos++];
     }
 
@@ -263,20 +475,64 @@ unsigned long random_bits(random_state *state, int bits)
     return ret;
 }
 
-unsigned long random_upto(random_state *state, unsigned long limit)
+/*
+ * The bulk functions below return exactly what the corresponding
+ * number of calls to random_bits or random_upto would, and leave the
+ * state in the same place; they just save the per-call overheads.
+ */
+
+/* The same bytes as len calls to random_bits(state, 8). */
+void random_fill(random_state *state, void *buf, int len)
 {
-    int bits = 0;
-    unsigned long max, divisor, data;
+    unsigned char *p = (unsigned char *)buf;
 
-    while ((limit >> bits) != 0)
-	bits++;
+    if (state->fast) {
+	while (len-- > 0)
+	    *p++ = (unsigned char)xoshiro_bits(state, 8);
+	return;
+    }
 
-    bits += 3;
-    assert(bits < 32);
+    while (len > 0) {
+	int n;
+	if (state->pos >= 20)
+	    random_refill(state);
+	n = 20 - state->pos;
+	if (n > len)
+	    n = len;
+	memcpy(p, state->databuf + state->pos, n);
+	state->pos += n;
+	p += n;
+	len -= n;
+    }
+}
 
-    max = 1L << bits;
-    divisor = max / limit;
-    max = limit * divisor;
+/*
+ * Work out how random_upto draws a number below `limit': it takes
+ * `bits' bits and rejects anything from `max' up.
+ */
+static void random_upto_setup(unsigned long limit, int *bits,
+			      unsigned long *max, unsigned long *divisor)
+{
+    int b = 0;
+
+    while ((limit >> b) != 0)
+	b++;
+
+    b += 3;
+    assert(b < 32);
+
+    *bits = b;
+    *max = 1L << b;
+    *divisor = *max / limit;
+    *max = limit * *divisor;
+}
+
+unsigned long random_upto(random_state *state, unsigned long limit)
+{
+    int bits;
+    unsigned long max, divisor, data;
+
+    random_upto_setup(limit, &bits, &max, &divisor);
 
     do {
 	data = random_bits(state, bits);
@@ -285,6 +541,22 @@ unsigned long random_upto(random_state *state, unsigned long limit)
     return data / divisor;
 }
 
+void random_upto_many(random_state *state, unsigned long limit,
+		      unsigned long *out, int n)
+{
+    int bits, i;
+    unsigned long max, divisor, data;
+
+    random_upto_setup(limit, &bits, &max, &divisor);
+
+    for (i = 0; i < n; i++) {
+	do {
+	    data = random_bits(state, bits);
+	} while (data >= max);
+	out[i] = data / divisor;
+    }
+}
+
 void random_free(random_state *state)
 {
     sfree(state);
@@ -295,6 +567,23 @@ char *random_state_encode(random_state *state)
     char retbuf[256];
     int len = 0, i;
 
+    if (state->fast) {
+	/*
+	 * The prefix, then the four state words, the unused bits and
+	 * how many of them there are, in hex.
+	 */
+	len += sprintf(retbuf+len, "%s", RANDOM_FAST_PREFIX);
+	for (i = 0; i < 4; i++)
+	    len += sprintf(retbuf+len, "%08lx%08lx",
+			   (unsigned long)(state->s[i] >> 32),
+			   (unsigned long)(state->s[i] & 0xFFFFFFFFUL));
+	len += sprintf(retbuf+len, "%08lx%08lx",
+		       (unsigned long)(state->xbuf >> 32),
+		       (unsigned long)(state->xbuf & 0xFFFFFFFFUL));
+	len += sprintf(retbuf+len, "%02x", state->xbits);
+	return dupstr(retbuf);
+    }
+
     for (i = 0; i < lenof(state->seedbuf); i++)
 	len += sprintf(retbuf+len, "%02x", state->seedbuf[i]);
     for (i = 0; i < lenof(state->databuf); i++)
@@ -304,6 +593,18 @@ char *random_state_encode(random_state *state)
     return dupstr(retbuf);
 }
 
+static int hexval(int v)
+{
+    if (v >= '0' && v <= '9')
+	return v - '0';
+    else if (v >= 'A' && v <= 'F')
+	return v - 'A' + 10;
+    else if (v >= 'a' && v <= 'f')
+	return v - 'a' + 10;
+    else
+	return 0;
+}
+
 random_state *random_state_decode(const char *input)
 {
     random_state *state;
@@ -314,22 +615,41 @@ random_state *random_state_decode(const char *input)
     memset(state->seedbuf, 0, sizeof(state->seedbuf));
     memset(state->databuf, 0, sizeof(state->databuf));
     state->pos = 0;
+    memset(state->s, 0, sizeof(state->s));
+    state->xbuf = 0;
+    state->xbits = 0;
+    state->cancel = NULL;
+    state->has_deadline = FALSE;
+    state->attempts = 0;
+
+    state->fast = random_is_fast_seed(input, strlen(input));
+    if (state->fast) {
+	/*
+	 * Five 64-bit words (the state and xbuf), then xbits, as
+	 * written by random_state_encode.
+	 */
+	uint64_t words[5];
+	int i;
+
+	input += strlen(RANDOM_FAST_PREFIX);
+	memset(words, 0, sizeof(words));
+	for (i = 0; i < 80 && *input; i++)
+	    words[i / 16] = (words[i / 16] << 4) | hexval(*input++);
+	memcpy(state->s, words, sizeof(state->s));
+	if (!(state->s[0] | state->s[1] | state->s[2] | state->s[3]))
+	    state->s[0] = 1;
+	state->xbuf = words[4];
+	for (i = 0; i < 2 && *input; i++)
+	    state->xbits = (state->xbits << 4) | hexval(*input++);
+	if (state->xbits > 64)
+	    state->xbits = 0;
+	return state;
+    }
 
     byte = digits = 0;
     pos = 0;
     while (*input) {
-	int v = *input++;
-
-	if (v >= '0' && v <= '9')
-	    v = v - '0';
-	else if (v >= 'A' && v <= 'F')
-	    v = v - 'A' + 10;
-	else if (v >= 'a' && v <= 'f')
-	    v = v - 'a' + 10;
-	else
-	    v = 0;
-
-	byte = (byte << 4) | v;
+	byte = (byte << 4) | hexval(*input++);
 	digits++;
 
 	if (digits == 2) {
@@ -349,3 +669,208 @@ random_state *random_state_decode(const char *input)
 
     return state;
 }
+
+#ifdef TESTMODE
+
+/*
+ * Checks the generator against a straightforward reimplementation of
+ * the original one (looped SHA-1, refilled through SHA_Simple-style
+ * padding one byte at a time), and times the two.
+ *
+ * gcc -O2 -DTESTMODE -o random random.c malloc.c
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+
+void fatal(char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "fatal error: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void ref_transform(uint32 *digest, const uint32 *block)
+{
+    uint32 w[80], a, b, c, d, e, tmp;
+    int t;
+
+    for (t = 0; t < 16; t++)
+	w[t] = block[t];
+    for (t = 16; t < 80; t++)
+	w[t] = rol(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16], 1);
+
+    a = digest[0]; b = digest[1]; c = digest[2]; d = digest[3]; e = digest[4];
+    for (t = 0; t < 80; t++) {
+	if (t < 20)
+	    tmp = ((b & c) | (~b & d)) + 0x5a827999;
+	else if (t < 40)
+	    tmp = (b ^ c ^ d) + 0x6ed9eba1;
+	else if (t < 60)
+	    tmp = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+	else
+	    tmp = (b ^ c ^ d) + 0xca62c1d6;
+	tmp += rol(a, 5) + e + w[t];
+	e = d; d = c; c = rol(b, 30); b = a; a = tmp;
+    }
+    digest[0] += a; digest[1] += b; digest[2] += c; digest[3] += d;
+    digest[4] += e;
+}
+
+/* SHA-1 of exactly 40 bytes, the slow way. */
+static void ref_sha40(const unsigned char *in, unsigned char *out)
+{
+    unsigned char buf[64];
+    uint32 h[5], block[16];
+    int i;
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, in, 40);
+    buf[40] = 0x80;
+    buf[63] = 40 * 8 & 0xFF;
+    buf[62] = 40 * 8 >> 8;
+    for (i = 0; i < 16; i++)
+	block[i] = ((uint32)buf[i*4] << 24) | ((uint32)buf[i*4+1] << 16) |
+	    ((uint32)buf[i*4+2] << 8) | buf[i*4+3];
+    SHA_Core_Init(h);
+    ref_transform(h, block);
+    for (i = 0; i < 20; i++)
+	out[i] = (unsigned char)(h[i/4] >> (24 - 8 * (i%4)));
+}
+
+static unsigned long ref_bits(random_state *state, int bits)
+{
+    unsigned long ret = 0;
+    int n, i;
+
+    for (n = 0; n < bits; n += 8) {
+	if (state->pos >= 20) {
+	    for (i = 0; i < 20; i++) {
+		if (state->seedbuf[i] != 0xFF) {
+		    state->seedbuf[i]++;
+		    break;
+		} else
+		    state->seedbuf[i] = 0;
+	    }
+	    ref_sha40(state->seedbuf, state->databuf);
+	    state->pos = 0;
+	}
+	ret = (ret << 8) | state->databuf[state->pos++];
+    }
+    return ret & ((1 << (bits-1)) * 2 - 1);
+}
+
+static double elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1 ? atoi(argv[1]) : 1000000);
+    random_state *a, *b;
+    unsigned long *many, sum;
+    unsigned char bytes[37];
+    clock_t start;
+    int i, j, bits, errors = 0;
+
+    /*
+     * Equivalence: random_bits of every width, and the bulk
+     * functions, against the reference bit stream.
+     */
+    a = random_new("random", 6);
+    b = random_new("random", 6);
+    many = snewn(64, unsigned long);
+    for (i = 0; i < n / 100; i++) {
+	bits = 1 + i % 32;
+	switch (i % 3) {
+	  case 0:
+	    if (random_bits(a, bits) != ref_bits(b, bits))
+		errors++;
+	    break;
+	  case 1:
+	    random_fill(a, bytes, 1 + i % 37);
+	    for (j = 0; j < 1 + i % 37; j++)
+		if (bytes[j] != ref_bits(b, 8))
+		    errors++;
+	    break;
+	  case 2:
+	    random_upto_many(a, 1 + i % 1000, many, 1 + i % 64);
+	    for (j = 0; j < 1 + i % 64; j++)
+		if (many[j] != random_upto(b, 1 + i % 1000))
+		    errors++;
+	    break;
+	}
+	if (memcmp(a->seedbuf, b->seedbuf, 40) || a->pos != b->pos)
+	    errors++;
+    }
+    random_free(a);
+    random_free(b);
+
+    /*
+     * Both kinds of state survive encoding and decoding part way
+     * through a stream.
+     */
+    for (i = 0; i < 2; i++) {
+	const char *seed = (i ? RANDOM_FAST_PREFIX "random" : "random");
+	char *enc;
+
+	a = random_new_seed(seed);
+	random_bits(a, 5);
+	random_bits(a, 17);
+	enc = random_state_encode(a);
+	b = random_state_decode(enc);
+	sfree(enc);
+	for (j = 0; j < 1000; j++)
+	    if (random_bits(a, 1 + j % 32) != random_bits(b, 1 + j % 32))
+		errors++;
+	random_free(a);
+	random_free(b);
+    }
+    printf("%d mismatches\n", errors);
+
+    /*
+     * Timing.
+     */
+    a = random_new("random", 6);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < n; i++)
+	sum += ref_bits(a, 31);
+    printf("reference random_bits(31): %.3fs (%lx)\n", elapsed(start), sum);
+    random_free(a);
+
+    a = random_new("random", 6);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < n; i++)
+	sum += random_bits(a, 31);
+    printf("random_bits(31):           %.3fs (%lx)\n", elapsed(start), sum);
+    random_free(a);
+
+    a = random_new("random", 6);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < n; i++)
+	sum += random_upto(a, 81);
+    printf("random_upto(81):           %.3fs (%lx)\n", elapsed(start), sum);
+    random_free(a);
+
+    a = random_new_fast("random", 6);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < n; i++)
+	sum += random_bits(a, 31);
+    printf("fast random_bits(31):      %.3fs (%lx)\n", elapsed(start), sum);
+    random_free(a);
+
+    sfree(many);
+    return errors != 0;
+}
+
+#endif
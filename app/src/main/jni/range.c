@@ -1797,4 +1797,5 @@ struct game const thegame = {
     FALSE, /* wants_statusbar */
     FALSE, game_timing_state,
     0, /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
@@ -0,0 +1,576 @@
+/*
+ * raster.c: a drawing_api that draws straight into a buffer of
+ * pixels in memory.
+ *
+ * The Android front end can use this to draw into the GameView's
+ * bitmap without going through Java at all (except for text, which
+ * it still leaves to Android so that it looks like the rest of the
+ * system). puzzlesgen uses it to render a puzzle to an image file
+ * with no display at all.
+ *
+ * Coordinates follow the other front ends: the pixel at (x,y) is the
+ * one covered by draw_rect(x, y, 1, 1), so polygon and circle edges
+ * pass through pixel centres, and everything is drawn without
+ * antialiasing. Text uses the small built-in font below, scaled up by
+ * whole pixels to roughly the size asked for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "puzzles.h"
+
+struct raster {
+    unsigned char *pixels;
+    int w, h, stride, format, bpp;
+    int ox, oy;
+    /* The clip rectangle in target pixels; x2 and y2 are exclusive. */
+    int cx1, cy1, cx2, cy2;
+    float *rgb;
+    unsigned long *values;             /* each colour as a pixel */
+    int ncolours;
+    double *points, *crossings;        /* scratch for polygon filling */
+    int pointsize, crossingsize;
+};
+
+struct raster_blitter {
+    int w, h, x, y;
+    unsigned char *data;
+};
+
+/*
+ * A 5x7 font covering printable ASCII, one byte per row with the
+ * leftmost pixel in bit 4.
+ */
+#define GLYPH_W 5
+#define GLYPH_H 7
+static const unsigned char glyphs[][GLYPH_H] = {
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00}, {0x04,0x04,0x04,0x04,0x04,0x00,0x04},
+    {0x0A,0x0A,0x0A,0x00,0x00,0x00,0x00}, {0x0A,0x0A,0x1F,0x0A,0x1F,0x0A,0x0A},
+    {0x04,0x0F,0x14,0x0E,0x05,0x1E,0x04}, {0x18,0x19,0x02,0x04,0x08,0x13,0x03},
+    {0x0C,0x12,0x14,0x08,0x15,0x12,0x0D}, {0x0C,0x04,0x08,0x00,0x00,0x00,0x00},
+    {0x02,0x04,0x08,0x08,0x08,0x04,0x02}, {0x08,0x04,0x02,0x02,0x02,0x04,0x08},
+    {0x00,0x04,0x15,0x0E,0x15,0x04,0x00}, {0x00,0x04,0x04,0x1F,0x04,0x04,0x00},
+    {0x00,0x00,0x00,0x00,0x0C,0x04,0x08}, {0x00,0x00,0x00,0x1F,0x00,0x00,0x00},
+    {0x00,0x00,0x00,0x00,0x00,0x0C,0x0C}, {0x00,0x01,0x02,0x04,0x08,0x10,0x00},
+    {0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E},
+    {0x0E,0x11,0x01,0x02,0x04,0x08,0x1F}, {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E},
+    {0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E},
+    {0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, {0x1F,0x01,0x02,0x04,0x08,0x08,0x08},
+    {0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E}, {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C},
+    {0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00}, {0x00,0x0C,0x0C,0x00,0x0C,0x04,0x08},
+    {0x02,0x04,0x08,0x10,0x08,0x04,0x02}, {0x00,0x00,0x1F,0x00,0x1F,0x00,0x00},
+    {0x08,0x04,0x02,0x01,0x02,0x04,0x08}, {0x0E,0x11,0x01,0x02,0x04,0x00,0x04},
+    {0x0E,0x11,0x01,0x0D,0x15,0x15,0x0E}, {0x0E,0x11,0x11,0x11,0x1F,0x11,0x11},
+    {0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}, {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E},
+    {0x1C,0x12,0x11,0x11,0x11,0x12,0x1C}, {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F},
+    {0x1F,0x10,0x10,0x1E,0x10,0x10,0x10}, {0x0E,0x11,0x10,0x17,0x11,0x11,0x0F},
+    {0x11,0x11,0x11,0x1F,0x11,0x11,0x11}, {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E},
+    {0x07,0x02,0x02,0x02,0x02,0x12,0x0C}, {0x11,0x12,0x14,0x18,0x14,0x12,0x11},
+    {0x10,0x10,0x10,0x10,0x10,0x10,0x1F}, {0x11,0x1B,0x15,0x15,0x11,0x11,0x11},
+    {0x11,0x11,0x19,0x15,0x13,0x11,0x11}, {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E},
+    {0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}, {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D},
+    {0x1E,0x11,0x11,0x1E,0x14,0x12,0x11}, {0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E},
+    {0x1F,0x04,0x04,0x04,0x04,0x04,0x04}, {0x11,0x11,0x11,0x11,0x11,0x11,0x0E},
+    {0x11,0x11,0x11,0x11,0x11,0x0A,0x04}, {0x11,0x11,0x11,0x15,0x15,0x15,0x0A},
+    {0x11,0x11,0x0A,0x04,0x0A,0x11,0x11}, {0x11,0x11,0x11,0x0A,0x04,0x04,0x04},
+    {0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}, {0x0E,0x08,0x08,0x08,0x08,0x08,0x0E},
+    {0x00,0x10,0x08,0x04,0x02,0x01,0x00}, {0x0E,0x02,0x02,0x02,0x02,0x02,0x0E},
+    {0x04,0x0A,0x11,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00,0x1F},
+    {0x08,0x04,0x02,0x00,0x00,0x00,0x00}, {0x00,0x00,0x0E,0x01,0x0F,0x11,0x0F},
+    {0x10,0x10,0x16,0x19,0x11,0x11,0x1E}, {0x00,0x00,0x0E,0x10,0x10,0x11,0x0E},
+    {0x01,0x01,0x0D,0x13,0x11,0x11,0x0F}, {0x00,0x00,0x0E,0x11,0x1F,0x10,0x0E},
+    {0x06,0x09,0x08,0x1C,0x08,0x08,0x08}, {0x00,0x0F,0x11,0x11,0x0F,0x01,0x0E},
+    {0x10,0x10,0x16,0x19,0x11,0x11,0x11}, {0x04,0x00,0x0C,0x04,0x04,0x04,0x0E},
+    {0x02,0x00,0x06,0x02,0x02,0x12,0x0C}, {0x10,0x10,0x12,0x14,0x18,0x14,0x12},
+    {0x0C,0x04,0x04,0x04,0x04,0x04,0x0E}, {0x00,0x00,0x1A,0x15,0x15,0x11,0x11},
+    {0x00,0x00,0x16,0x19,0x11,0x11,0x11}, {0x00,0x00,0x0E,0x11,0x11,0x11,0x0E},
+    {0x00,0x00,0x1E,0x11,0x1E,0x10,0x10}, {0x00,0x00,0x0D,0x13,0x0F,0x01,0x01},
+    {0x00,0x00,0x16,0x19,0x10,0x10,0x10}, {0x00,0x00,0x0E,0x10,0x0E,0x01,0x1E},
+    {0x08,0x08,0x1C,0x08,0x08,0x09,0x06}, {0x00,0x00,0x11,0x11,0x11,0x13,0x0D},
+    {0x00,0x00,0x11,0x11,0x11,0x0A,0x04}, {0x00,0x00,0x11,0x11,0x15,0x15,0x0A},
+    {0x00,0x00,0x11,0x0A,0x04,0x0A,0x11}, {0x00,0x00,0x11,0x11,0x0F,0x01,0x0E},
+    {0x00,0x00,0x1F,0x02,0x04,0x08,0x1F}, {0x02,0x04,0x04,0x08,0x04,0x04,0x02},
+    {0x04,0x04,0x04,0x04,0x04,0x04,0x04}, {0x08,0x04,0x04,0x02,0x04,0x04,0x08},
+    {0x00,0x00,0x08,0x15,0x02,0x00,0x00},
+};
+/* A few more that puzzles use, and a box for anything else. */
+static const unsigned char glyph_times[GLYPH_H] =
+    {0x00,0x11,0x0A,0x04,0x0A,0x11,0x00};
+static const unsigned char glyph_divide[GLYPH_H] =
+    {0x00,0x04,0x00,0x1F,0x00,0x04,0x00};
+static const unsigned char glyph_unknown[GLYPH_H] =
+    {0x1F,0x11,0x11,0x11,0x11,0x11,0x1F};
+
+raster *raster_new(void)
+{
+    raster *r = snew(raster);
+
+    memset(r, 0, sizeof(raster));
+    return r;
+}
+
+void raster_free(raster *r)
+{
+    sfree(r->rgb);
+    sfree(r->values);
+    sfree(r->points);
+    sfree(r->crossings);
+    sfree(r);
+}
+
+static void raster_pack_colours(raster *r)
+{
+    int i;
+
+    for (i = 0; i < r->ncolours; i++) {
+        int red = (int)(r->rgb[3*i] * 255.0F + 0.5F);
+        int green = (int)(r->rgb[3*i+1] * 255.0F + 0.5F);
+        int blue = (int)(r->rgb[3*i+2] * 255.0F + 0.5F);
+
+        if (r->format == RASTER_RGB565) {
+            r->values[i] = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+        } else {
+            unsigned char bytes[4];
+            unsigned int value;
+
+            bytes[0] = red;
+            bytes[1] = green;
+            bytes[2] = blue;
+            bytes[3] = 255;
+            memcpy(&value, bytes, 4);
+            r->values[i] = value;
+        }
+    }
+}
+
+void raster_set_target(raster *r, void *pixels, int w, int h, int stride,
+                       int format)
+{
+    assert(format == RASTER_RGBA8888 || format == RASTER_RGB565);
+    r->pixels = pixels;
+    r->w = w;
+    r->h = h;
+    r->stride = stride;
+    if (format != r->format) {
+        r->format = format;
+        raster_pack_colours(r);
+    }
+    r->bpp = (format == RASTER_RGB565 ? 2 : 4);
+    r->cx1 = r->cy1 = 0;
+    r->cx2 = w;
+    r->cy2 = h;
+}
+
+void raster_set_origin(raster *r, int ox, int oy)
+{
+    r->ox = ox;
+    r->oy = oy;
+}
+
+void raster_set_colours(raster *r, const float *colours, int ncolours)
+{
+    r->ncolours = ncolours;
+    r->rgb = sresize(r->rgb, 3 * ncolours, float);
+    r->values = sresize(r->values, ncolours, unsigned long);
+    memcpy(r->rgb, colours, 3 * ncolours * sizeof(float));
+    raster_pack_colours(r);
+}
+
+int raster_ncolours(raster *r)
+{
+    return r->ncolours;
+}
+
+/*
+ * Fill pixels x1..x2 inclusive of row y, in target coordinates, as
+ * far as they're inside the clip rectangle.
+ */
+static void raster_span(raster *r, int y, int x1, int x2, int colour)
+{
+    unsigned long value;
+    unsigned char *p;
+    int x;
+
+    if (y < r->cy1 || y >= r->cy2) return;
+    if (x1 < r->cx1) x1 = r->cx1;
+    if (x2 >= r->cx2) x2 = r->cx2 - 1;
+    if (x1 > x2) return;
+    assert(colour >= 0 && colour < r->ncolours);
+    value = r->values[colour];
+    p = r->pixels + y * r->stride + x1 * r->bpp;
+    if (r->format == RASTER_RGB565) {
+        unsigned short *q = (unsigned short *)p;
+        for (x = x1; x <= x2; x++)
+            *q++ = (unsigned short)value;
+    } else {
+        unsigned int *q = (unsigned int *)p;
+        for (x = x1; x <= x2; x++)
+            *q++ = (unsigned int)value;
+    }
+}
+
+static void raster_rect(void *handle, int x, int y, int w, int h, int colour)
+{
+    raster *r = (raster *)handle;
+    int y1 = y + r->oy, y2 = y1 + h - 1, x1 = x + r->ox, x2 = x1 + w - 1;
+
+    if (y1 < r->cy1) y1 = r->cy1;
+    if (y2 >= r->cy2) y2 = r->cy2 - 1;
+    for (y = y1; y <= y2; y++)
+        raster_span(r, y, x1, x2, colour);
+}
+
+/* Bresenham, in target coordinates, including both ends. */
+static void raster_line_target(raster *r, int x1, int y1, int x2, int y2,
+                               int colour)
+{
+    int dx = abs(x2 - x1), dy = -abs(y2 - y1);
+    int sx = x1 < x2 ? 1 : -1, sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    while (1) {
+        raster_span(r, y1, x1, x1, colour);
+        if (x1 == x2 && y1 == y2) break;
+        e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+static void raster_line(void *handle, int x1, int y1, int x2, int y2,
+                        int colour)
+{
+    raster *r = (raster *)handle;
+
+    raster_line_target(r, x1 + r->ox, y1 + r->oy, x2 + r->ox, y2 + r->oy,
+                       colour);
+}
+
+static int compare_doubles(const void *av, const void *bv)
+{
+    double a = *(const double *)av, b = *(const double *)bv;
+
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Fill a polygon given in target coordinates, even-odd, taking the
+ * pixels whose centres are inside it. Each edge counts at the rows
+ * from its upper end down to just short of its lower one, so a shared
+ * vertex is crossed once and shared edges don't leave gaps.
+ */
+static void raster_fill(raster *r, const double *coords, int npoints,
+                        int colour)
+{
+    double ymin = coords[1], ymax = coords[1];
+    int i, y, y1, y2, n;
+
+    for (i = 1; i < npoints; i++) {
+        if (coords[2*i+1] < ymin) ymin = coords[2*i+1];
+        if (coords[2*i+1] > ymax) ymax = coords[2*i+1];
+    }
+    y1 = (int)ceil(ymin);
+    y2 = (int)ceil(ymax) - 1;
+    if (y1 < r->cy1) y1 = r->cy1;
+    if (y2 >= r->cy2) y2 = r->cy2 - 1;
+
+    if (r->crossingsize < npoints) {
+        r->crossingsize = npoints;
+        r->crossings = sresize(r->crossings, npoints, double);
+    }
+
+    for (y = y1; y <= y2; y++) {
+        n = 0;
+        for (i = 0; i < npoints; i++) {
+            const double *a = coords + 2*i;
+            const double *b = coords + 2*((i+1) % npoints);
+            if ((a[1] <= y && y < b[1]) || (b[1] <= y && y < a[1]))
+                r->crossings[n++] =
+                    a[0] + (y - a[1]) * (b[0] - a[0]) / (b[1] - a[1]);
+        }
+        qsort(r->crossings, n, sizeof(double), compare_doubles);
+        for (i = 0; i + 1 < n; i += 2)
+            raster_span(r, y, (int)ceil(r->crossings[i]),
+                        (int)ceil(r->crossings[i+1]) - 1, colour);
+    }
+}
+
+static void raster_polygon(void *handle, int *coords, int npoints,
+                           int fillcolour, int outlinecolour)
+{
+    raster *r = (raster *)handle;
+    int i;
+
+    assert(outlinecolour != -1);
+    if (fillcolour != -1) {
+        if (r->pointsize < npoints) {
+            r->pointsize = npoints;
+            r->points = sresize(r->points, 2 * npoints, double);
+        }
+        for (i = 0; i < npoints; i++) {
+            r->points[2*i] = coords[2*i] + r->ox;
+            r->points[2*i+1] = coords[2*i+1] + r->oy;
+        }
+        raster_fill(r, r->points, npoints, fillcolour);
+    }
+    for (i = 0; i < npoints; i++) {
+        int j = (i + 1) % npoints;
+        raster_line_target(r, coords[2*i] + r->ox, coords[2*i+1] + r->oy,
+                           coords[2*j] + r->ox, coords[2*j+1] + r->oy,
+                           outlinecolour);
+    }
+}
+
+static void raster_circle(void *handle, int cx, int cy, int radius,
+                          int fillcolour, int outlinecolour)
+{
+    raster *r = (raster *)handle;
+    int x, y, err;
+
+    assert(outlinecolour != -1);
+    cx += r->ox;
+    cy += r->oy;
+    if (fillcolour != -1) {
+        for (y = -radius; y <= radius; y++) {
+            int hw = (int)sqrt((double)radius * radius - (double)y * y);
+            raster_span(r, cy + y, cx - hw, cx + hw, fillcolour);
+        }
+    }
+
+    /* The midpoint circle algorithm, an octant at a time. */
+    x = radius;
+    y = 0;
+    err = 1 - radius;
+    while (x >= y) {
+        raster_span(r, cy + y, cx + x, cx + x, outlinecolour);
+        raster_span(r, cy + y, cx - x, cx - x, outlinecolour);
+        raster_span(r, cy - y, cx + x, cx + x, outlinecolour);
+        raster_span(r, cy - y, cx - x, cx - x, outlinecolour);
+        raster_span(r, cy + x, cx + y, cx + y, outlinecolour);
+        raster_span(r, cy + x, cx - y, cx - y, outlinecolour);
+        raster_span(r, cy - x, cx + y, cx + y, outlinecolour);
+        raster_span(r, cy - x, cx - y, cx - y, outlinecolour);
+        y++;
+        if (err < 0) {
+            err += 2 * y + 1;
+        } else {
+            x--;
+            err += 2 * (y - x) + 1;
+        }
+    }
+}
+
+static void raster_thick_line(void *handle, float thickness,
+                              float x1, float y1, float x2, float y2,
+                              int colour)
+{
+    raster *r = (raster *)handle;
+    double len = sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+    double tx, ty, d[8];
+
+    if (len == 0) {
+        raster_rect(r, (int)(x1 - thickness/2 + 0.5), (int)(y1 - thickness/2 + 0.5),
+                    (int)(thickness + 0.5), (int)(thickness + 0.5), colour);
+        return;
+    }
+    /* Half the thickness, across the line. */
+    tx = (y1 - y2) / len * thickness / 2;
+    ty = (x2 - x1) / len * thickness / 2;
+    d[0] = x1 + tx + r->ox; d[1] = y1 + ty + r->oy;
+    d[2] = x2 + tx + r->ox; d[3] = y2 + ty + r->oy;
+    d[4] = x2 - tx + r->ox; d[5] = y2 - ty + r->oy;
+    d[6] = x1 - tx + r->ox; d[7] = y1 - ty + r->oy;
+    raster_fill(r, d, 4, colour);
+}
+
+static const unsigned char *raster_glyph(const char **text)
+{
+    const unsigned char *p = (const unsigned char *)*text;
+    unsigned long c = *p++;
+
+    /* Decode UTF-8, as far as knowing which character it is. */
+    if (c >= 0xC0) {
+        int more = (c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1);
+        c &= (0x3F >> more);
+        while (more-- > 0 && (*p & 0xC0) == 0x80)
+            c = (c << 6) | (*p++ & 0x3F);
+    }
+    *text = (const char *)p;
+
+    if (c >= 32 && c < 127)
+        return glyphs[c - 32];
+    else if (c == 0xD7)                /* multiplication sign */
+        return glyph_times;
+    else if (c == 0xF7)                /* division sign */
+        return glyph_divide;
+    else if (c == 0x2212)              /* minus sign */
+        return glyphs['-' - 32];
+    return glyph_unknown;
+}
+
+static void raster_text(void *handle, int x, int y, int fonttype,
+                        int fontsize, int align, int colour, char *text)
+{
+    raster *r = (raster *)handle;
+    int scale = max(1, (fontsize + 5) / 10), advance = (GLYPH_W + 1) * scale;
+    int nchars = 0, width, row, col;
+    const char *p;
+
+    for (p = text; *p; nchars++)
+        raster_glyph(&p);
+    width = nchars * advance - scale;
+
+    x += r->ox;
+    y += r->oy;
+    if (align & ALIGN_HCENTRE)
+        x -= width / 2;
+    else if (align & ALIGN_HRIGHT)
+        x -= width;
+    if (align & ALIGN_VCENTRE)
+        y -= GLYPH_H * scale / 2;
+    else
+        y -= GLYPH_H * scale;          /* y was the baseline */
+
+    for (p = text; *p; x += advance) {
+        const unsigned char *glyph = raster_glyph(&p);
+        for (row = 0; row < GLYPH_H * scale; row++) {
+            unsigned char bits = glyph[row / scale];
+            for (col = 0; col < GLYPH_W; col++)
+                if (bits & (0x10 >> col))
+                    raster_span(r, y + row, x + col * scale,
+                                x + (col + 1) * scale - 1, colour);
+        }
+    }
+}
+
+static void raster_clip(void *handle, int x, int y, int w, int h)
+{
+    raster *r = (raster *)handle;
+
+    r->cx1 = max(0, x + r->ox);
+    r->cy1 = max(0, y + r->oy);
+    r->cx2 = min(r->w, x + r->ox + w);
+    r->cy2 = min(r->h, y + r->oy + h);
+}
+
+static void raster_unclip(void *handle)
+{
+    raster *r = (raster *)handle;
+
+    r->cx1 = r->cy1 = 0;
+    r->cx2 = r->w;
+    r->cy2 = r->h;
+}
+
+static void raster_nothing(void *handle)
+{
+}
+
+static void raster_status_bar(void *handle, char *text)
+{
+}
+
+static blitter *raster_blitter_new(void *handle, int w, int h)
+{
+    struct raster_blitter *bl = snew(struct raster_blitter);
+
+    bl->w = w;
+    bl->h = h;
+    bl->x = bl->y = 0;
+    /* Big enough for either format, in case the target changes. */
+    bl->data = snewn(w * h * 4, unsigned char);
+    memset(bl->data, 0, w * h * 4);
+    return (blitter *)bl;
+}
+
+static void raster_blitter_free(void *handle, blitter *vbl)
+{
+    struct raster_blitter *bl = (struct raster_blitter *)vbl;
+
+    sfree(bl->data);
+    sfree(bl);
+}
+
+/*
+ * Copy between the blitter and the target, for the rows and columns
+ * where the blitter at (x,y) overlaps [x1,x2) by [y1,y2).
+ */
+static void raster_blitter_copy(raster *r, struct raster_blitter *bl,
+                                int x, int y, int x1, int y1, int x2, int y2,
+                                int save)
+{
+    int row, left = max(x, x1), right = min(x + bl->w, x2);
+
+    if (left >= right) return;
+    for (row = max(y, y1); row < min(y + bl->h, y2); row++) {
+        unsigned char *pix = r->pixels + row * r->stride + left * r->bpp;
+        unsigned char *saved = bl->data +
+            ((row - y) * bl->w + (left - x)) * r->bpp;
+        if (save)
+            memcpy(saved, pix, (right - left) * r->bpp);
+        else
+            memcpy(pix, saved, (right - left) * r->bpp);
+    }
+}
+
+static void raster_blitter_save(void *handle, blitter *vbl, int x, int y)
+{
+    raster *r = (raster *)handle;
+    struct raster_blitter *bl = (struct raster_blitter *)vbl;
+
+    bl->x = x;
+    bl->y = y;
+    raster_blitter_copy(r, bl, x + r->ox, y + r->oy, 0, 0, r->w, r->h, TRUE);
+}
+
+static void raster_blitter_load(void *handle, blitter *vbl, int x, int y)
+{
+    raster *r = (raster *)handle;
+    struct raster_blitter *bl = (struct raster_blitter *)vbl;
+
+    if (x == BLITTER_FROMSAVED && y == BLITTER_FROMSAVED) {
+        x = bl->x;
+        y = bl->y;
+    }
+    raster_blitter_copy(r, bl, x + r->ox, y + r->oy,
+                        r->cx1, r->cy1, r->cx2, r->cy2, FALSE);
+}
+
+static char *raster_text_fallback(void *handle, const char *const *strings,
+                                  int nstrings)
+{
+    return dupstr(strings[0]);
+}
+
+const struct drawing_api raster_drawing = {
+    raster_text,
+    raster_rect,
+    raster_line,
+    raster_polygon,
+    raster_circle,
+    NULL,                              /* draw_update */
+    raster_clip,
+    raster_unclip,
+    raster_nothing,                    /* start_draw */
+    raster_nothing,                    /* end_draw */
+    raster_status_bar,
+    raster_blitter_new,
+    raster_blitter_free,
+    raster_blitter_save,
+    raster_blitter_load,
+    NULL, NULL, NULL, NULL, NULL, NULL, /* {begin,end}_{doc,page,puzzle} */
+    NULL, NULL,                        /* line_width, line_dotted */
+    raster_text_fallback,
+    NULL,                              /* changed_state */
+    raster_thick_line,
+};
@@ -354,7 +354,7 @@ static void merge_vertices(int *connected,
 	border = sc->border[i] || sc->border[j];
     }
 
-    dsf_merge(connected, i, j);
+    dsf_merge_by_size(connected, NULL, i, j);
 
     if (sc) {
 	i = dsf_canonify(connected, i);
@@ -713,7 +713,7 @@ static int slant_solve(int w, int h, const signed char *clues,
 			    return 0;
 			}
 			sv1 = sv1 ? sv1 : sv2;
-			dsf_merge(sc->equiv, mj1, mj2);
+			dsf_merge_by_size(sc->equiv, NULL, mj1, mj2);
 			mj1 = dsf_canonify(sc->equiv, mj1);
 			sc->slashval[mj1] = sv1;
 		    }
@@ -881,7 +881,7 @@ static int slant_solve(int w, int h, const signed char *clues,
                     int n1 = y*w+x, n2 = y*w+(x+1);
                     if (dsf_canonify(sc->equiv, n1) !=
                         dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                        dsf_merge_by_size(sc->equiv, NULL, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
@@ -895,7 +895,7 @@ static int slant_solve(int w, int h, const signed char *clues,
                     int n1 = y*w+x, n2 = (y+1)*w+x;
                     if (dsf_canonify(sc->equiv, n1) !=
                         dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                        dsf_merge_by_size(sc->equiv, NULL, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
@@ -2225,6 +2225,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -88,6 +88,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
 
 #ifdef STANDALONE_SOLVER
 #include <stdarg.h>
@@ -176,7 +177,7 @@ static int find_sum_bits(unsigned long *array, int idx, int value_left,
     return idx;
 }
 
-static void precompute_sum_bits(void)
+static void compute_sum_bits(void)
 {
     int i;
     for (i = 3; i < 31; i++) {
@@ -200,6 +201,13 @@ static void precompute_sum_bits(void)
     }
 }
 
+/* Fill in the tables once, however many threads get here at once. */
+static void precompute_sum_bits(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, compute_sum_bits);
+}
+
 struct game_params {
     /*
      * For a square puzzle, `c' and `r' indicate the puzzle
@@ -3163,16 +3171,9 @@ static void dsf_to_blocks(int *dsf, struct block_structure *blocks,
 			  int min_expected, int max_expected)
 {
     int cr = blocks->c * blocks->r, area = cr * cr;
-    int i, nb = 0;
+    int nb;
 
-    for (i = 0; i < area; i++)
-	blocks->whichblock[i] = -1;
-    for (i = 0; i < area; i++) {
-	int j = dsf_canonify(dsf, i);
-	if (blocks->whichblock[j] < 0)
-	    blocks->whichblock[j] = nb++;
-	blocks->whichblock[i] = blocks->whichblock[j];
-    }
+    dsf_flatten(dsf, area, blocks->whichblock, NULL, &nb);
     assert(nb >= min_expected && nb <= max_expected);
     blocks->nr_blocks = nb;
 }
@@ -3561,6 +3562,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     char *desc;
     int coords[16], ncoords;
     int x, y, i, j;
+    int cancelled = FALSE;
     struct difficulty dlev;
 
     precompute_sum_bits();
@@ -3596,6 +3598,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
      */
     while (1) {
 
+        if (random_cancelled(rs)) {
+            cancelled = TRUE;
+            break;
+        }
+        PROFILE_COUNT("solo.grids");
+
         /*
          * Generate a random solved state, starting by
          * constructing the block structure.
@@ -3618,8 +3626,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 	    kblocks = gen_killer_cages(cr, rs, params->kdiff > DIFF_KSINGLE);
 	}
 
-        if (!gridgen(cr, blocks, kblocks, params->xtype, grid, rs, area*area))
+        PROFILE_BEGIN("solo.gridgen");
+        if (!gridgen(cr, blocks, kblocks, params->xtype, grid, rs, area*area)) {
+            PROFILE_END("solo.gridgen");
 	    continue;
+        }
+        PROFILE_END("solo.gridgen");
 
         assert(check_valid(cr, blocks, kblocks, params->xtype, grid));
 
@@ -3657,7 +3669,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 		compute_kclues(kblocks, kgrid, grid2, area);
 
 		memset(grid, 0, area * sizeof *grid);
+		PROFILE_BEGIN("solo.solve");
 		solver(cr, blocks, kblocks, params->xtype, grid, kgrid, &dlev);
+		PROFILE_END("solo.solve");
 		if (dlev.diff == dlev.maxdiff && dlev.kdiff == dlev.maxkdiff) {
 		    /*
 		     * We have one that matches our difficulty.  Store it for
@@ -3740,6 +3754,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
         /*
          * Now shuffle that list.
          */
+        PROFILE_BEGIN("solo.remove_clues");
         shuffle(locs, nlocs, sizeof(*locs), rs);
 
         /*
@@ -3756,20 +3771,26 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             for (j = 0; j < ncoords; j++)
                 grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
 
+            PROFILE_BEGIN("solo.solve");
             solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
+            PROFILE_END("solo.solve");
             if (dlev.diff <= dlev.maxdiff &&
 		(!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
                 for (j = 0; j < ncoords; j++)
                     grid[coords[2*j+1]*cr+coords[2*j]] = 0;
             }
         }
+        PROFILE_END("solo.remove_clues");
 
         memcpy(grid2, grid, area);
 
+	PROFILE_BEGIN("solo.solve");
 	solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
+	PROFILE_END("solo.solve");
 	if (dlev.diff == dlev.maxdiff &&
 	    (!params->killer || dlev.kdiff == dlev.maxkdiff))
 	    break;		       /* found one! */
+	PROFILE_COUNT("solo.wrong_difficulty");
     }
 
     sfree(grid2);
@@ -3779,12 +3800,18 @@ static char *new_game_desc(const game_params *params, random_state *rs,
      * Now we have the grid as it will be presented to the user.
      * Encode it in a game desc.
      */
-    desc = encode_puzzle_desc(params, grid, blocks, kgrid, kblocks);
+    if (cancelled) {
+        sfree(*aux);
+        *aux = NULL;
+        desc = NULL;
+    } else
+        desc = encode_puzzle_desc(params, grid, blocks, kgrid, kblocks);
 
     sfree(grid);
     free_block_structure(blocks);
     if (params->killer) {
-        free_block_structure(kblocks);
+        if (kblocks)
+            free_block_structure(kblocks);
         sfree(kgrid);
     }
 
@@ -4205,6 +4232,64 @@ static void free_game(game_state *state)
     sfree(state);
 }
 
+/*
+ * A checkpoint for the save file: the flags, the grid in hex, and the
+ * pencil marks packed one bit each. Everything else (the blocks, the
+ * killer sums, which squares were clues) is fixed by the game
+ * description, so it comes from the initial state.
+ */
+static char *encode_state(const game_state *state)
+{
+    int cr = state->cr, area = cr * cr, nbits = area * cr;
+    unsigned char *bits = snewn((nbits + 7) / 8, unsigned char);
+    char *grid, *pencil, *ret;
+    int i;
+
+    memset(bits, 0, (nbits + 7) / 8);
+    for (i = 0; i < nbits; i++)
+	if (state->pencil[i])
+	    bits[i / 8] |= 0x80 >> (i % 8);
+    grid = bin2hex(state->grid, area);
+    pencil = bin2hex(bits, (nbits + 7) / 8);
+    ret = snewn(strlen(grid) + strlen(pencil) + 40, char);
+    sprintf(ret, "%d,%d,%s,%s", state->completed, state->cheated,
+	    grid, pencil);
+    sfree(grid);
+    sfree(pencil);
+    sfree(bits);
+    return ret;
+}
+
+static game_state *decode_state(const game_state *base, const char *encoding)
+{
+    int cr = base->cr, area = cr * cr, nbits = area * cr;
+    int completed, cheated, i, n = 0;
+    unsigned char *grid, *bits;
+    game_state *ret;
+
+    if (sscanf(encoding, "%d,%d,%n", &completed, &cheated, &n) < 2 ||
+	n == 0 || strlen(encoding + n) != (size_t)area * 2 + 1 +
+	(nbits + 7) / 8 * 2 || encoding[n + area * 2] != ',')
+	return NULL;
+    grid = hex2bin(encoding + n, area);
+    for (i = 0; i < area; i++)
+	if (grid[i] > cr || (base->immutable[i] && grid[i] != base->grid[i])) {
+	    sfree(grid);
+	    return NULL;
+	}
+    bits = hex2bin(encoding + n + area * 2 + 1, (nbits + 7) / 8);
+
+    ret = dup_game(base);
+    ret->completed = completed;
+    ret->cheated = cheated;
+    memcpy(ret->grid, grid, area);
+    for (i = 0; i < nbits; i++)
+	ret->pencil[i] = (bits[i / 8] >> (7 - i % 8)) & 1;
+    sfree(grid);
+    sfree(bits);
+    return ret;
+}
+
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *ai, char **error)
 {
@@ -5594,6 +5679,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    encode_state, decode_state,
 };
 
 #ifdef STANDALONE_SOLVER
@@ -1834,7 +1834,9 @@ static game_state *execute_move(const game_state *state, const char *move)
                     capacity[nedges] = 1;
                     nedges++;
                 }
-	n = maxflow(w*h+2, w*h, w*h+1, nedges, edges, capacity, flow, NULL);
+	/* Only the size of the matching matters here, so use Dinic. */
+	n = maxflow_alg(MAXFLOW_DINIC, w*h+2, w*h, w*h+1, nedges, edges,
+			capacity, flow, NULL);
 
         sfree(flow);
         sfree(capacity);
@@ -2625,6 +2627,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -594,10 +594,12 @@ static int solver(int w, int *clues, digit *soln, int maxdiff)
     ctx.iscratch = snewn(w, long);
     ctx.dscratch = snewn(w+1, int);
 
+    PROFILE_BEGIN("towers.solve");
     ret = latin_solver(soln, w, maxdiff,
 		       DIFF_EASY, DIFF_HARD, DIFF_EXTREME,
 		       DIFF_EXTREME, DIFF_UNREASONABLE,
 		       towers_solvers, &ctx, NULL, NULL);
+    PROFILE_END("towers.solve");
 
     sfree(ctx.iscratch);
     sfree(ctx.dscratch);
@@ -651,6 +653,12 @@ done
     order = snewn(max(4*w,a), int);
 
     while (1) {
+	if (random_cancelled(rs)) {
+	    desc = NULL;
+	    goto cleanup;
+	}
+	PROFILE_COUNT("towers.grids");
+
 	/*
 	 * Construct a latin square to be the solution.
 	 */
@@ -688,10 +696,13 @@ done
 	     */
 	    memset(soln2, 0, a);
 	    ret = solver(w, clues, soln2, diff);
-	    if (ret > diff)
+	    if (ret > diff) {
+		PROFILE_COUNT("towers.wrong_difficulty");
 		continue;
+	    }
 	}
 
+	PROFILE_BEGIN("towers.remove_clues");
 	for (i = 0; i < a; i++)
 	    order[i] = i;
 	shuffle(order, a, sizeof(*order), rs);
@@ -720,6 +731,7 @@ done
 		    clues[j] = clue;
 	    }
 	}
+	PROFILE_END("towers.remove_clues");
 
 	/*
 	 * See if the game can be solved at the specified difficulty
@@ -727,8 +739,10 @@ done
 	 */
 	memcpy(soln2, grid, a);
 	ret = solver(w, clues, soln2, diff);
-	if (ret != diff)
+	if (ret != diff) {
+	    PROFILE_COUNT("towers.wrong_difficulty");
 	    continue;		       /* go round again */
+	}
 
 	/*
 	 * We've got a usable puzzle!
@@ -794,6 +808,7 @@ done
 	(*aux)[i+1] = '0' + soln[i];
     (*aux)[a+1] = '\0';
 
+  cleanup:
     sfree(grid);
     sfree(clues);
     sfree(soln);
@@ -2012,6 +2027,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -43,10 +43,20 @@
 #endif
 
 typedef struct node234_Tag node234;
+typedef struct nodechunk234_Tag nodechunk234;
 
 struct tree234_Tag {
     node234 *root;
     cmpfn234 cmp;
+    /*
+     * Node pool, for trees made by newpooltree234: `chunks' is the
+     * list of blocks the nodes came from, and `freenodes' a list of
+     * nodes not in use, chained through their parent pointers. For
+     * other trees, `chunksize' is zero and nodes are malloced singly.
+     */
+    nodechunk234 *chunks;
+    node234 *freenodes;
+    int chunksize;
 };
 
 struct node234_Tag {
@@ -56,6 +66,15 @@ struct node234_Tag {
     void *elems[3];
 };
 
+struct nodechunk234_Tag {
+    nodechunk234 *next;
+    node234 nodes[1];		       /* really as many as there's room for */
+};
+
+/* Sizes of the first and largest blocks of nodes in a pool. */
+#define POOLMIN 8
+#define POOLMAX 256
+
 /*
  * Create a 2-3-4 tree.
  */
@@ -64,11 +83,132 @@ tree234 *newtree234(cmpfn234 cmp) {
     LOG(("created tree %p\n", ret));
     ret->root = NULL;
     ret->cmp = cmp;
+    ret->chunks = NULL;
+    ret->freenodes = NULL;
+    ret->chunksize = 0;
+    return ret;
+}
+
+tree234 *newpooltree234(cmpfn234 cmp) {
+    tree234 *ret = newtree234(cmp);
+    ret->chunksize = POOLMIN;
     return ret;
 }
 
 /*
- * Free a 2-3-4 tree (not including freeing the elements).
+ * Get a node for a tree, from its pool if it has one. When the pool
+ * runs dry we malloc another block of nodes, each twice the size of
+ * the last up to POOLMAX, so a small tree doesn't tie up much memory
+ * and a large one doesn't make many calls to malloc.
+ */
+static node234 *newnode234(tree234 *t) {
+    node234 *n;
+
+    if (!t->chunksize)
+	return snew(node234);
+
+    if (!t->freenodes) {
+	nodechunk234 *c;
+	int i;
+
+	c = smalloc(sizeof(nodechunk234) +
+		    (t->chunksize - 1) * sizeof(node234));
+	LOG(("pool of tree %p grows by %d nodes\n", t, t->chunksize));
+	c->next = t->chunks;
+	t->chunks = c;
+	for (i = t->chunksize; i-- > 0 ;) {
+	    c->nodes[i].parent = t->freenodes;
+	    t->freenodes = &c->nodes[i];
+	}
+	if (t->chunksize < POOLMAX)
+	    t->chunksize *= 2;
+    }
+
+    n = t->freenodes;
+    t->freenodes = n->parent;
+    return n;
+}
+
+static void releasenode234(tree234 *t, node234 *n) {
+    if (!t->chunksize) {
+	sfree(n);
+    } else {
+	n->parent = t->freenodes;
+	t->freenodes = n;
+    }
+}
+
+/*
+ * Build a subtree of the given height (1 for a leaf) holding
+ * array[0..n-1]. A subtree of height h can hold anything from 2^h-1
+ * elements (all 2-nodes) to 4^h-1 (all 4-nodes); we give this node
+ * as few children as will hold n, and share the elements out between
+ * them as evenly as possible, which keeps each child within the
+ * range for its own height.
+ */
+static node234 *buildnode234(tree234 *t, void **array, int n,
+			     int height) {
+    node234 *node = newnode234(t);
+    int nkids, i;
+
+    node->parent = NULL;
+    for (i = 0; i < 4; i++) {
+	node->kids[i] = NULL;
+	node->counts[i] = 0;
+    }
+    for (i = 0; i < 3; i++)
+	node->elems[i] = NULL;
+
+    if (height == 1) {
+	assert(n >= 1 && n <= 3);
+	for (i = 0; i < n; i++)
+	    node->elems[i] = array[i];
+    } else {
+	int kidmax = 1, share, extra;
+	for (i = 1; i < height; i++)
+	    kidmax *= 4;
+	kidmax--;
+	for (nkids = 2; nkids < 4; nkids++)
+	    if (n - (nkids-1) <= nkids * kidmax)
+		break;
+	share = (n - (nkids-1)) / nkids;
+	extra = (n - (nkids-1)) % nkids;
+	for (i = 0; i < nkids; i++) {
+	    int count = share + (i < extra);
+	    node->kids[i] = buildnode234(t, array, count, height-1);
+	    node->kids[i]->parent = node;
+	    node->counts[i] = count;
+	    array += count;
+	    if (i < nkids-1)
+		node->elems[i] = *array++;
+	}
+    }
+    return node;
+}
+
+tree234 *buildtree234(cmpfn234 cmp, void **array, int n) {
+    tree234 *ret = newtree234(cmp);
+    int height, capacity;
+
+#ifndef NDEBUG
+    if (cmp) {
+	int i;
+	for (i = 1; i < n; i++)
+	    assert(cmp(array[i-1], array[i]) < 0);
+    }
+#endif
+
+    if (n > 0) {
+	for (height = 1, capacity = 3; capacity < n; height++)
+	    capacity = capacity * 4 + 3;
+	ret->root = buildnode234(ret, array, n, height);
+    }
+    return ret;
+}
+
+/*
+ * Free a 2-3-4 tree (not including freeing the elements). A pooled
+ * tree's nodes all go back with its blocks, in use or not.
  */
 static void freenode234(node234 *n) {
     if (!n)
@@ -80,7 +220,15 @@ static void freenode234(node234 *n) {
     sfree(n);
 }
 void freetree234(tree234 *t) {
-    freenode234(t->root);
+    if (!t->chunksize) {
+	freenode234(t->root);
+    } else {
+	while (t->chunks) {
+	    nodechunk234 *c = t->chunks;
+	    t->chunks = c->next;
+	    sfree(c);
+	}
+    }
     sfree(t);
 }
 
@@ -114,7 +262,7 @@ int count234(tree234 *t) {
  * Propagate a node overflow up a tree until it stops. Returns 0 or
  * 1, depending on whether the root had to be split or not.
  */
-static int add234_insert(node234 *left, void *e, node234 *right,
+static int add234_insert(tree234 *t, node234 *left, void *e, node234 *right,
 			 node234 **root, node234 *n, int ki) {
     int lcount, rcount;
     /*
@@ -187,7 +335,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	    LOG(("  done\n"));
 	    break;
 	} else {
-	    node234 *m = snew(node234);
+	    node234 *m = newnode234(t);
 	    m->parent = n->parent;
 	    LOG(("  splitting a 4-node; created new node %p\n", m));
 	    /*
@@ -283,7 +431,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	return 0;		       /* root unchanged */
     } else {
 	LOG(("  root is overloaded, split into two\n"));
-	(*root) = snew(node234);
+	(*root) = newnode234(t);
 	(*root)->kids[0] = left;     (*root)->counts[0] = lcount;
 	(*root)->elems[0] = e;
 	(*root)->kids[1] = right;    (*root)->counts[1] = rcount;
@@ -314,7 +462,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 
     LOG(("adding element \"%s\" to tree %p\n", e, t));
     if (t->root == NULL) {
-	t->root = snew(node234);
+	t->root = newnode234(t);
 	t->root->elems[1] = t->root->elems[2] = NULL;
 	t->root->kids[0] = t->root->kids[1] = NULL;
 	t->root->kids[2] = t->root->kids[3] = NULL;
@@ -382,7 +530,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 	n = n->kids[ki];
     }
 
-    add234_insert(NULL, e, NULL, &t->root, n, ki);
+    add234_insert(t, NULL, e, NULL, &t->root, n, ki);
 
     return orig_e;
 }
@@ -437,6 +585,117 @@ void *index234(tree234 *t, int index) {
     return NULL;
 }
 
+/*
+ * Iterators. An iterator points at an element by its node and its
+ * index within the node; node is NULL once the iterator has run off
+ * either end.
+ */
+static void *iterset234(iter234 *it, node234 *n, int ki) {
+    it->node = n;
+    it->ki = ki;
+    return n ? n->elems[ki] : NULL;
+}
+
+static int kidindex234(node234 *n) {
+    int i;
+    for (i = 0; n->parent->kids[i] != n; i++);
+    return i;
+}
+
+void *first234(tree234 *t, iter234 *it) {
+    node234 *n = t->root;
+    if (n)
+	while (n->kids[0])
+	    n = n->kids[0];
+    return iterset234(it, n, 0);
+}
+
+void *last234(tree234 *t, iter234 *it) {
+    node234 *n = t->root;
+    int ki = 0;
+    while (n) {
+	ki = n->elems[2] ? 2 : n->elems[1] ? 1 : 0;
+	if (!n->kids[ki+1])
+	    break;
+	n = n->kids[ki+1];
+    }
+    return iterset234(it, n, ki);
+}
+
+void *iterpos234(tree234 *t, int index, iter234 *it) {
+    node234 *n = t->root;
+    int ki;
+
+    if (!n || index < 0 || index >= countnode234(n))
+	return iterset234(it, NULL, 0);
+
+    while (1) {
+	for (ki = 0; ki < 3; ki++) {
+	    if (index < n->counts[ki])
+		break;
+	    index -= n->counts[ki];
+	    if (index == 0)
+		return iterset234(it, n, ki);
+	    index--;
+	}
+	n = n->kids[ki];
+    }
+}
+
+void *next234(iter234 *it) {
+    node234 *n = it->node;
+    int ki = it->ki;
+
+    if (!n)
+	return NULL;
+    if (n->kids[ki+1]) {
+	/* Down to the leftmost element of the subtree after this one. */
+	n = n->kids[ki+1];
+	while (n->kids[0])
+	    n = n->kids[0];
+	return iterset234(it, n, 0);
+    }
+    if (ki < 2 && n->elems[ki+1])
+	return iterset234(it, n, ki+1);
+    /* Up until we come out of a subtree with an element to its right. */
+    while (n->parent) {
+	ki = kidindex234(n);
+	n = n->parent;
+	if (ki < 3 && n->elems[ki])
+	    return iterset234(it, n, ki);
+    }
+    return iterset234(it, NULL, 0);
+}
+
+void *prev234(iter234 *it) {
+    node234 *n = it->node;
+    int ki = it->ki;
+
+    if (!n)
+	return NULL;
+    if (n->kids[ki]) {
+	/* Down to the rightmost element of the subtree before this one. */
+	n = n->kids[ki];
+	while (1) {
+	    ki = n->elems[2] ? 2 : n->elems[1] ? 1 : 0;
+	    if (!n->kids[ki+1])
+		break;
+	    n = n->kids[ki+1];
+	}
+	return iterset234(it, n, ki);
+    }
+    if (ki > 0)
+	return iterset234(it, n, ki-1);
+    /* Up until we come out of a subtree with an element to its left. */
+    while (n->parent) {
+	ki = kidindex234(n);
+	n = n->parent;
+	if (ki > 0)
+	    return iterset234(it, n, ki-1);
+    }
+    return iterset234(it, NULL, 0);
+}
+
 /*
  * Find an element e in a sorted 2-3-4 tree t. Returns NULL if not
  * found. e is always passed as the first argument to cmp, so cmp
@@ -779,7 +1038,8 @@ static void trans234_subtree_left(node234 *n, int ki, int *k, int *index) {
  *   /     \       ->        |
  *  a   b B c C d      a A b B c C d
  */
-static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
+static void trans234_subtree_merge(tree234 *t, node234 *n, int ki,
+				  int *k, int *index) {
     node234 *left, *right;
     int i, leftlen, rightlen, lsize, rsize;
 
@@ -823,7 +1083,7 @@ static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
 
     n->counts[ki] += rightlen + 1;
 
-    sfree(right);
+    releasenode234(t, right);
 
     /*
      * Move the rest of n up by one.
@@ -950,7 +1210,7 @@ static void *delpos234_internal(tree234 *t, int index) {
 		 * ki is small with only small neighbours. Pick a
 		 * neighbour and merge with it.
 		 */
-		trans234_subtree_merge(n, ki>0 ? ki-1 : ki, &ki, &index);
+		trans234_subtree_merge(t, n, ki>0 ? ki-1 : ki, &ki, &index);
 		sub = n->kids[ki];
 
 		if (!n->elems[0]) {
@@ -961,7 +1221,7 @@ static void *delpos234_internal(tree234 *t, int index) {
 		    LOG(("  shifting root!\n"));
 		    t->root = sub;
 		    sub->parent = NULL;
-		    sfree(n);
+		    releasenode234(t, n);
 		    n = NULL;
 		}
 	    }
@@ -993,7 +1253,7 @@ static void *delpos234_internal(tree234 *t, int index) {
     if (!n->elems[0]) {
 	LOG(("  removed last element in tree, destroying empty root\n"));
 	assert(n == t->root);
-	sfree(n);
+	releasenode234(t, n);
 	t->root = NULL;
     }
 
@@ -1024,8 +1284,11 @@ void *del234(tree234 *t, void *e) {
  * The value returned in `height' is 0 or 1 depending on whether the
  * resulting tree is the same height as the original larger one, or
  * one higher.
+ *
+ * New nodes come from t, which (like the trees the subtrees came
+ * from) must not be pooled, since the result takes in nodes from both.
  */
-static node234 *join234_internal(node234 *left, void *sep,
+static node234 *join234_internal(tree234 *t, node234 *left, void *sep,
 				 node234 *right, int *height) {
     node234 *root, *node;
     int relht = *height;
@@ -1040,7 +1303,7 @@ static node234 *join234_internal(node234 *left, void *sep,
 	 * nodes.
 	 */
 	node234 *newroot;
-	newroot = snew(node234);
+	newroot = newnode234(t);
 	newroot->kids[0] = left;     newroot->counts[0] = countnode234(left);
 	newroot->elems[0] = sep;
 	newroot->kids[1] = right;    newroot->counts[1] = countnode234(right);
@@ -1100,7 +1363,7 @@ static node234 *join234_internal(node234 *left, void *sep,
     /*
      * Now proceed as for addition.
      */
-    *height = add234_insert(left, sep, right, &root, node, ki);
+    *height = add234_insert(t, left, sep, right, &root, node, ki);
 
     return root;
 }
@@ -1115,6 +1378,7 @@ static int height234(tree234 *t) {
 }
 tree234 *join234(tree234 *t1, tree234 *t2) {
     int size2 = countnode234(t2->root);
+    assert(!t1->chunksize && !t2->chunksize);
     if (size2 > 0) {
 	void *element;
 	int relht;
@@ -1128,13 +1392,14 @@ tree234 *join234(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t2, 0);
 	relht = height234(t1) - height234(t2);
-	t1->root = join234_internal(t1->root, element, t2->root, &relht);
+	t1->root = join234_internal(t1, t1->root, element, t2->root, &relht);
 	t2->root = NULL;
     }
     return t1;
 }
 tree234 *join234r(tree234 *t1, tree234 *t2) {
     int size1 = countnode234(t1->root);
+    assert(!t1->chunksize && !t2->chunksize);
     if (size1 > 0) {
 	void *element;
 	int relht;
@@ -1148,7 +1413,7 @@ tree234 *join234r(tree234 *t1, tree234 *t2) {
 
 	element = delpos234(t1, size1-1);
 	relht = height234(t1) - height234(t2);
-	t2->root = join234_internal(t1->root, element, t2->root, &relht);
+	t2->root = join234_internal(t2, t1->root, element, t2->root, &relht);
 	t1->root = NULL;
     }
     return t2;
@@ -1217,7 +1482,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	 * new node pointers in halves[0] and halves[1], and go up
 	 * a level.
 	 */
-	sib = snew(node234);
+	sib = newnode234(t);
 	for (i = 0; i < 3; i++) {
 	    if (i+ki < 3 && n->elems[i+ki]) {
 		sib->elems[i] = n->elems[i+ki];
@@ -1292,7 +1557,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	while (halves[half] && !halves[half]->elems[0]) {
 	    LOG(("  root %p is undersize, throwing away\n", halves[half]));
 	    halves[half] = halves[half]->kids[0];
-	    sfree(halves[half]->parent);
+	    releasenode234(t, halves[half]->parent);
 	    halves[half]->parent = NULL;
 	    LOG(("  new root is %p\n", halves[half]));
 	}
@@ -1349,7 +1614,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 		     * Neighbour is small, or possibly neighbour is
 		     * medium and we are undersize.
 		     */
-		    trans234_subtree_merge(n, merge, NULL, NULL);
+		    trans234_subtree_merge(t, n, merge, NULL, NULL);
 		    sub = n->kids[merge];
 		    if (!n->elems[0]) {
 			/*
@@ -1360,7 +1625,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 			LOG(("  shifting root!\n"));
 			halves[half] = sub;
 			halves[half]->parent = NULL;
-			sfree(n);
+			releasenode234(t, n);
 		    }
 		} else {
 		    /* Neighbour is big enough to move trees over. */
@@ -1381,6 +1646,7 @@ tree234 *splitpos234(tree234 *t, int index, int before) {
     node234 *n;
     int count;
 
+    assert(!t->chunksize);
     count = countnode234(t->root);
     if (index < 0 || index > count)
 	return NULL;		       /* error */
@@ -1417,9 +1683,10 @@ tree234 *split234(tree234 *t, void *e, cmpfn234 cmp, int rel) {
     return splitpos234(t, index+1, before);
 }
 
-static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
+static node234 *copynode234(tree234 *t2, node234 *n,
+			    copyfn234 copyfn, void *copyfnstate) {
     int i;
-    node234 *n2 = snew(node234);
+    node234 *n2 = newnode234(t2);
 
     for (i = 0; i < 3; i++) {
 	if (n->elems[i] && copyfn)
@@ -1430,7 +1697,7 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 
     for (i = 0; i < 4; i++) {
 	if (n->kids[i]) {
-	    n2->kids[i] = copynode234(n->kids[i], copyfn, copyfnstate);
+	    n2->kids[i] = copynode234(t2, n->kids[i], copyfn, copyfnstate);
 	    n2->kids[i]->parent = n2;
 	} else {
 	    n2->kids[i] = NULL;
@@ -1443,9 +1710,9 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     tree234 *t2;
 
-    t2 = newtree234(t->cmp);
+    t2 = (t->chunksize ? newpooltree234(t->cmp) : newtree234(t->cmp));
     if (t->root) {
-	t2->root = copynode234(t->root, copyfn, copyfnstate);
+	t2->root = copynode234(t2, t->root, copyfn, copyfnstate);
 	t2->root->parent = NULL;
     } else
 	t2->root = NULL;
@@ -1787,6 +2054,39 @@ void verifytree(tree234 *tree, void **array, int arraylen) {
         error("tree really contains %d elements, count234 gave %d",
 	      ctx.elemcount, i);
     }
+    /*
+     * And check the iterators give the same list, both ways round
+     * and from every starting index.
+     */
+    {
+        iter234 it;
+        for (i = 0, p = first234(tree, &it); p; i++, p = next234(&it))
+            if (i >= arraylen || array[i] != p)
+                error("forward iteration at position %d gave %s", i, p);
+        if (i != arraylen)
+            error("forward iteration gave %d elements, array has %d",
+                  i, arraylen);
+        for (i = arraylen, p = last234(tree, &it); p; p = prev234(&it))
+            if (--i < 0 || array[i] != p)
+                error("backward iteration at position %d gave %s", i, p);
+        if (i != 0)
+            error("backward iteration stopped at position %d", i);
+        for (i = -1; i <= arraylen; i++) {
+            iter234 it2;
+            p = iterpos234(tree, i, &it);
+            if (p != (i >= 0 && i < arraylen ? array[i] : NULL))
+                error("iterpos234(%d) gave %s", i, p);
+            if (!p)
+                continue;
+            it2 = it;
+            p = next234(&it);
+            if (p != (i+1 < arraylen ? array[i+1] : NULL))
+                error("next234 after iterpos234(%d) gave %s", i, p);
+            p = prev234(&it2);
+            if (p != (i > 0 ? array[i-1] : NULL))
+                error("prev234 after iterpos234(%d) gave %s", i, p);
+        }
+    }
 }
 void verify(void) { verifytree(tree, array, arraylen); }
 
@@ -2137,6 +2437,58 @@ int main(void) {
     }
     freetree234(tree);
 
+    /*
+     * Test buildtree234 on every size of tree up to NSTR, sorted
+     * and unsorted.
+     */
+    arraylen = 0;
+    for (i = 0; i < (int)NSTR; i++) {
+        for (j = 0; j < arraylen && mycmp(array[j], strings[i]) < 0; j++);
+        for (k = arraylen; k > j; k--)
+            array[k] = array[k-1];
+        array[j] = strings[i];
+        arraylen++;
+        tree = buildtree234(mycmp, array, arraylen);
+        cmp = mycmp;
+        verifytree(tree, array, arraylen);
+        freetree234(tree);
+        tree = buildtree234(NULL, (void **)strings, i+1);
+        cmp = NULL;
+        verifytree(tree, (void **)strings, i+1);
+        freetree234(tree);
+    }
+    cmp = mycmp;
+    tree = buildtree234(mycmp, array, 0);
+    verifytree(tree, array, 0);
+    freetree234(tree);
+
+    /*
+     * Add and delete at random in a pooled tree, so that nodes go
+     * back to its pool and come out again; check a copy of it; then
+     * free it with elements still in, which should free every node
+     * through the pool.
+     */
+    for (i = 0; i < (int)NSTR; i++) in[i] = 0;
+    arraylen = 0;
+    tree = newpooltree234(mycmp);
+    cmp = mycmp;
+    for (i = 0; i < 2000; i++) {
+        j = randomnumber(&seed);
+        j %= NSTR;
+        printf("pooled trial: %d\n", i);
+        if (in[j]) {
+            deltest(strings[j]);
+            in[j] = 0;
+        } else {
+            addtest(strings[j]);
+            in[j] = 1;
+        }
+    }
+    tree2 = copytree234(tree, NULL, NULL);
+    verifytree(tree2, array, arraylen);
+    freetree234(tree2);
+    freetree234(tree);
+
     /*
      * Test silly cases of join: join(emptytree, emptytree), and
      * also ensure join correctly spots when sorted trees fail the
@@ -44,6 +44,26 @@ typedef void *(*copyfn234)(void *state, void *element);
  */
 tree234 *newtree234(cmpfn234 cmp);
 
+/*
+ * Create a 2-3-4 tree whose nodes come from a pool belonging to the
+ * tree: they are malloced in blocks, a deleted node is kept for the
+ * next insertion rather than freed, and freetree234 frees the blocks
+ * in one go. This suits a tree that has many elements added and
+ * removed over its life, or is built up and then freed whole. The
+ * memory a pooled tree has used is not given back until it is freed,
+ * and a pooled tree can't be split or joined.
+ */
+tree234 *newpooltree234(cmpfn234 cmp);
+
+/*
+ * Create a 2-3-4 tree holding the n elements of `array', in that
+ * order, in time proportional to n: for a tree that is built once
+ * and then only looked things up in, this is cheaper than adding the
+ * elements one at a time. If `cmp' is non-NULL, the array must
+ * already be sorted by it, with no two elements comparing equal.
+ */
+tree234 *buildtree234(cmpfn234 cmp, void **array, int n);
+
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
@@ -85,6 +105,33 @@ void *addpos234(tree234 *t, void *e, int index);
  */
 void *index234(tree234 *t, int index);
 
+/*
+ * Iterate over a 2-3-4 tree in order, forwards or backwards, at
+ * amortised constant cost per step (where index234 costs log n per
+ * step). first234, last234 and iterpos234 set up the iterator at the
+ * first element, the last, or the one at a given index, and return
+ * that element; next234 and prev234 move the iterator on and return
+ * the element it reaches. All of them return NULL once there is no
+ * such element, after which the iterator stays finished.
+ *
+ *   iter234 it;
+ *   for (p = first234(tree, &it); p != NULL; p = next234(&it))
+ *       consume(p);
+ *
+ * An iterator may be copied (by structure assignment), and the copy
+ * moved independently, for instance to scan the elements after the
+ * current one. It is invalidated by any change to the tree.
+ */
+typedef struct {
+    struct node234_Tag *node;
+    int ki;
+} iter234;
+void *first234(tree234 *t, iter234 *it);
+void *last234(tree234 *t, iter234 *it);
+void *iterpos234(tree234 *t, int index, iter234 *it);
+void *next234(iter234 *it);
+void *prev234(iter234 *it);
+
 /*
  * Find an element e in a sorted 2-3-4 tree t. Returns NULL if not
  * found. e is always passed as the first argument to cmp, so cmp
@@ -195,7 +242,8 @@ tree234 *join234r(tree234 *t1, tree234 *t2);
  * reused unless copyfn is non-NULL, in which case it will be used
  * to copy each element. (copyfn takes two `void *' parameters; the
  * first is private state and the second is the element. A simple
- * copy routine probably won't need private state.)
+ * copy routine probably won't need private state.) The copy of a
+ * pooled tree is pooled.
  */
 tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate);
 
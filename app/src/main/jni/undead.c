@@ -2732,4 +2732,5 @@ const struct game thegame = {
     FALSE,                 /* wants_statusbar */
     FALSE, game_timing_state,
     0,                     /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
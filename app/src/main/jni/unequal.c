@@ -808,6 +808,7 @@ static int solver_state(game_state *state, int maxdiff)
     struct latin_solver solver;
     int diff;
 
+    PROFILE_BEGIN("unequal.solve");
     latin_solver_alloc(&solver, state->nums, state->order);
 
     diff = latin_solver_main(&solver, maxdiff,
@@ -820,6 +821,7 @@ static int solver_state(game_state *state, int maxdiff)
     free_ctx(ctx);
 
     latin_solver_free(&solver);
+    PROFILE_END("unequal.solve");
 
     if (diff == DIFF_IMPOSSIBLE)
         return -1;
@@ -1020,7 +1022,9 @@ static int game_assemble(game_state *new, int *scratch, digit *latin,
 #endif
 
     while(1) {
+#ifdef STANDALONE_SOLVER
         gg_solved++;
+#endif
         if (solver_state(copy, difficulty) == 1) break;
 
         best = gg_best_clue(copy, scratch, latin);
@@ -1051,7 +1055,9 @@ static void game_strip(game_state *new, int *scratch, digit *latin,
 
         memcpy(copy->nums,  new->nums,  o2 * sizeof(digit));
         memcpy(copy->flags, new->flags, o2 * sizeof(unsigned int));
+#ifdef STANDALONE_SOLVER
         gg_solved++;
+#endif
         if (solver_state(copy, difficulty) != 1) {
             /* put clue back, we can't solve without it. */
 #ifndef NDEBUG
@@ -1117,6 +1123,13 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
     for (i = 0; i < lscratch; i++) scratch[i] = (i%o2)*5 + 4 - (i/o2);
 
 generate:
+    if (random_cancelled(rs)) {
+        sfree(sq);
+        sfree(scratch);
+        free_game(state);
+        return NULL;
+    }
+    PROFILE_COUNT("unequal.grids");
 #ifdef STANDALONE_SOLVER
     if (solver_show_working)
         printf("new_game_desc: generating %s puzzle, ntries so far %d\n",
@@ -1137,10 +1150,18 @@ generate:
         add_adjacent_flags(state, sq);
     }
 
+#ifdef STANDALONE_SOLVER
     gg_solved = 0;
-    if (game_assemble(state, scratch, sq, params->diff) < 0)
+#endif
+    PROFILE_BEGIN("unequal.assemble");
+    if (game_assemble(state, scratch, sq, params->diff) < 0) {
+        PROFILE_END("unequal.assemble");
         goto generate;
+    }
+    PROFILE_END("unequal.assemble");
+    PROFILE_BEGIN("unequal.remove_clues");
     game_strip(state, scratch, sq, params->diff);
+    PROFILE_END("unequal.remove_clues");
 
     if (params->diff > 0) {
         game_state *copy = dup_game(state);
@@ -1153,6 +1174,7 @@ generate:
 #endif
             if (ntries < MAXTRIES) {
                 ntries++;
+                PROFILE_COUNT("unequal.too_easy");
                 goto generate;
             }
 #ifdef STANDALONE_SOLVER
@@ -2053,6 +2075,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };
 
 /* ----------------------------------------------------------------------
@@ -120,6 +120,11 @@ static int edgecmpC(const void *av, const void *bv)
 
 static int edgecmp(void *av, void *bv) { return edgecmpC(av, bv); }
 
+static int edgeptrcmpC(const void *av, const void *bv)
+{
+    return edgecmpC(*(edge *const *)av, *(edge *const *)bv);
+}
+
 static game_params *default_params(void)
 {
     game_params *ret = snew(game_params);
@@ -503,6 +508,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     point *pts, *pts2;
     long *tmp;
     tree234 *edges, *vertices;
+    iter234 it, it2;
     edge *e, *e2;
     vertex *v, *vs, *vlist;
     char *ret;
@@ -549,8 +555,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     while (1) {
 	int added = FALSE;
 
-	for (i = 0; i < n; i++) {
-	    v = index234(vertices, i);
+	for (v = first234(vertices, &it); v; v = next234(&it)) {
+	    vertex *kv;
+
 	    j = v->vindex;
 
 	    if (v->param >= MAXDEGREE)
@@ -565,8 +572,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 	     * have an edge.
 	     */
 	    m = 0;
-	    for (k = i+1; k < n; k++) {
-		vertex *kv = index234(vertices, k);
+	    it2 = it;
+	    for (kv = next234(&it2); kv; kv = next234(&it2)) {
 		int ki = kv->vindex;
 		int dx, dy;
 
@@ -596,7 +603,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 			break;
 		if (p < n)
 		    continue;
-		for (p = 0; (e = index234(edges, p)) != NULL; p++)
+		for (e = first234(edges, &it2); e; e = next234(&it2))
 		    if (e->a != ki && e->a != j &&
 			e->b != ki && e->b != j &&
 			cross(pts[ki], pts[j], pts[e->a], pts[e->b]))
@@ -639,8 +646,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     make_circle(pts2, n, w);
     while (1) {
 	shuffle(tmp, n, sizeof(*tmp), rs);
-	for (i = 0; (e = index234(edges, i)) != NULL; i++) {
-	    for (j = i+1; (e2 = index234(edges, j)) != NULL; j++) {
+	for (e = first234(edges, &it); e; e = next234(&it)) {
+	    it2 = it;
+	    for (e2 = next234(&it2); e2; e2 = next234(&it2)) {
 		if (e2->a == e->a || e2->a == e->b ||
 		    e2->b == e->a || e2->b == e->b)
 		    continue;
@@ -671,7 +679,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 	retlen = 0;
 	m = count234(edges);
 	ea = snewn(m, edge);
-	for (i = 0; (e = index234(edges, i)) != NULL; i++) {
+	for (i = 0, e = first234(edges, &it); e; i++, e = next234(&it)) {
 	    assert(i < m);
 	    ea[i].a = min(tmp[e->a], tmp[e->b]);
 	    ea[i].b = max(tmp[e->a], tmp[e->b]);
@@ -730,7 +738,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     sfree(vlist);
     freetree234(vertices);
     sfree(vs);
-    while ((e = delpos234(edges, 0)) != NULL)
+    for (e = first234(edges, &it); e; e = next234(&it))
 	sfree(e);
     freetree234(edges);
     sfree(pts);
@@ -768,10 +776,11 @@ static void mark_crossings(game_state *state)
 {
     int ok = TRUE;
     int i, j;
+    iter234 it, it2;
     edge *e, *e2;
 
 #ifdef SHOW_CROSSINGS
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++)
+    for (i = 0; i < count234(state->graph->edges); i++)
 	state->crosses[i] = FALSE;
 #endif
 
@@ -779,8 +788,10 @@ static void mark_crossings(game_state *state)
      * Check correctness: for every pair of edges, see whether they
      * cross.
      */
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
-	for (j = i+1; (e2 = index234(state->graph->edges, j)) != NULL; j++) {
+    for (i = 0, e = first234(state->graph->edges, &it); e;
+	 i++, e = next234(&it)) {
+	it2 = it;
+	for (j = i+1, e2 = next234(&it2); e2; j++, e2 = next234(&it2)) {
 	    if (e2->a == e->a || e2->a == e->b ||
 		e2->b == e->a || e2->b == e->b)
 		continue;
@@ -819,7 +830,8 @@ static game_state *new_game(midend *me, const game_params *params,
 {
     int n = params->n;
     game_state *state = snew(game_state);
-    int a, b;
+    edge **ea = NULL;
+    int a, b, i, j, m = 0, msize = 0;
 
     state->params = *params;
     state->w = state->h = COORDLIMIT(n);
@@ -827,7 +839,6 @@ static game_state *new_game(midend *me, const game_params *params,
     make_circle(state->pts, n, state->w);
     state->graph = snew(struct graph);
     state->graph->refcount = 1;
-    state->graph->edges = newtree234(edgecmp);
     state->completed = state->cheated = state->just_solved = FALSE;
 
     while (*desc) {
@@ -843,8 +854,35 @@ static game_state *new_game(midend *me, const game_params *params,
 	    assert(*desc == ',');
 	    desc++;		       /* eat comma */
 	}
-	addedge(state->graph->edges, a, b);
+	assert(a != b);
+	if (m >= msize) {
+	    msize = m * 3 / 2 + 16;
+	    ea = sresize(ea, msize, edge *);
+	}
+	ea[m] = snew(edge);
+	ea[m]->a = min(a, b);
+	ea[m]->b = max(a, b);
+	m++;
+    }
+
+    /*
+     * The edge tree is never changed after this, so build it in one
+     * go. Our own descriptions list the edges in order already; any
+     * other we sort, and drop repeated edges from.
+     */
+    for (i = 1; i < m && edgecmpC(ea[i-1], ea[i]) < 0; i++);
+    if (i < m) {
+	qsort(ea, m, sizeof(*ea), edgeptrcmpC);
+	for (i = j = 0; i < m; i++) {
+	    if (j > 0 && edgecmpC(ea[j-1], ea[i]) == 0)
+		sfree(ea[i]);
+	    else
+		ea[j++] = ea[i];
+	}
+	m = j;
     }
+    state->graph->edges = buildtree234(edgecmp, (void **)ea, m);
+    sfree(ea);
 
 #ifdef SHOW_CROSSINGS
     state->crosses = snewn(count234(state->graph->edges), int);
@@ -881,8 +919,9 @@ static game_state *dup_game(const game_state *state)
 static void free_game(game_state *state)
 {
     if (--state->graph->refcount <= 0) {
+	iter234 it;
 	edge *e;
-	while ((e = delpos234(state->graph->edges, 0)) != NULL)
+	for (e = first234(state->graph->edges, &it); e; e = next234(&it))
 	    sfree(e);
 	freetree234(state->graph->edges);
 	sfree(state->graph);
@@ -1311,6 +1350,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
                         float animtime, float flashtime)
 {
     int w, h;
+    iter234 it;
     edge *e;
     int i, j;
     int bg, points_moved;
@@ -1372,7 +1412,8 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
      * Draw the edges.
      */
 
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
+    for (i = 0, e = first234(state->graph->edges, &it); e;
+	 i++, e = next234(&it)) {
 	draw_line(dr, ds->x[e->a], ds->y[e->a], ds->x[e->b], ds->y[e->b],
 #ifdef SHOW_CROSSINGS
 		  (oldstate?oldstate:state)->crosses[i] ?
@@ -1508,4 +1549,5 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     SOLVE_ANIMATES,		       /* flags */
+    NULL, NULL,			       /* encode_state, decode_state */
 };